@@ -0,0 +1,434 @@
+#include "ArchiveCatalog.h"
+#include "../compression/BlockArchive.h"
+#include "../compression/Huffman.h"
+#include "../concurrency/ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+using namespace std;
+
+// Catalog file, little-endian:
+//   "HCAT" | version u8 | archive count u32
+//   per archive  path | file size u64 | modified i64 | summary | block count u32 | block summaries
+//   summary      records u64 | minTime | maxTime | hashes u8 | filter words u32 | words u64...
+// Strings are a u32 length followed by the bytes.
+static const char MAGIC[4] = {'H', 'C', 'A', 'T'};
+static constexpr uint8_t VERSION = 1;
+static constexpr size_t SCAN_CHUNK = 1 << 20;
+
+enum class Scan { More, Stop, Error };
+
+static void putU32(string &s, uint32_t v) { for (int i = 0; i < 4; ++i) s.push_back(char(v >> (8 * i))); }
+static void putU64(string &s, uint64_t v) { for (int i = 0; i < 8; ++i) s.push_back(char(v >> (8 * i))); }
+static void putString(string &s, const string &v) { putU32(s, uint32_t(v.size())); s += v; }
+
+// Bounds-checked reader over the loaded catalog file.
+struct CatalogInput {
+    const string &buf;
+    size_t pos = 0;
+    bool ok = true;
+
+    uint64_t get(int bytes) {
+        if (!ok || buf.size() - pos < size_t(bytes)) { ok = false; return 0; }
+        uint64_t v = 0;
+        for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | static_cast<uint8_t>(buf[pos + i]);
+        pos += bytes;
+        return v;
+    }
+    string getString() {
+        uint64_t len = get(4);
+        if (!ok || buf.size() - pos < len) { ok = false; return string(); }
+        string s = buf.substr(pos, len);
+        pos += len;
+        return s;
+    }
+};
+
+static void putSummary(string &s, const RecordSummary &r) {
+    putU64(s, r.records);
+    putString(s, r.minTime);
+    putString(s, r.maxTime);
+    s.push_back(char(r.accounts.hashCount()));
+    putU32(s, uint32_t(r.accounts.data().size()));
+    for (uint64_t w : r.accounts.data()) putU64(s, w);
+}
+
+static bool getSummary(CatalogInput &in, RecordSummary &r) {
+    r.records = in.get(8);
+    r.minTime = in.getString();
+    r.maxTime = in.getString();
+    uint8_t hashes = uint8_t(in.get(1));
+    uint64_t count = in.get(4);
+    if (!in.ok || (in.buf.size() - in.pos) / 8 < count) return false;
+    vector<uint64_t> words(count);
+    for (uint64_t &w : words) w = in.get(8);
+    r.accounts.assign(move(words), hashes);
+    return in.ok;
+}
+
+// Archives are cataloged by absolute path, so queries work from any working directory.
+static string catalogKey(const string &path) {
+    error_code ec;
+    filesystem::path abs = filesystem::absolute(path, ec);
+    return ec ? path : abs.lexically_normal().string();
+}
+
+static bool fileStamp(const string &path, uint64_t &size, int64_t &modified) {
+    error_code ec;
+    size = filesystem::file_size(path, ec);
+    if (ec) return false;
+    auto t = filesystem::last_write_time(path, ec);
+    if (ec) return false;
+    modified = int64_t(t.time_since_epoch().count());
+    return true;
+}
+
+// The fields of one "timestamp|type|amount|relatedAccount" line that queries look at.
+// Lines that Transaction::deserialize would not accept are not records.
+struct LineFields {
+    string_view timestamp, type, amount;
+    int account = -1;
+};
+
+static bool splitLine(string_view line, LineFields &f) {
+    size_t a = line.find('|');
+    if (a == string_view::npos) return false;
+    size_t b = line.find('|', a + 1);
+    if (b == string_view::npos) return false;
+    size_t c = line.find('|', b + 1);
+    f.timestamp = line.substr(0, a);
+    f.type = line.substr(a + 1, b - a - 1);
+    f.amount = line.substr(b + 1, c == string_view::npos ? string_view::npos : c - b - 1);
+    if (f.amount.empty()) return false;
+    f.account = -1;
+    if (c == string_view::npos) return true;
+    string_view rel = line.substr(c + 1);
+    rel = rel.substr(0, rel.find('|'));
+    size_t i = 0;
+    bool negative = !rel.empty() && rel[0] == '-';
+    if (negative || (!rel.empty() && rel[0] == '+')) ++i;
+    if (i == rel.size()) return false;
+    int64_t v = 0;
+    for (; i < rel.size(); ++i) {
+        if (rel[i] < '0' || rel[i] > '9') return false;
+        v = v * 10 + (rel[i] - '0');
+        if (v > INT32_MAX) return false;
+    }
+    f.account = int(negative ? -v : v);
+    return true;
+}
+
+// Calls fn for every line in text; a final line without '\n' counts too.
+template <typename F>
+static bool forEachLine(string_view text, F fn) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        size_t end = nl == string_view::npos ? text.size() : nl;
+        string_view line = text.substr(pos, end - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (!fn(line)) return false;
+        pos = end + 1;
+    }
+    return true;
+}
+
+// Streams a plain text file in SCAN_CHUNK pieces cut after a newline.
+template <typename F>
+static bool forEachChunk(const string &path, F fn) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    string chunk, carry;
+    vector<char> buf(SCAN_CHUNK);
+    while (in) {
+        in.read(buf.data(), buf.size());
+        size_t got = size_t(in.gcount());
+        if (got == 0) break;
+        chunk = move(carry);
+        chunk.append(buf.data(), got);
+        size_t cut = chunk.rfind('\n');
+        carry = cut == string::npos ? move(chunk) : chunk.substr(cut + 1);
+        if (cut == string::npos) continue;
+        chunk.resize(cut + 1);
+        if (!fn(chunk)) return true;
+    }
+    if (!carry.empty()) fn(carry);
+    return !in.bad();
+}
+
+static bool inRange(string_view ts, const ArchiveQuery &q) {
+    if (q.from.empty() && q.to.empty()) return true;
+    if (ts.empty()) return false;
+    if (!q.from.empty() && ts < q.from) return false;
+    if (!q.to.empty() && ts.substr(0, q.to.size()) > q.to) return false;
+    return true;
+}
+
+static bool mayMatch(const RecordSummary &s, const ArchiveQuery &q) {
+    if (s.records == 0) return false;
+    if (q.account != ArchiveQuery::ANY_ACCOUNT && !s.accounts.mayContain(q.account)) return false;
+    if (q.from.empty() && q.to.empty()) return true;
+    if (s.minTime.empty()) return false; // nothing in it has a time to match
+    if (!q.from.empty() && s.maxTime < q.from) return false;
+    if (!q.to.empty() && string_view(s.minTime).substr(0, q.to.size()) > q.to) return false;
+    return true;
+}
+
+// Runs the matching records of 'text' through the callback.
+static Scan emitMatches(string_view text, const ArchiveQuery &q, const string &path,
+                        const ArchiveCatalog::RecordFn &onRecord, QueryStats &stats) {
+    bool more = forEachLine(text, [&](string_view line) {
+        LineFields f;
+        if (!splitLine(line, f)) return true;
+        if (q.account != ArchiveQuery::ANY_ACCOUNT && f.account != q.account) return true;
+        if (!inRange(f.timestamp, q)) return true;
+        ++stats.matches;
+        Transaction tr(string(f.timestamp), string(f.type), strtod(string(f.amount).c_str(), nullptr), f.account);
+        return onRecord(tr, path);
+    });
+    return more ? Scan::More : Scan::Stop;
+}
+
+void ArchiveSummaryBuilder::addBlock(const char *data, size_t len) {
+    RecordSummary s;
+    vector<int> seen;
+    forEachLine(string_view(data, len), [&](string_view line) {
+        LineFields f;
+        if (!splitLine(line, f)) return true;
+        ++s.records;
+        seen.push_back(f.account);
+        if (!f.timestamp.empty()) {
+            if (s.minTime.empty() || f.timestamp < s.minTime) s.minTime = string(f.timestamp);
+            if (s.maxTime.empty() || f.timestamp > s.maxTime) s.maxTime = string(f.timestamp);
+        }
+        return true;
+    });
+    sort(seen.begin(), seen.end());
+    seen.erase(unique(seen.begin(), seen.end()), seen.end());
+    s.accounts = BloomFilter(seen.size());
+    for (int a : seen) s.accounts.add(a);
+
+    size_t mid = accounts.size();
+    accounts.insert(accounts.end(), seen.begin(), seen.end());
+    inplace_merge(accounts.begin(), accounts.begin() + mid, accounts.end());
+    accounts.erase(unique(accounts.begin(), accounts.end()), accounts.end());
+    blocks.push_back(move(s));
+}
+
+bool ArchiveSummaryBuilder::finish(const string &path, ArchiveEntry &entry) {
+    entry = ArchiveEntry();
+    entry.path = catalogKey(path);
+    if (!fileStamp(path, entry.fileSize, entry.modified)) return false;
+    RecordSummary &all = entry.summary;
+    for (const RecordSummary &b : blocks) {
+        all.records += b.records;
+        if (!b.minTime.empty() && (all.minTime.empty() || b.minTime < all.minTime)) all.minTime = b.minTime;
+        if (b.maxTime > all.maxTime) all.maxTime = b.maxTime;
+    }
+    all.accounts = BloomFilter(accounts.size());
+    for (int a : accounts) all.accounts.add(a);
+    entry.blocks = move(blocks);
+    blocks.clear();
+    accounts.clear();
+    return true;
+}
+
+ArchiveCatalog::ArchiveCatalog(const string &catalogPath) : catalogPath(catalogPath) {}
+
+bool ArchiveCatalog::load() {
+    lock_guard<mutex> lk(mtx);
+    archives.clear();
+    ifstream in(catalogPath, ios::binary);
+    if (!in) return !filesystem::exists(catalogPath);
+    string buf((istreambuf_iterator<char>(in)), {});
+    if (buf.size() < 9 || buf.compare(0, 4, MAGIC, 4) != 0 || uint8_t(buf[4]) != VERSION) return false;
+    CatalogInput input{buf, 5};
+    uint64_t count = input.get(4);
+    vector<ArchiveEntry> loaded;
+    for (uint64_t i = 0; i < count && input.ok; ++i) {
+        ArchiveEntry e;
+        e.path = input.getString();
+        e.fileSize = input.get(8);
+        e.modified = int64_t(input.get(8));
+        if (!getSummary(input, e.summary)) return false;
+        uint64_t blockCount = input.get(4);
+        for (uint64_t b = 0; b < blockCount && input.ok; ++b) {
+            RecordSummary s;
+            if (!getSummary(input, s)) return false;
+            e.blocks.push_back(move(s));
+        }
+        loaded.push_back(move(e));
+    }
+    if (!input.ok || input.pos != buf.size()) return false;
+    archives = move(loaded);
+    return true;
+}
+
+bool ArchiveCatalog::save() {
+    lock_guard<mutex> lk(mtx);
+    return saveLocked();
+}
+
+bool ArchiveCatalog::saveLocked() {
+    string buf(MAGIC, 4);
+    buf.push_back(char(VERSION));
+    putU32(buf, uint32_t(archives.size()));
+    for (const ArchiveEntry &e : archives) {
+        putString(buf, e.path);
+        putU64(buf, e.fileSize);
+        putU64(buf, uint64_t(e.modified));
+        putSummary(buf, e.summary);
+        putU32(buf, uint32_t(e.blocks.size()));
+        for (const RecordSummary &s : e.blocks) putSummary(buf, s);
+    }
+    // Write aside and rename, so a crash leaves either the old catalog or the new one.
+    string tmp = catalogPath + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out.write(buf.data(), buf.size())) return false;
+    }
+    error_code ec;
+    filesystem::rename(tmp, catalogPath, ec);
+    return !ec;
+}
+
+bool ArchiveCatalog::add(ArchiveEntry entry) {
+    lock_guard<mutex> lk(mtx);
+    auto it = find_if(archives.begin(), archives.end(), [&](const ArchiveEntry &e) { return e.path == entry.path; });
+    if (it != archives.end()) *it = move(entry);
+    else archives.push_back(move(entry));
+    return saveLocked();
+}
+
+bool ArchiveCatalog::addArchive(const string &archivePath) {
+    ArchiveSummaryBuilder builder;
+    ArchiveEntry entry;
+    if (BlockArchiveReader::isBlockArchive(archivePath)) {
+        BlockArchiveReader reader;
+        if (!reader.open(archivePath)) return false;
+        string block;
+        for (size_t i = 0; i < reader.blockCount(); ++i) {
+            if (!reader.readBlock(i, block)) return false;
+            builder.addBlock(block.data(), block.size());
+        }
+        if (!builder.finish(archivePath, entry)) return false;
+    } else {
+        // Single-stream archive: summarized as a whole, and decoded as a whole when it may match.
+        string plain = archivePath + ".scan";
+        bool ok = Huffman::decompressFile(archivePath, plain) &&
+                  forEachChunk(plain, [&](const string &text) { builder.addBlock(text.data(), text.size()); return true; });
+        error_code ec;
+        filesystem::remove(plain, ec);
+        if (!ok || !builder.finish(archivePath, entry)) return false;
+        entry.blocks.clear();
+    }
+    return add(move(entry));
+}
+
+bool ArchiveCatalog::remove(const string &archivePath) {
+    string key = catalogKey(archivePath);
+    lock_guard<mutex> lk(mtx);
+    auto it = find_if(archives.begin(), archives.end(), [&](const ArchiveEntry &e) { return e.path == key; });
+    if (it == archives.end()) return false;
+    archives.erase(it);
+    return saveLocked();
+}
+
+vector<ArchiveEntry> ArchiveCatalog::entries() const {
+    lock_guard<mutex> lk(mtx);
+    return archives;
+}
+
+// Current entry for 'path', re-indexing the archive if the file changed since it was cataloged.
+bool ArchiveCatalog::freshEntry(const string &path, ArchiveEntry &entry) {
+    uint64_t size;
+    int64_t modified;
+    if (!fileStamp(path, size, modified)) return false;
+    {
+        lock_guard<mutex> lk(mtx);
+        for (const ArchiveEntry &e : archives) {
+            if (e.path != path) continue;
+            if (e.fileSize == size && e.modified == modified) { entry = e; return true; }
+            break;
+        }
+    }
+    if (!addArchive(path)) return false;
+    lock_guard<mutex> lk(mtx);
+    for (const ArchiveEntry &e : archives)
+        if (e.path == path) { entry = e; return true; }
+    return false;
+}
+
+// Decodes the candidate blocks of a block archive a few ahead on the pool, and scans them in order.
+static Scan queryBlocks(const ArchiveEntry &e, const ArchiveQuery &q, const ArchiveCatalog::RecordFn &onRecord,
+                        ThreadPool &pool, QueryStats &stats) {
+    BlockArchiveReader reader;
+    if (!reader.open(e.path) || reader.blockCount() != e.blocks.size()) return Scan::Error;
+    vector<size_t> candidates;
+    for (size_t i = 0; i < e.blocks.size(); ++i)
+        if (mayMatch(e.blocks[i], q)) candidates.push_back(i);
+    stats.blocksSkipped += e.blocks.size() - candidates.size();
+
+    using Decoded = pair<bool, string>;
+    deque<future<Decoded>> ahead;
+    size_t next = 0;
+    auto dispatch = [&] {
+        size_t i = candidates[next++];
+        ahead.push_back(pool.submit([&reader, i] {
+            Decoded d;
+            d.first = reader.readBlock(i, d.second);
+            return d;
+        }));
+    };
+    Scan result = Scan::More;
+    while (result == Scan::More && (next < candidates.size() || !ahead.empty())) {
+        while (next < candidates.size() && ahead.size() < 2 * pool.size()) dispatch();
+        Decoded d = ahead.front().get();
+        ahead.pop_front();
+        ++stats.blocksDecoded;
+        result = d.first ? emitMatches(d.second, q, e.path, onRecord, stats) : Scan::Error;
+    }
+    for (auto &f : ahead) f.wait(); // tasks still reference the reader
+    return result;
+}
+
+static Scan queryStream(const ArchiveEntry &e, const ArchiveQuery &q, const ArchiveCatalog::RecordFn &onRecord,
+                        QueryStats &stats) {
+    string plain = e.path + ".scan";
+    if (!Huffman::decompressFile(e.path, plain)) return Scan::Error;
+    ++stats.blocksDecoded;
+    Scan result = Scan::More;
+    bool ok = forEachChunk(plain, [&](const string &text) {
+        result = emitMatches(text, q, e.path, onRecord, stats);
+        return result == Scan::More;
+    });
+    error_code ec;
+    filesystem::remove(plain, ec);
+    return ok ? result : Scan::Error;
+}
+
+bool ArchiveCatalog::query(const ArchiveQuery &q, RecordFn onRecord, QueryStats *stats, size_t threads) {
+    QueryStats local;
+    QueryStats &st = stats ? *stats : local;
+    st = QueryStats();
+    vector<ArchiveEntry> list = entries();
+    stable_sort(list.begin(), list.end(), [](const ArchiveEntry &a, const ArchiveEntry &b) {
+        return a.summary.minTime < b.summary.minTime;
+    });
+    if (threads == 0) threads = thread::hardware_concurrency();
+    ThreadPool pool(threads ? threads : 1);
+    bool ok = true;
+    for (const ArchiveEntry &cached : list) {
+        ArchiveEntry e;
+        if (!freshEntry(cached.path, e) || !mayMatch(e.summary, q)) { ++st.archivesSkipped; continue; }
+        ++st.archivesSearched;
+        Scan r = e.blocks.empty() ? queryStream(e, q, onRecord, st) : queryBlocks(e, q, onRecord, pool, st);
+        if (r == Scan::Stop) break;
+        if (r == Scan::Error) ok = false;
+    }
+    return ok;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "BloomFilter.h"
+#include "../core/Transaction.h"
+using namespace std;
+
+// What a stretch of archived log (one block, or a whole archive) contains, enough to rule it
+// out of a query without decoding it.
+struct RecordSummary {
+    uint64_t records = 0;
+    string minTime, maxTime; // ISO-8601 timestamps; empty if no record carried one
+    BloomFilter accounts;    // relatedAccount of every record
+};
+
+struct ArchiveEntry {
+    string path;
+    uint64_t fileSize = 0; // with 'modified', tells whether the file changed since it was indexed
+    int64_t modified = 0;
+    RecordSummary summary;
+    vector<RecordSummary> blocks; // one per block archive block; empty for single-stream archives
+};
+
+// Time bounds are inclusive and compared as ISO-8601 prefixes, so "2024-03-31" as 'to'
+// covers that whole day. Empty bounds are open.
+struct ArchiveQuery {
+    static constexpr int ANY_ACCOUNT = -2; // -1 is a real relatedAccount ("none")
+    int account = ANY_ACCOUNT;
+    string from, to;
+};
+
+struct QueryStats {
+    size_t archivesSearched = 0, archivesSkipped = 0;
+    size_t blocksDecoded = 0, blocksSkipped = 0;
+    uint64_t matches = 0;
+};
+
+// Collects the per-block summaries of an archive while it is being written. Blocks must be
+// added with exactly the boundaries the archive writer uses.
+class ArchiveSummaryBuilder {
+public:
+    void addBlock(const char *data, size_t len);
+    // Entry for 'path'; the file must exist so its size and time can be recorded.
+    bool finish(const string &path, ArchiveEntry &entry);
+
+private:
+    vector<RecordSummary> blocks;
+    vector<int> accounts; // distinct across all blocks, for the archive-wide filter
+};
+
+// Local index of the .huff archives written by the archive job. Queries use it to skip
+// archives, and blocks within them, that cannot hold a match; only the rest are decoded,
+// and matching records are streamed to the caller in log order per archive.
+class ArchiveCatalog {
+public:
+    // false from the callback stops the query.
+    using RecordFn = function<bool(const Transaction &record, const string &archivePath)>;
+
+    explicit ArchiveCatalog(const string &catalogPath);
+
+    bool load(); // a missing catalog file is an empty catalog
+    bool save();
+
+    // Adds or replaces the entry for entry.path and saves the catalog.
+    bool add(ArchiveEntry entry);
+    // Indexes an existing archive by decoding it once (e.g. archives written before the catalog).
+    bool addArchive(const string &archivePath);
+    bool remove(const string &archivePath);
+    vector<ArchiveEntry> entries() const;
+
+    // Archives are searched oldest first. Ones that changed on disk since they were indexed
+    // are re-indexed; missing ones are skipped. 'threads' decode candidate blocks ahead of
+    // the callback (0 = one per core).
+    bool query(const ArchiveQuery &q, RecordFn onRecord, QueryStats *stats = nullptr, size_t threads = 0);
+
+private:
+    string catalogPath;
+    mutable mutex mtx;
+    vector<ArchiveEntry> archives;
+
+    bool saveLocked();
+    bool freshEntry(const string &path, ArchiveEntry &entry);
+};
@@ -0,0 +1,130 @@
+#include "ArchiveJob.h"
+#include "ArchiveCatalog.h"
+#include "../core/Bank.h"
+#include "../crypto/CryptoUtils.h"
+#include "../compression/BlockArchive.h"
+#include "../concurrency/BoundedQueue.h"
+#include <filesystem>
+using namespace std;
+
+static constexpr size_t CHUNK_SIZE = 256 * 1024;
+static constexpr size_t QUEUE_DEPTH = 4; // chunks in flight per stage boundary
+
+// Decrypts 'path' into CHUNK_SIZE pieces on the queue; always closes it.
+static bool decryptStage(const string &path, string_view password, BoundedQueue<string> &out,
+                         const atomic<bool> &cancelled) {
+    string chunk;
+    chunk.reserve(CHUNK_SIZE);
+    bool ok = CryptoUtils::decryptStream(path, password, [&](const unsigned char *data, size_t len) {
+        if (cancelled) return false;
+        chunk.append(reinterpret_cast<const char*>(data), len);
+        if (chunk.size() >= CHUNK_SIZE) {
+            if (!out.push(move(chunk))) return false;
+            chunk.clear();
+            chunk.reserve(CHUNK_SIZE);
+        }
+        return true;
+    });
+    if (ok && !chunk.empty()) ok = out.push(move(chunk));
+    out.close();
+    return ok;
+}
+
+ArchiveJob::ArchiveJob(Bank &bank, const string &archivePath, string_view password, ArchiveCatalog *catalog,
+                       EntropyCodec::Id entropy)
+    : bank(bank), archivePath(archivePath), password(password), catalog(catalog), entropy(entropy) {}
+
+ArchiveJob::~ArchiveJob() {
+    cancel();
+    if (runner.joinable()) runner.join();
+}
+
+void ArchiveJob::start(ProgressFn progress, DoneFn done) {
+    onProgress = move(progress);
+    onDone = move(done);
+    runner = thread([this] { run(); });
+}
+
+void ArchiveJob::cancel() {
+    cancelled = true;
+}
+
+void ArchiveJob::advance(uint64_t bytes) {
+    progressDone += bytes;
+    if (onProgress) onProgress(min(progressDone, progressTotal), progressTotal);
+}
+
+void ArchiveJob::run() {
+    string source = archivePath + ".src";
+    string partial = archivePath + ".part";
+    string message;
+    Result result;
+    if (!bank.snapshotLog(source)) {
+        result = Result::Failed;
+        message = "No transaction log to archive.";
+    } else {
+        result = runStages(source, partial, message);
+    }
+    error_code ec;
+    filesystem::remove(source, ec);
+    filesystem::remove(partial, ec);
+    if (onDone) onDone(result, message);
+}
+
+ArchiveJob::Result ArchiveJob::runStages(const string &source, const string &partial, string &message) {
+    error_code ec;
+    if (!CryptoUtils::plainSize(source, progressTotal)) progressTotal = 0;
+    progressDone = 0;
+
+    BlockArchiveWriter writer(BlockArchiveWriter::DEFAULT_BLOCK_SIZE, 0, BlockCodec::Transactions, entropy);
+    if (!writer.open(partial)) { message = "Cannot create archive file."; return Result::Failed; }
+
+    // Stage 1 decrypts on its own thread; this thread cuts the plaintext into blocks at record
+    // boundaries and hands them to the writer, which encodes them on its pool (stage 2) and
+    // writes them back in order (stage 3). Every hand-off is bounded. The catalog summary of
+    // each block is taken here, from the same boundaries.
+    BoundedQueue<string> plain(QUEUE_DEPTH);
+    ArchiveSummaryBuilder summary;
+    bool decrypted = false;
+    thread decryptor([&] { decrypted = decryptStage(source, password, plain, cancelled); });
+    string pending, chunk;
+    bool written = true;
+    while (plain.pop(chunk)) {
+        if (!written) continue; // keep draining so the decryptor can finish
+        pending += chunk;
+        advance(chunk.size());
+        if (pending.size() >= BlockArchiveWriter::DEFAULT_BLOCK_SIZE) {
+            size_t cut = pending.rfind('\n');
+            cut = (cut == string::npos) ? pending.size() : cut + 1;
+            if (catalog) summary.addBlock(pending.data(), cut);
+            written = writer.writeBlock(pending.substr(0, cut));
+            pending.erase(0, cut);
+        }
+        if (!written) cancelled = true; // stop the decryptor
+    }
+    decryptor.join();
+    if (written && !pending.empty()) {
+        if (catalog) summary.addBlock(pending.data(), pending.size());
+        written = writer.writeBlock(move(pending));
+    }
+    uint64_t plainBytes = writer.rawBytes();
+    written = writer.close(true) && written;
+    if (!written) { message = "Failed to write archive."; return Result::Failed; }
+    if (cancelled) return Result::Cancelled;
+    if (!decrypted) { message = "Failed to decrypt log."; return Result::Failed; }
+    if (plainBytes == 0) { message = "Transaction log is empty."; return Result::Failed; }
+
+    // The archive is durable; only now give up the records it holds.
+    filesystem::rename(partial, archivePath, ec);
+    if (ec) { message = "Failed to move archive into place."; return Result::Failed; }
+    string note;
+    ArchiveEntry entry;
+    if (catalog && !(summary.finish(archivePath, entry) && catalog->add(move(entry))))
+        note = " (it could not be added to the archive catalog)";
+    if (!bank.trimLog(plainBytes)) {
+        message = "Archive created: " + archivePath + note + ", but the log could not be trimmed.";
+        return Result::Failed;
+    }
+    message = "Archive created: " + archivePath + note;
+    return Result::Done;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "../compression/EntropyCodec.h"
+#include "../crypto/SecureArena.h"
+using namespace std;
+
+class ArchiveCatalog;
+class Bank;
+
+// Archives the encrypted transaction log into a .huff file without blocking the caller.
+// Decrypt, compress and write run as separate pipeline stages with bounded hand-offs, so
+// memory stays at a few blocks regardless of log size and no plaintext touches the disk.
+// The bank's log is trimmed only after the archive has been synced and renamed into place.
+class ArchiveJob {
+public:
+    enum class Result { Done, Cancelled, Failed };
+    using ProgressFn = function<void(uint64_t done, uint64_t total)>;
+    using DoneFn = function<void(Result result, const string &message)>;
+
+    // 'entropy' picks the coder behind the transaction columns; it is recorded in the archive.
+    // A finished archive is registered in 'catalog', if given, which must outlive the job.
+    ArchiveJob(Bank &bank, const string &archivePath, string_view password,
+               ArchiveCatalog *catalog = nullptr, EntropyCodec::Id entropy = EntropyCodec::RANS);
+    ~ArchiveJob(); // cancels if still running and waits for the worker
+
+    // Both callbacks run on the job's thread.
+    void start(ProgressFn progress, DoneFn done);
+    void cancel();
+
+private:
+    Bank &bank;
+    string archivePath;
+    SecureString password;
+    ArchiveCatalog *catalog;
+    EntropyCodec::Id entropy;
+    ProgressFn onProgress;
+    DoneFn onDone;
+    thread runner;
+    atomic<bool> cancelled{false};
+    uint64_t progressDone = 0;
+    uint64_t progressTotal = 0;
+
+    void run();
+    Result runStages(const string &source, const string &partial, string &message);
+    void advance(uint64_t bytes);
+};
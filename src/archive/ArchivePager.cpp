@@ -0,0 +1,238 @@
+#include "ArchivePager.h"
+#include "../compression/Huffman.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+using namespace std;
+
+static size_t countNewlines(const char *p, size_t len) {
+    size_t n = 0;
+    const char *end = p + len;
+    while ((p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr) {
+        ++n;
+        ++p;
+    }
+    return n;
+}
+
+static void lowerAscii(string &s) {
+    for (char &c : s)
+        if (c >= 'A' && c <= 'Z') c = char(c - 'A' + 'a');
+}
+
+ArchivePager::ArchivePager(size_t cachePages) : cacheCapacity(max<size_t>(cachePages, 2)) {}
+
+ArchivePager::~ArchivePager() {
+    close();
+}
+
+void ArchivePager::close() {
+    stopping = true;
+    ++searchGeneration;
+    if (indexer.joinable()) indexer.join();
+    if (searcher.joinable()) searcher.join();
+    if (temp.is_open()) temp.close();
+    if (!tempPath.empty()) {
+        error_code ec;
+        filesystem::remove(tempPath, ec);
+        tempPath.clear();
+    }
+}
+
+bool ArchivePager::open(const string &path) {
+    pageOffsets.clear();
+    if (BlockArchiveReader::isBlockArchive(path)) {
+        if (!blocks.open(path)) return false;
+        blockMode = true;
+        for (size_t i = 0; i < blocks.blockCount(); ++i) pageOffsets.push_back(blocks.block(i).rawOffset);
+        pageOffsets.push_back(blocks.rawSize());
+    } else {
+        // Single-stream formats cannot be entered in the middle, so decode them once to a temp file.
+        auto stamp = chrono::steady_clock::now().time_since_epoch().count();
+        tempPath = (filesystem::temp_directory_path() / ("archive_view_" + to_string(stamp) + ".txt")).string();
+        if (!Huffman::decompressFile(path, tempPath)) return false;
+        temp.open(tempPath, ios::binary);
+        error_code ec;
+        uint64_t size = filesystem::file_size(tempPath, ec);
+        if (!temp || ec) return false;
+        blockMode = false;
+        for (uint64_t off = 0; off < size; off += FILE_PAGE_SIZE) pageOffsets.push_back(off);
+        pageOffsets.push_back(size);
+    }
+    pageLines.assign(pageCount(), PageLines());
+    return true;
+}
+
+uint64_t ArchivePager::rawSize() const {
+    return pageOffsets.empty() ? 0 : pageOffsets.back();
+}
+
+uint64_t ArchivePager::lineCount() const {
+    lock_guard<mutex> lk(indexMtx);
+    if (pagesIndexed == 0) return 0;
+    const PageLines &last = pageLines[pagesIndexed - 1];
+    return last.firstLine + last.lines;
+}
+
+bool ArchivePager::readPage(size_t p, string &out) {
+    if (blockMode) return blocks.readBlock(p, out);
+    size_t len = size_t(pageOffsets[p + 1] - pageOffsets[p]);
+    out.resize(len);
+    lock_guard<mutex> lk(tempMtx);
+    temp.clear();
+    temp.seekg(streamoff(pageOffsets[p]));
+    return bool(temp.read(&out[0], len));
+}
+
+void ArchivePager::buildIndex(IndexFn progress) {
+    indexer = thread([this, progress = move(progress)] { runIndex(progress); });
+}
+
+void ArchivePager::runIndex(IndexFn progress) {
+    string text;
+    uint64_t lines = 0;
+    bool lineOpen = false; // the previous page ended in the middle of a line
+    for (size_t p = 0; p < pageCount() && !stopping; ++p) {
+        if (!readPage(p, text)) break;
+        PageLines entry;
+        entry.firstLine = lines;
+        entry.endsWithNewline = !text.empty() && text.back() == '\n';
+        bool startsHere = !text.empty() && !lineOpen;
+        entry.lines = uint32_t(startsHere + countNewlines(text.data(), text.size()) - entry.endsWithNewline);
+        lines += entry.lines;
+        lineOpen = !entry.endsWithNewline;
+        {
+            lock_guard<mutex> lk(indexMtx);
+            pageLines[p] = entry;
+            pagesIndexed = p + 1;
+        }
+        if (progress) progress(lines, false);
+    }
+    indexDone = true;
+    if (progress) progress(lines, true);
+}
+
+// Decoded page p with its line starts, through the cache. Only called for indexed pages.
+shared_ptr<const ArchivePager::Page> ArchivePager::page(size_t p) {
+    {
+        lock_guard<mutex> lk(cacheMtx);
+        auto it = cached.find(p);
+        if (it != cached.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+    }
+    bool startsAtZero;
+    {
+        lock_guard<mutex> lk(indexMtx);
+        startsAtZero = p == 0 || pageLines[p - 1].endsWithNewline;
+    }
+    auto fresh = make_shared<Page>();
+    if (!readPage(p, fresh->text)) return nullptr;
+    const string &text = fresh->text;
+    if (startsAtZero && !text.empty()) fresh->starts.push_back(0);
+    for (size_t i = text.find('\n'); i != string::npos && i + 1 < text.size(); i = text.find('\n', i + 1))
+        fresh->starts.push_back(uint32_t(i + 1));
+
+    // Decoded outside the lock, so two readers may race to fill the same page; keep the first.
+    lock_guard<mutex> lk(cacheMtx);
+    auto it = cached.find(p);
+    if (it != cached.end()) return it->second->second;
+    lru.emplace_front(p, fresh);
+    cached[p] = lru.begin();
+    while (lru.size() > cacheCapacity) {
+        cached.erase(lru.back().first);
+        lru.pop_back();
+    }
+    return fresh;
+}
+
+// Page holding the start of line n and the line's offset in it.
+bool ArchivePager::locate(uint64_t n, size_t &p, uint32_t &start) {
+    uint64_t first;
+    {
+        lock_guard<mutex> lk(indexMtx);
+        auto end = pageLines.begin() + pagesIndexed;
+        auto it = upper_bound(pageLines.begin(), end, n,
+                              [](uint64_t line, const PageLines &pl) { return line < pl.firstLine; });
+        if (it == pageLines.begin()) return false;
+        --it;
+        if (n >= it->firstLine + it->lines) return false;
+        p = size_t(it - pageLines.begin());
+        first = it->firstLine;
+    }
+    shared_ptr<const Page> pg = page(p);
+    if (!pg || n - first >= pg->starts.size()) return false;
+    start = pg->starts[size_t(n - first)];
+    return true;
+}
+
+bool ArchivePager::line(uint64_t n, string &out) {
+    size_t p;
+    uint32_t start;
+    if (!locate(n, p, start)) return false;
+    out.clear();
+    // A line runs to the next newline, which may be pages further on for temp-file archives.
+    for (size_t off = start; p < pageCount() && out.size() < MAX_LINE; ++p, off = 0) {
+        shared_ptr<const Page> pg = page(p);
+        if (!pg) return false;
+        const string &text = pg->text;
+        size_t nl = text.find('\n', off);
+        out.append(text, off, (nl == string::npos ? text.size() : nl) - off);
+        if (nl != string::npos) break;
+    }
+    if (out.size() > MAX_LINE) out.resize(MAX_LINE);
+    if (!out.empty() && out.back() == '\r') out.pop_back();
+    return true;
+}
+
+void ArchivePager::search(const string &needle, uint64_t fromLine, SearchFn done) {
+    uint64_t generation = ++searchGeneration;
+    if (searcher.joinable()) searcher.join();
+    searcher = thread([this, needle, fromLine, generation, done = move(done)] {
+        runSearch(needle, fromLine, generation, done);
+    });
+}
+
+void ArchivePager::cancelSearch() {
+    ++searchGeneration;
+}
+
+void ArchivePager::runSearch(string needle, uint64_t fromLine, uint64_t generation, SearchFn done) {
+    auto current = [&] { return searchGeneration == generation && !stopping; };
+    lowerAscii(needle);
+    size_t startPage = 0;
+    uint32_t startOffset = 0;
+    if (!locate(fromLine, startPage, startOffset)) fromLine = 0;
+
+    // Pages are scanned from the start line to the end, then from the top back to the start
+    // page. 'buf' holds text from the beginning of line 'lineNo'; only whole lines are searched,
+    // and a line cut by a page boundary is carried over to the next page.
+    string buf, text;
+    uint64_t lineNo = fromLine;
+    size_t pages = pageCount();
+    if (pages == 0) {
+        if (current()) done(-1);
+        return;
+    }
+    for (size_t step = 0; step <= pages && current(); ++step) {
+        size_t p = (startPage + step) % pages;
+        if (p == 0 && step > 0) { buf.clear(); lineNo = 0; } // wrapped
+        if (!readPage(p, text)) break;
+        size_t from = step == 0 ? startOffset : 0;
+        buf.append(text, from, string::npos);
+        lowerAscii(buf); // carried text is already lower case; cheap to redo
+        size_t limit = (p + 1 == pages) ? buf.size() : buf.rfind('\n') + 1; // npos + 1 == 0
+        size_t hit = needle.empty() ? string::npos : string_view(buf.data(), limit).find(needle);
+        if (hit != string::npos) {
+            int64_t found = int64_t(lineNo + countNewlines(buf.data(), hit));
+            if (current()) done(found);
+            return;
+        }
+        lineNo += countNewlines(buf.data(), limit);
+        buf.erase(0, limit);
+    }
+    if (current()) done(-1);
+}
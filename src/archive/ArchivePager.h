@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../compression/BlockArchive.h"
+using namespace std;
+
+// Random access to the lines of a .huff archive without decompressing all of it up front.
+// Block archives are paged by block, decoded on demand into a small LRU cache. Older
+// single-stream archives are decompressed to a temp file once and paged from there.
+//
+// The line index is built on a background thread and only keeps a line count per page, so
+// memory stays bounded by the cache no matter how large the archive is; lines become
+// reachable as the index passes them.
+class ArchivePager {
+public:
+    static constexpr size_t DEFAULT_CACHE_PAGES = 16;
+    static constexpr size_t FILE_PAGE_SIZE = 1 << 20; // page size for temp-file archives
+    static constexpr size_t MAX_LINE = 1 << 16;       // longer lines are cut when displayed
+
+    // Both run on background threads.
+    using IndexFn = function<void(uint64_t linesIndexed, bool finished)>;
+    using SearchFn = function<void(int64_t line)>; // -1 if nothing matched
+
+    explicit ArchivePager(size_t cachePages = DEFAULT_CACHE_PAGES);
+    ~ArchivePager(); // stops background work and removes any temp file
+
+    bool open(const string &path);
+    // Starts indexing lines; 'progress' is called after every page and once at the end.
+    void buildIndex(IndexFn progress);
+
+    uint64_t lineCount() const; // lines indexed so far
+    bool indexComplete() const { return indexDone; }
+    uint64_t rawSize() const;
+
+    // Text of line n without its newline; false if n is not indexed yet or unreadable.
+    bool line(uint64_t n, string &out);
+
+    // Looks for the first line at or after 'fromLine' containing 'needle' (ASCII case-insensitive),
+    // wrapping around to the start once. Runs on a background thread; a new search or
+    // cancelSearch() stops the one in progress without calling its 'done'.
+    void search(const string &needle, uint64_t fromLine, SearchFn done);
+    void cancelSearch();
+
+private:
+    struct Page {
+        string text;
+        vector<uint32_t> starts; // offsets of the lines that start in this page
+    };
+    struct PageLines {
+        uint64_t firstLine = 0; // number of the first line starting in the page
+        uint32_t lines = 0;     // lines starting in the page
+        bool endsWithNewline = false;
+    };
+
+    // Source of page text: blocks of a block archive or fixed slices of a temp file.
+    BlockArchiveReader blocks;
+    bool blockMode = false;
+    string tempPath;
+    ifstream temp;
+    mutex tempMtx;
+    vector<uint64_t> pageOffsets; // raw offset of each page, plus the total at the end
+
+    size_t cacheCapacity;
+    mutex cacheMtx;
+    list<pair<size_t, shared_ptr<const Page>>> lru; // most recent first
+    unordered_map<size_t, list<pair<size_t, shared_ptr<const Page>>>::iterator> cached;
+
+    mutable mutex indexMtx;
+    vector<PageLines> pageLines; // filled in page order by the indexer
+    size_t pagesIndexed = 0;
+    atomic<bool> indexDone{false};
+    atomic<bool> stopping{false};
+    thread indexer;
+
+    atomic<uint64_t> searchGeneration{0};
+    thread searcher;
+
+    size_t pageCount() const { return pageOffsets.empty() ? 0 : pageOffsets.size() - 1; }
+    bool readPage(size_t p, string &out);
+    shared_ptr<const Page> page(size_t p);
+    bool locate(uint64_t n, size_t &p, uint32_t &start);
+    void runIndex(IndexFn progress);
+    void runSearch(string needle, uint64_t fromLine, uint64_t generation, SearchFn done);
+    void close();
+};
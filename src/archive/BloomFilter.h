@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Fixed-size Bloom filter over 64-bit keys (account numbers). Sized for the number of distinct
+// keys it will hold at about 1% false positives; never gives a false negative.
+class BloomFilter {
+public:
+    static constexpr uint32_t BITS_PER_KEY = 10;
+    static constexpr uint8_t HASHES = 7;
+
+    BloomFilter() = default;
+    explicit BloomFilter(size_t keys) : words((keys * BITS_PER_KEY + 63) / 64), hashes(HASHES) {}
+
+    void add(int64_t key) {
+        if (words.empty()) return;
+        uint64_t h1, h2, bits = words.size() * 64;
+        split(key, h1, h2);
+        for (uint8_t i = 0; i < hashes; ++i) {
+            uint64_t bit = (h1 + i * h2) % bits;
+            words[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    }
+
+    bool mayContain(int64_t key) const {
+        if (words.empty()) return false;
+        uint64_t h1, h2, bits = words.size() * 64;
+        split(key, h1, h2);
+        for (uint8_t i = 0; i < hashes; ++i) {
+            uint64_t bit = (h1 + i * h2) % bits;
+            if (!(words[bit >> 6] & (uint64_t(1) << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+    // Raw state, for persisting the filter.
+    const vector<uint64_t>& data() const { return words; }
+    uint8_t hashCount() const { return hashes; }
+    void assign(vector<uint64_t> bits, uint8_t hashCount) { words = move(bits); hashes = hashCount; }
+
+private:
+    vector<uint64_t> words;
+    uint8_t hashes = 0;
+
+    // Double hashing: two halves of one well-mixed 64-bit hash give all the probe positions.
+    static void split(int64_t key, uint64_t &h1, uint64_t &h2) {
+        uint64_t z = uint64_t(key) + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        h1 = z & 0xFFFFFFFFu;
+        h2 = (z >> 32) | 1;
+    }
+};
@@ -0,0 +1,364 @@
+#include "Reconciler.h"
+#include "../archive/ArchiveCatalog.h"
+#include "../concurrency/ThreadPool.h"
+#include "../crypto/CryptoUtils.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <climits>
+using namespace std;
+
+static constexpr size_t WINDOW = 4 << 20; // plaintext read at a time per range
+
+// What a stretch of the journal does to one account. A stretch that starts mid-journal
+// cannot check its first Close, which depends on what came before; it keeps the cents
+// leading up to it ('head') so that then() can, once the stretches are put in order.
+struct Replay {
+    int64_t tail = 0;       // cents since the last Close, or since the start
+    int64_t head = 0;       // cents before the first Close
+    int64_t firstClose = 0;
+    uint32_t records = 0;
+    uint32_t closeMismatches = 0;
+    bool closed = false;
+    bool matched = false; // the snapshot has the account (set by the final check)
+
+    void add(int64_t cents) {
+        tail += cents;
+        ++records;
+    }
+    void close(int64_t cents) {
+        ++records;
+        if (!closed) {
+            head = tail;
+            firstClose = cents;
+            closed = true;
+        } else if (tail != cents) {
+            ++closeMismatches;
+        }
+        tail = 0;
+    }
+    // Appends the stretch right after this one. Folding from the start of the journal, every
+    // Close gets checked.
+    void then(const Replay &later) {
+        records += later.records;
+        closeMismatches += later.closeMismatches;
+        if (!later.closed) {
+            tail += later.tail;
+            return;
+        }
+        if (tail + later.head != later.firstClose) ++closeMismatches;
+        tail = later.tail;
+        closed = true;
+    }
+};
+
+// Account number -> Replay, open addressing with linear probing. Every journal record
+// lands here, and a node-based map spent more time allocating and chasing pointers than
+// decryption and parsing together.
+class Bucket {
+public:
+    struct Slot {
+        int key = EMPTY;
+        Replay value;
+    };
+    static constexpr int EMPTY = INT32_MIN;
+
+    Replay &operator[](int key) {
+        if ((used + 1) * 2 > slots.size()) grow();
+        size_t i = find(key);
+        if (slots[i].key == EMPTY) {
+            slots[i].key = key;
+            ++used;
+        }
+        return slots[i].value;
+    }
+    Replay *get(int key) {
+        if (slots.empty()) return nullptr;
+        Slot &s = slots[find(key)];
+        return s.key == EMPTY ? nullptr : &s.value;
+    }
+    const vector<Slot> &all() const { return slots; } // EMPTY keys included
+    void release() { vector<Slot>().swap(slots); used = 0; }
+
+private:
+    vector<Slot> slots;
+    size_t used = 0;
+
+    size_t find(int key) const {
+        size_t mask = slots.size() - 1;
+        size_t i = (uint32_t(key) * 2654435761u >> 7) & mask; // the low bits picked the bucket
+        while (slots[i].key != EMPTY && slots[i].key != key) i = (i + 1) & mask;
+        return i;
+    }
+    void grow() {
+        vector<Slot> old(max<size_t>(64, slots.size() * 2));
+        old.swap(slots);
+        for (const Slot &s : old)
+            if (s.key != EMPTY) slots[find(s.key)] = s;
+    }
+};
+
+// Partial results of one range of the journal.
+struct RangeResult {
+    vector<Bucket> buckets;
+    uint64_t records = 0;
+    uint64_t unattributed = 0;
+    int64_t unattributedCents = 0;
+    uint64_t unreadable = 0;
+
+    explicit RangeResult(size_t bucketCount) : buckets(bucketCount) {}
+
+    void apply(string_view type, double amount, int account) {
+        int64_t cents = llround(amount * 100);
+        bool isClose = type == "Close";
+        if (type == "Withdraw") cents = -cents;
+        else if (!isClose && type != "Deposit") {
+            ++unreadable;
+            return;
+        }
+        ++records;
+        if (account < 0) {
+            ++unattributed;
+            unattributedCents += isClose ? 0 : cents;
+            return;
+        }
+        Replay &r = buckets[bucketOf(account, buckets.size())][account];
+        if (isClose) r.close(cents);
+        else r.add(cents);
+    }
+
+    // "timestamp|type|amount|account", as Transaction::serialize writes it.
+    void applyLine(const char *p, size_t n) {
+        if (n && p[n - 1] == '\r') --n;
+        if (n == 0) return;
+        const char *end = p + n;
+        const char *type = static_cast<const char*>(memchr(p, '|', n));
+        const char *amount = type ? static_cast<const char*>(memchr(type + 1, '|', end - type - 1)) : nullptr;
+        if (!amount) {
+            ++unreadable;
+            return;
+        }
+        const char *account = static_cast<const char*>(memchr(amount + 1, '|', end - amount - 1));
+        double value = 0;
+        auto parsed = from_chars(amount + 1, account ? account : end, value);
+        int number = -1; // missing in the oldest logs
+        if (parsed.ec != errc() || parsed.ptr != (account ? account : end) ||
+            (account && from_chars(account + 1, end, number).ec != errc())) {
+            ++unreadable;
+            return;
+        }
+        apply(string_view(type + 1, amount - type - 1), value, number);
+    }
+
+    static size_t bucketOf(int account, size_t count) {
+        return size_t(uint32_t(account) * 2654435761u) % count;
+    }
+};
+
+// Replays the lines that start in [from, to) of a journal that can be read by offset (a
+// sealed log, or a chunked container).
+static bool scanRange(const string &logFile, string_view password, uint64_t size, uint64_t from, uint64_t to,
+                      RangeResult &out) {
+    CryptoUtils::ChunkedReader reader;
+    if (!reader.open(logFile, password, 1)) return false;
+    // A range that starts mid-line leaves that line to the range before; reading from one
+    // byte early tells whether it does.
+    uint64_t at = from > 0 ? from - 1 : 0;
+    bool aligned = from == 0;
+    uint64_t lineStart = from;
+    string data, carry;
+    while (at < size) {
+        if (!reader.read(at, WINDOW, data)) return false;
+        uint64_t base = at;
+        at += data.size();
+        size_t i = 0;
+        if (!aligned) {
+            size_t nl = data.find('\n');
+            if (nl == string::npos) continue;
+            i = nl + 1;
+            lineStart = base + i;
+            aligned = true;
+        }
+        for (;;) {
+            if (lineStart >= to) return true;
+            size_t nl = data.find('\n', i);
+            if (nl == string::npos) {
+                carry.append(data, i, string::npos);
+                break;
+            }
+            if (carry.empty()) {
+                out.applyLine(data.data() + i, nl - i);
+            } else {
+                carry.append(data, i, nl - i);
+                out.applyLine(carry.data(), carry.size());
+                carry.clear();
+            }
+            i = nl + 1;
+            lineStart = base + i;
+        }
+    }
+    if (!carry.empty() && lineStart < to) out.applyLine(carry.data(), carry.size()); // no final newline
+    return true;
+}
+
+// Legacy CBC journals can only be decrypted front to back, so they are one range.
+static bool scanStream(const string &logFile, string_view password, RangeResult &out) {
+    string carry;
+    bool ok = CryptoUtils::decryptStream(logFile, password, [&](const unsigned char *data, size_t len) {
+        const char *p = reinterpret_cast<const char*>(data);
+        const char *end = p + len;
+        while (p < end) {
+            const char *nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!nl) {
+                carry.append(p, end);
+                break;
+            }
+            if (carry.empty()) {
+                out.applyLine(p, nl - p);
+            } else {
+                carry.append(p, nl);
+                out.applyLine(carry.data(), carry.size());
+                carry.clear();
+            }
+            p = nl + 1;
+        }
+        return true;
+    });
+    if (ok && !carry.empty()) out.applyLine(carry.data(), carry.size());
+    return ok;
+}
+
+Reconciler::Reconciler(string_view pwd, size_t threadCount)
+    : password(pwd), threads(threadCount ? threadCount : max<size_t>(1, thread::hardware_concurrency())) {}
+
+void Reconciler::setArchives(ArchiveCatalog *catalog) {
+    archives = catalog;
+}
+
+bool Reconciler::reconcile(Bank &bank, ReconcileReport &report) {
+    error_code ec;
+    filesystem::path tmp = filesystem::temp_directory_path(ec);
+    if (ec) tmp = ".";
+    auto stamp = chrono::steady_clock::now().time_since_epoch().count();
+    string copy = (tmp / ("sbank-reconcile-" + to_string(stamp) + ".journal")).string();
+    shared_ptr<const Bank::AccountsView> view;
+    if (!bank.captureState(copy, [&view](shared_ptr<const Bank::AccountsView> accounts) { view = move(accounts); }))
+        return false;
+    bool ok = run(*view, copy, report);
+    filesystem::remove(copy, ec);
+    return ok;
+}
+
+bool Reconciler::reconcileFiles(const string &dataFile, const string &logFile, ReconcileReport &report) {
+    Bank bank(dataFile, logFile, password);
+    if (!bank.load()) return false;
+    return run(*bank.accountsSnapshot(), logFile, report);
+}
+
+bool Reconciler::run(const Bank::AccountsView &accounts, const string &logFile, ReconcileReport &report) {
+    auto started = chrono::steady_clock::now();
+    report = ReconcileReport();
+    report.accounts = accounts.size();
+    const size_t bucketCount = threads;
+    ThreadPool pool(threads);
+
+    // Pass 1: replay the ranges. Archives, when there are any, come first in journal order.
+    vector<RangeResult> ranges;
+    ranges.reserve(threads + 2); // the archives, then at most 'threads' ranges: never moved
+    vector<future<bool>> scans;
+    if (archives) {
+        ranges.emplace_back(bucketCount);
+        RangeResult &r = ranges.back();
+        scans.push_back(pool.submit([this, &r] {
+            return archives->query(ArchiveQuery(), [&r](const Transaction &tr, const string&) {
+                r.apply(tr.type, tr.amount, tr.relatedAccount);
+                return true;
+            });
+        }));
+    }
+    if (filesystem::exists(logFile)) {
+        uint64_t size = 0;
+        if (!CryptoUtils::isChunkedFile(logFile)) {
+            ranges.emplace_back(bucketCount);
+            RangeResult &r = ranges.back();
+            scans.push_back(pool.submit([this, &logFile, &r] { return scanStream(logFile, password, r); }));
+        } else if (CryptoUtils::plainSize(logFile, size)) {
+            size_t first = ranges.size();
+            uint64_t step = max<uint64_t>(WINDOW, (size + threads - 1) / threads);
+            for (uint64_t from = 0; from < size; from += step) ranges.emplace_back(bucketCount);
+            for (size_t i = first; i < ranges.size(); ++i) {
+                uint64_t from = (i - first) * step, to = min(size, from + step);
+                RangeResult &r = ranges[i];
+                scans.push_back(pool.submit([this, &logFile, size, from, to, &r] {
+                    return scanRange(logFile, password, size, from, to, r);
+                }));
+            }
+        } else {
+            return false;
+        }
+    }
+    bool ok = true;
+    for (auto &f : scans) ok = f.get() && ok;
+    if (!ok) return false;
+    for (const RangeResult &r : ranges) {
+        report.records += r.records;
+        report.unattributed += r.unattributed;
+        report.unattributedCents += r.unattributedCents;
+        report.unreadable += r.unreadable;
+    }
+
+    // Pass 2: one task per bucket folds the ranges in order and checks that bucket's accounts.
+    vector<vector<size_t>> byBucket(bucketCount);
+    for (size_t i = 0; i < accounts.size(); ++i)
+        byBucket[RangeResult::bucketOf(accounts[i].getAccountNumber(), bucketCount)].push_back(i);
+    vector<future<vector<Discrepancy>>> checks;
+    for (size_t b = 0; b < bucketCount; ++b) {
+        checks.push_back(pool.submit([&, b] {
+            Bucket journal;
+            for (RangeResult &r : ranges) {
+                for (const Bucket::Slot &s : r.buckets[b].all())
+                    if (s.key != Bucket::EMPTY) journal[s.key].then(s.value);
+                r.buckets[b].release(); // done with it
+            }
+            vector<Discrepancy> found;
+            auto note = [&found](Discrepancy::Kind kind, int number, int64_t snapshot, const Replay &r) {
+                Discrepancy d;
+                d.kind = kind;
+                d.accountNumber = number;
+                d.snapshotCents = snapshot;
+                d.journalCents = r.tail;
+                d.records = r.records;
+                found.push_back(d);
+            };
+            for (size_t i : byBucket[b]) {
+                const BankAccount &acc = accounts[i];
+                int64_t cents = llround(acc.getBalance() * 100);
+                Replay *found = journal.get(acc.getAccountNumber());
+                Replay none;
+                const Replay &r = found ? *found : none;
+                if (r.tail != cents) note(Discrepancy::BalanceMismatch, acc.getAccountNumber(), cents, r);
+                if (r.closeMismatches) note(Discrepancy::CloseMismatch, acc.getAccountNumber(), cents, r);
+                if (found) found->matched = true;
+            }
+            for (const Bucket::Slot &s : journal.all()) {
+                if (s.key == Bucket::EMPTY || s.value.matched) continue;
+                if (s.value.tail != 0) note(Discrepancy::JournalOnly, s.key, 0, s.value);
+                if (s.value.closeMismatches) note(Discrepancy::CloseMismatch, s.key, 0, s.value);
+            }
+            return found;
+        }));
+    }
+    for (auto &f : checks) {
+        vector<Discrepancy> found = f.get();
+        report.discrepancies.insert(report.discrepancies.end(), found.begin(), found.end());
+    }
+    sort(report.discrepancies.begin(), report.discrepancies.end(), [](const Discrepancy &a, const Discrepancy &b) {
+        return a.accountNumber != b.accountNumber ? a.accountNumber < b.accountNumber : a.kind < b.kind;
+    });
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return true;
+}
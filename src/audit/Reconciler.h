@@ -0,0 +1,64 @@
+#pragma once
+#include "../core/Bank.h"
+#include "../crypto/SecureArena.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+class ArchiveCatalog;
+
+struct Discrepancy {
+    enum Kind : uint8_t {
+        BalanceMismatch, // the account's balance is not what its journal adds up to
+        JournalOnly,     // no such account, but its journal leaves money in it
+        CloseMismatch,   // a Close record does not match the balance the journal had reached
+    };
+    Kind kind = BalanceMismatch;
+    int accountNumber = 0;
+    int64_t snapshotCents = 0; // 0 for JournalOnly
+    int64_t journalCents = 0;  // what replaying the journal gives
+    uint64_t records = 0;      // journal records for the account
+};
+
+struct ReconcileReport {
+    uint64_t records = 0;      // journal records replayed, archived ones included
+    uint64_t accounts = 0;     // in the snapshot
+    uint64_t unattributed = 0; // records with no account (initial deposits in older logs)
+    int64_t unattributedCents = 0;
+    uint64_t unreadable = 0;   // malformed lines and unknown record types
+    vector<Discrepancy> discrepancies; // by account number
+    double seconds = 0;
+    bool consistent() const { return discrepancies.empty(); }
+};
+
+// Replays the transaction journal and checks every account's balance against it. Deposits
+// add, withdrawals subtract, and a Close (written when an account is deleted) must match the
+// balance reached and starts the account over. Amounts are summed in whole cents, so the
+// result does not depend on the order of the additions.
+//
+// The journal is split into byte ranges that worker threads decrypt and parse on their own,
+// each into per-account partial results hashed into one bucket per thread. A second pass
+// gives each thread one bucket: it folds the partial results of every range in journal
+// order and compares them with the snapshot's accounts in that bucket.
+class Reconciler {
+public:
+    explicit Reconciler(string_view password, size_t threads = 0); // 0 = one per core
+
+    // Archived journal (oldest first) is replayed ahead of the live one, for logs trimmed by
+    // archiving. The catalog must outlive the reconciler.
+    void setArchives(ArchiveCatalog *catalog);
+
+    // A running bank: the journal and accounts are captured together under the bank's lock.
+    bool reconcile(Bank &bank, ReconcileReport &report);
+    // Files as left on disk, e.g. after a crash, where the journal runs ahead of the last save.
+    bool reconcileFiles(const string &dataFile, const string &logFile, ReconcileReport &report);
+
+private:
+    SecureString password;
+    size_t threads;
+    ArchiveCatalog *archives = nullptr;
+
+    bool run(const Bank::AccountsView &accounts, const string &logFile, ReconcileReport &report);
+};
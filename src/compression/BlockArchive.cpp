@@ -0,0 +1,254 @@
+#include "BlockArchive.h"
+#include "TransactionCodec.h"
+#include "../concurrency/ThreadPool.h"
+#include <cstring>
+#include <thread>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const char MAGIC[4] = {'H', 'U', 'F', 'B'};
+static const char FOOTER_MAGIC[4] = {'H', 'U', 'F', 'I'};
+static constexpr uint8_t VERSION = 1;
+static constexpr size_t HEADER_SIZE = 12;
+static constexpr size_t INDEX_ENTRY_SIZE = 16;
+static constexpr size_t FOOTER_SIZE = 16;
+
+// Other kinds are EntropyCodec ids.
+enum BlockKind : uint8_t { STORED = 0, TRANSACTIONS = 2 };
+
+static void putU32(string &s, uint32_t v) { for (int i = 0; i < 4; ++i) s.push_back(char(v >> (8 * i))); }
+static void putU64(string &s, uint64_t v) { for (int i = 0; i < 8; ++i) s.push_back(char(v >> (8 * i))); }
+
+static uint64_t getLE(const char *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | static_cast<uint8_t>(p[i]);
+    return v;
+}
+
+static size_t poolSize(size_t threads) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+// Coded with the archive's codec, falling back to stored bytes when that would not be smaller
+// (e.g. already-compressed input).
+static string encodeBlock(const string &raw, BlockCodec codec, const EntropyCodec &entropy) {
+    string stored(1, char(TRANSACTIONS));
+    if (codec == BlockCodec::Transactions && TransactionCodec::encode(raw.data(), raw.size(), stored, entropy) &&
+        stored.size() < raw.size() + 1)
+        return stored;
+    stored.assign(1, char(entropy.id()));
+    if (!entropy.compress(raw.data(), raw.size(), stored) || stored.size() >= raw.size() + 1) {
+        stored.assign(1, char(STORED));
+        stored += raw;
+    }
+    return stored;
+}
+
+static bool decodeBlock(const string &stored, uint32_t rawSize, string &out) {
+    out.clear();
+    if (stored.empty()) return false;
+    uint8_t kind = static_cast<uint8_t>(stored[0]);
+    const EntropyCodec *entropy = EntropyCodec::byId(kind);
+    if (kind == STORED) {
+        out.assign(stored, 1, string::npos);
+    } else if (kind == TRANSACTIONS) {
+        if (!TransactionCodec::decode(stored.data() + 1, stored.size() - 1, out, rawSize)) return false;
+    } else if (!entropy || !entropy->decompress(stored.data() + 1, stored.size() - 1, out, rawSize)) {
+        return false;
+    }
+    return out.size() == rawSize;
+}
+
+BlockArchiveWriter::BlockArchiveWriter(size_t blockSize, size_t threads, BlockCodec codec, EntropyCodec::Id entropy)
+    : blockSize(blockSize ? blockSize : DEFAULT_BLOCK_SIZE),
+      codec(codec),
+      entropy(EntropyCodec::byId(entropy)),
+      pool(make_unique<ThreadPool>(poolSize(threads))),
+      maxInFlight(2 * poolSize(threads)) {}
+
+BlockArchiveWriter::~BlockArchiveWriter() {
+    if (out) fclose(out);
+}
+
+bool BlockArchiveWriter::open(const string &path) {
+    if (!entropy) return false;
+    out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+    string header(MAGIC, sizeof(MAGIC));
+    header.push_back(char(VERSION));
+    header.push_back(char(codec));
+    header.push_back(char(entropy->id()));
+    header.push_back(0);
+    putU32(header, uint32_t(blockSize));
+    failed = fwrite(header.data(), 1, header.size(), out) != header.size();
+    fileOffset = header.size();
+    return !failed;
+}
+
+void BlockArchiveWriter::dispatch(string block) {
+    uint32_t rawSize = uint32_t(block.size());
+    rawTotal += block.size();
+    auto raw = make_shared<string>(move(block));
+    BlockCodec c = codec;
+    const EntropyCodec *e = entropy;
+    inFlight.push_back(Pending{pool->submit([raw, c, e] { return encodeBlock(*raw, c, *e); }), rawSize});
+    while (inFlight.size() > maxInFlight) retireOldest();
+}
+
+bool BlockArchiveWriter::retireOldest() {
+    Pending p = move(inFlight.front());
+    inFlight.pop_front();
+    string stored = p.stored.get();
+    if (!failed) failed = fwrite(stored.data(), 1, stored.size(), out) != stored.size();
+    BlockInfo info;
+    info.offset = fileOffset;
+    info.storedSize = uint32_t(stored.size());
+    info.rawSize = p.rawSize;
+    index.push_back(info);
+    fileOffset += stored.size();
+    return !failed;
+}
+
+bool BlockArchiveWriter::write(const char *data, size_t len) {
+    if (!out || failed) return false;
+    while (len > 0) {
+        size_t take = min(len, blockSize - partial.size());
+        partial.append(data, take);
+        data += take;
+        len -= take;
+        if (partial.size() == blockSize) {
+            dispatch(move(partial));
+            partial.clear();
+        }
+    }
+    return !failed;
+}
+
+bool BlockArchiveWriter::writeBlock(string block) {
+    if (!out || failed || block.size() > UINT32_MAX) return false;
+    if (!partial.empty()) {
+        dispatch(move(partial));
+        partial.clear();
+    }
+    if (!block.empty()) dispatch(move(block));
+    return !failed;
+}
+
+bool BlockArchiveWriter::close(bool durable) {
+    if (!out) return false;
+    if (!partial.empty()) {
+        dispatch(move(partial));
+        partial.clear();
+    }
+    while (!inFlight.empty()) retireOldest();
+    string tail;
+    for (const BlockInfo &b : index) {
+        putU64(tail, b.offset);
+        putU32(tail, b.storedSize);
+        putU32(tail, b.rawSize);
+    }
+    putU64(tail, fileOffset);
+    putU32(tail, uint32_t(index.size()));
+    tail.append(FOOTER_MAGIC, sizeof(FOOTER_MAGIC));
+    bool ok = !failed && fwrite(tail.data(), 1, tail.size(), out) == tail.size();
+    ok = fflush(out) == 0 && ok;
+    if (durable) {
+#if defined(_WIN32)
+        ok = _commit(_fileno(out)) == 0 && ok;
+#else
+        ok = fsync(fileno(out)) == 0 && ok;
+#endif
+    }
+    ok = fclose(out) == 0 && ok;
+    out = nullptr;
+    return ok;
+}
+
+bool BlockArchiveReader::isBlockArchive(const string &path) {
+    ifstream f(path, ios::binary);
+    char magic[4];
+    return f.read(magic, 4) && memcmp(magic, MAGIC, 4) == 0;
+}
+
+bool BlockArchiveReader::open(const string &path) {
+    blocks.clear();
+    in.open(path, ios::binary);
+    if (!in) return false;
+    char header[HEADER_SIZE];
+    if (!in.read(header, HEADER_SIZE) || memcmp(header, MAGIC, 4) != 0 || uint8_t(header[4]) != VERSION) return false;
+    layout = BlockCodec(header[5]);
+    // Archives written before the coder was selectable have 0 here and are all Huffman.
+    entropyId = header[6] ? EntropyCodec::Id(header[6]) : EntropyCodec::HUFFMAN;
+    in.seekg(0, ios::end);
+    uint64_t fileSize = uint64_t(in.tellg());
+    if (fileSize < HEADER_SIZE + FOOTER_SIZE) return false;
+    char footer[FOOTER_SIZE];
+    in.seekg(fileSize - FOOTER_SIZE);
+    if (!in.read(footer, FOOTER_SIZE) || memcmp(footer + 12, FOOTER_MAGIC, 4) != 0) return false;
+    uint64_t indexOffset = getLE(footer, 8);
+    uint64_t count = getLE(footer + 8, 4);
+    if (indexOffset + count * INDEX_ENTRY_SIZE + FOOTER_SIZE != fileSize) return false;
+    string raw(count * INDEX_ENTRY_SIZE, '\0');
+    in.seekg(indexOffset);
+    if (!in.read(&raw[0], raw.size())) return false;
+    blocks.resize(count);
+    uint64_t rawOffset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char *e = raw.data() + i * INDEX_ENTRY_SIZE;
+        BlockInfo &b = blocks[i];
+        b.offset = getLE(e, 8);
+        b.storedSize = uint32_t(getLE(e + 8, 4));
+        b.rawSize = uint32_t(getLE(e + 12, 4));
+        b.rawOffset = rawOffset;
+        rawOffset += b.rawSize;
+        if (b.offset + b.storedSize > indexOffset) return false;
+    }
+    return true;
+}
+
+uint64_t BlockArchiveReader::rawSize() const {
+    return blocks.empty() ? 0 : blocks.back().rawOffset + blocks.back().rawSize;
+}
+
+bool BlockArchiveReader::readBlock(size_t i, string &out) {
+    if (i >= blocks.size()) return false;
+    const BlockInfo &b = blocks[i];
+    string stored(b.storedSize, '\0');
+    {
+        lock_guard<mutex> lk(inMtx);
+        in.clear();
+        in.seekg(b.offset);
+        if (!in.read(&stored[0], stored.size())) return false;
+    }
+    return decodeBlock(stored, b.rawSize, out);
+}
+
+bool BlockArchiveReader::decompressTo(const string &outputPath, size_t threads) {
+    ofstream out(outputPath, ios::binary);
+    if (!out) return false;
+    size_t workers = poolSize(threads);
+    ThreadPool pool(workers);
+    deque<future<pair<bool, string>>> window; // bounded read-ahead, drained in order
+    bool ok = true;
+    size_t next = 0;
+    while (ok && (next < blocks.size() || !window.empty())) {
+        while (next < blocks.size() && window.size() < 2 * workers) {
+            size_t i = next++;
+            window.push_back(pool.submit([this, i] {
+                string data;
+                bool decoded = readBlock(i, data);
+                return make_pair(decoded, move(data));
+            }));
+        }
+        auto result = window.front().get();
+        window.pop_front();
+        ok = result.first && out.write(result.second.data(), result.second.size());
+    }
+    for (auto &f : window) f.wait();
+    return ok && bool(out);
+}
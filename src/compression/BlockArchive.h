@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "EntropyCodec.h"
+using namespace std;
+
+class ThreadPool;
+
+// Block container for archives ("HUFB"). The input is cut into blocks that are entropy-coded
+// independently, on a thread pool, and a trailing index records where each block lives, so
+// any block can be decoded on its own.
+//
+//   header  "HUFB" | version u8 | codec u8 | entropy coder id u8 | reserved u8 | nominal block size u32
+//   blocks  kind u8 (0 stored, 2 transaction columns, else an EntropyCodec id) | payload
+//   index   per block: file offset u64 | stored size u32 | raw size u32
+//   footer  index offset u64 | block count u32 | "HUFI"
+// Integers are little-endian.
+
+// What the writer tries on each block; the reader only looks at the per-block kind byte.
+enum class BlockCodec : uint8_t {
+    Generic = 0,      // bytes straight into the entropy coder
+    Transactions = 1, // transaction log lines (TransactionCodec), generic if a block does not fit
+};
+
+struct BlockInfo {
+    uint64_t offset = 0;     // of the block in the archive file
+    uint32_t storedSize = 0; // kind byte + payload
+    uint32_t rawSize = 0;
+    uint64_t rawOffset = 0;  // of the block's first byte in the decompressed stream
+};
+
+class BlockArchiveWriter {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+    explicit BlockArchiveWriter(size_t blockSize = DEFAULT_BLOCK_SIZE, size_t threads = 0, // 0 = one per core
+                                BlockCodec codec = BlockCodec::Generic,
+                                EntropyCodec::Id entropy = EntropyCodec::HUFFMAN);
+    ~BlockArchiveWriter();
+
+    bool open(const string &path);
+    // Appends bytes, starting a new block every blockSize bytes.
+    bool write(const char *data, size_t len);
+    // Appends exactly one block with caller-chosen boundaries (e.g. whole records).
+    // Bytes still pending from write() become their own block first.
+    bool writeBlock(string block);
+    // Writes the index and footer; 'durable' also syncs the file before closing it.
+    bool close(bool durable = false);
+
+    uint64_t rawBytes() const { return rawTotal; }
+
+private:
+    struct Pending {
+        future<string> stored;
+        uint32_t rawSize;
+    };
+    size_t blockSize;
+    BlockCodec codec;
+    const EntropyCodec *entropy;
+    unique_ptr<ThreadPool> pool;
+    size_t maxInFlight;
+    FILE *out = nullptr;
+    bool failed = false;
+    string partial;
+    deque<Pending> inFlight; // encoded in parallel, written strictly in order
+    vector<BlockInfo> index;
+    uint64_t fileOffset = 0;
+    uint64_t rawTotal = 0;
+
+    void dispatch(string block);
+    bool retireOldest();
+};
+
+class BlockArchiveReader {
+public:
+    static bool isBlockArchive(const string &path);
+
+    bool open(const string &path);
+    size_t blockCount() const { return blocks.size(); }
+    const BlockInfo& block(size_t i) const { return blocks[i]; }
+    BlockCodec codec() const { return layout; }
+    EntropyCodec::Id entropy() const { return entropyId; }
+    uint64_t rawSize() const;
+    // Decodes block i into 'out', replacing its contents. Safe to call from several threads.
+    bool readBlock(size_t i, string &out);
+    // Decodes every block on a thread pool and writes them in order.
+    bool decompressTo(const string &outputPath, size_t threads = 0);
+
+private:
+    ifstream in;
+    mutex inMtx; // guards the seek+read on 'in'; decoding happens outside it
+    vector<BlockInfo> blocks;
+    BlockCodec layout = BlockCodec::Generic;
+    EntropyCodec::Id entropyId = EntropyCodec::HUFFMAN;
+};
@@ -0,0 +1,47 @@
+#include "EntropyCodec.h"
+#include "Huffman.h"
+#include "Rans.h"
+using namespace std;
+
+class HuffmanCodec : public EntropyCodec {
+public:
+    Id id() const override { return HUFFMAN; }
+    const char *name() const override { return "huffman"; }
+    bool compress(const char *data, size_t len, string &out) const override {
+        return Huffman::compressBuffer(data, len, out);
+    }
+    bool decompress(const char *data, size_t len, string &out, size_t rawSize) const override {
+        return Huffman::decompressBuffer(data, len, out, rawSize);
+    }
+};
+
+class RansCodec : public EntropyCodec {
+public:
+    Id id() const override { return RANS; }
+    const char *name() const override { return "rans"; }
+    bool compress(const char *data, size_t len, string &out) const override {
+        return Rans::compressBuffer(data, len, out);
+    }
+    bool decompress(const char *data, size_t len, string &out, size_t rawSize) const override {
+        return Rans::decompressBuffer(data, len, out, rawSize);
+    }
+};
+
+const vector<const EntropyCodec*> &EntropyCodec::all() {
+    static const HuffmanCodec huffman;
+    static const RansCodec rans;
+    static const vector<const EntropyCodec*> codecs{&huffman, &rans};
+    return codecs;
+}
+
+const EntropyCodec *EntropyCodec::byId(uint8_t id) {
+    for (const EntropyCodec *c : all())
+        if (c->id() == id) return c;
+    return nullptr;
+}
+
+const EntropyCodec *EntropyCodec::byName(const string &name) {
+    for (const EntropyCodec *c : all())
+        if (name == c->name()) return c;
+    return nullptr;
+}
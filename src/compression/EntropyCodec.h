@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Common face of the order-0 entropy coders (Huffman, rANS) so archives can pick one per file.
+// Both work on self-contained in-memory buffers and append their output.
+class EntropyCodec {
+public:
+    // Ids are stored in archive headers and double as BlockArchive block kinds and
+    // TransactionCodec column methods, where 0 and 2 already mean something else.
+    enum Id : uint8_t { HUFFMAN = 1, RANS = 3 };
+
+    virtual ~EntropyCodec() = default;
+    virtual Id id() const = 0;
+    virtual const char *name() const = 0;
+    virtual bool compress(const char *data, size_t len, string &out) const = 0;
+    // Appends exactly 'rawSize' bytes: the caller knows how much it stored, and a stream whose
+    // header says otherwise is rejected before anything is allocated for it.
+    virtual bool decompress(const char *data, size_t len, string &out, size_t rawSize) const = 0;
+
+    static const EntropyCodec *byId(uint8_t id); // nullptr if unknown
+    static const EntropyCodec *byName(const string &name);
+    static const vector<const EntropyCodec*> &all();
+};
@@ -1,12 +1,24 @@
 #include "Huffman.h"
+#include "BlockArchive.h"
+#include <algorithm>
 #include <fstream>
 #include <vector>
 #include <queue>
 #include <unordered_map>
 #include <cstdint>
+#include <cstring>
 #include<functional>
 using namespace std;
 
+// Canonical stream ("HUF2"): original length (u64 LE), 256 code lengths, then the bitstream
+// MSB-first. .huff files are block containers of such streams (BlockArchive.h); single-stream
+// files and archives written before canonical codes (preorder tree, first byte 0 or 1) still decode.
+static const char MAGIC_V2[4] = {'H', 'U', 'F', '2'};
+static constexpr int MAX_CODE_LEN = 12; // codes are length-limited so one table probe always resolves
+static constexpr int TABLE_BITS = MAX_CODE_LEN;
+static constexpr int MAX_SYMS_PER_PROBE = 3;
+static constexpr size_t IO_BLOCK = 1 << 20;
+
 // Node for Huffman tree
 struct Node {
     uint8_t byte;
@@ -22,20 +34,6 @@ struct NodeCmp {
     }
 };
 
-static void buildCodes(Node* root, vector<string> &codes, string &prefix) {
-    if (!root) return;
-    if (!root->left && !root->right) {
-        codes[root->byte] = prefix;
-    } else {
-        prefix.push_back('0');
-        buildCodes(root->left, codes, prefix);
-        prefix.pop_back();
-        prefix.push_back('1');
-        buildCodes(root->right, codes, prefix);
-        prefix.pop_back();
-    }
-}
-
 static void deleteTree(Node* root) {
     if (!root) return;
     deleteTree(root->left);
@@ -43,35 +41,6 @@ static void deleteTree(Node* root) {
     delete root;
 }
 
-// Write bits to output stream, buffering into bytes
-class BitWriter {
-    ofstream &out;
-    uint8_t buffer;
-    int bitCount;
-public:
-    BitWriter(ofstream &o): out(o), buffer(0), bitCount(0) {}
-    void writeBit(int b) {
-        buffer = (buffer << 1) | (b & 1);
-        bitCount++;
-        if (bitCount == 8) {
-            out.put(static_cast<char>(buffer));
-            buffer = 0;
-            bitCount = 0;
-        }
-    }
-    void writeCode(const string &code) {
-        for (char c: code) writeBit(c == '1' ? 1 : 0);
-    }
-    void flush() {
-        if (bitCount > 0) {
-            buffer <<= (8 - bitCount);
-            out.put(static_cast<char>(buffer));
-            buffer = 0;
-            bitCount = 0;
-        }
-    }
-};
-
 // Read bits from input stream
 class BitReader {
     ifstream &in;
@@ -94,32 +63,17 @@ public:
     }
 };
 
-bool Huffman::compressFile(const string &inputPath, const string &outputPath) {
-    ifstream in(inputPath, ios::binary);
-    if (!in) return false;
-    // Frequency map
-    vector<size_t> freq(256, 0);
-    char c;
-    while (in.get(c)) {
-        uint8_t b = static_cast<uint8_t>(c);
-        freq[b]++;
-    }
-    in.clear();
-    in.seekg(0);
-
-    // Build min-heap
+// Build the tree for a histogram; nullptr if fewer than two distinct bytes
+static Node* buildTree(const vector<size_t> &freq) {
     priority_queue<Node*, vector<Node*>, NodeCmp> pq;
     for (int i = 0; i < 256; ++i) {
         if (freq[i] > 0) {
             pq.push(new Node(static_cast<uint8_t>(i), freq[i]));
         }
     }
-    if (pq.empty()) return false;
-    // Edge case: only one unique byte
-    if (pq.size() == 1) {
-        Node* only = pq.top(); pq.pop();
-        Node* root = new Node(only, new Node(only->byte, 0));
-        pq.push(root);
+    if (pq.size() < 2) {
+        while (!pq.empty()) { delete pq.top(); pq.pop(); }
+        return nullptr;
     }
     while (pq.size() > 1) {
         Node* a = pq.top(); pq.pop();
@@ -127,47 +81,318 @@ bool Huffman::compressFile(const string &inputPath, const string &outputPath) {
         Node* parent = new Node(a, b);
         pq.push(parent);
     }
-    Node* root = pq.top();
+    return pq.top();
+}
 
-    // Build codes
-    vector<string> codes(256);
-    string prefix;
-    buildCodes(root, codes, prefix);
+static void collectDepths(Node* node, int depth, vector<int> &depthCount) {
+    if (!node->left && !node->right) {
+        depthCount[depth]++;
+        return;
+    }
+    collectDepths(node->left, depth + 1, depthCount);
+    collectDepths(node->right, depth + 1, depthCount);
+}
 
-    ofstream out(outputPath, ios::binary);
-    if (!out) { deleteTree(root); return false; }
-    // Serialize tree: preorder. Use '1' + byte for leaf, '0' for internal.
-    function<void(Node*)> writeTree = [&](Node* node) {
-        if (!node) return;
-        if (!node->left && !node->right) {
-            out.put(char(1));
-            out.put(static_cast<char>(node->byte));
-        } else {
-            out.put(char(0));
-            writeTree(node->left);
-            writeTree(node->right);
+// Code length per byte value (0 = unused), limited to MAX_CODE_LEN.
+static vector<uint8_t> computeCodeLengths(const vector<size_t> &freq) {
+    vector<uint8_t> lengths(256, 0);
+    vector<int> symbols;
+    for (int i = 0; i < 256; ++i) if (freq[i] > 0) symbols.push_back(i);
+    if (symbols.empty()) return lengths;
+    if (symbols.size() == 1) {
+        lengths[symbols[0]] = 1;
+        return lengths;
+    }
+    // Only the number of codes per length matters for a canonical code.
+    Node* root = buildTree(freq);
+    vector<int> bits(257, 0);
+    collectDepths(root, 0, bits);
+    deleteTree(root);
+    // Push overlong codes up the tree (JPEG Annex K.3): two leaves at depth i become one at
+    // i-1, and a shallower leaf is split to make room. Kraft equality is preserved.
+    for (int i = 256; i > MAX_CODE_LEN; --i) {
+        while (bits[i] > 0) {
+            int j = i - 2;
+            while (bits[j] == 0) --j;
+            bits[i] -= 2;
+            bits[i - 1] += 1;
+            bits[j + 1] += 2;
+            bits[j] -= 1;
         }
-    };
-    writeTree(root);
+    }
+    // Most frequent bytes get the shortest codes.
+    stable_sort(symbols.begin(), symbols.end(), [&](int a, int b) { return freq[a] > freq[b]; });
+    size_t k = 0;
+    for (int len = 1; len <= MAX_CODE_LEN; ++len) {
+        for (int n = 0; n < bits[len]; ++n) lengths[symbols[k++]] = uint8_t(len);
+    }
+    return lengths;
+}
 
-    // Write a marker to separate tree and data, e.g., one zero byte
-    out.put(char(2));
+// Canonical code assignment: shorter codes first, ties by byte value. False if the lengths
+// over-subscribe the code space (corrupt header).
+static bool assignCanonicalCodes(const vector<uint8_t> &lengths, vector<uint32_t> &codes) {
+    int count[MAX_CODE_LEN + 1] = {0};
+    for (int s = 0; s < 256; ++s) {
+        if (lengths[s] > MAX_CODE_LEN) return false;
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+    uint32_t next[MAX_CODE_LEN + 2] = {0};
+    uint32_t code = 0;
+    for (int len = 1; len <= MAX_CODE_LEN; ++len) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+        if (code + count[len] > (1u << len)) return false;
+    }
+    codes.assign(256, 0);
+    for (int s = 0; s < 256; ++s) {
+        if (lengths[s]) codes[s] = next[lengths[s]]++;
+    }
+    return true;
+}
 
-    // Write compressed data
-    BitWriter writer(out);
-    while (in.get(c)) {
-        uint8_t b = static_cast<uint8_t>(c);
-        writer.writeCode(codes[b]);
+// One entry per TABLE_BITS-bit window: up to MAX_SYMS_PER_PROBE whole codes that fit in it.
+struct DecodeEntry {
+    uint8_t syms[MAX_SYMS_PER_PROBE];
+    uint8_t count; // 0 = no code starts with these bits
+    uint8_t bits;  // total bits consumed by the symbols
+};
+
+static bool buildDecodeTable(const vector<uint8_t> &lengths, vector<DecodeEntry> &table) {
+    vector<uint32_t> codes;
+    if (!assignCanonicalCodes(lengths, codes)) return false;
+    const uint32_t size = 1u << TABLE_BITS;
+    vector<uint8_t> symOf(size, 0), lenOf(size, 0);
+    for (int s = 0; s < 256; ++s) {
+        int len = lengths[s];
+        if (!len) continue;
+        uint32_t first = codes[s] << (TABLE_BITS - len);
+        uint32_t last = (codes[s] + 1) << (TABLE_BITS - len);
+        for (uint32_t v = first; v < last; ++v) {
+            symOf[v] = uint8_t(s);
+            lenOf[v] = uint8_t(len);
+        }
+    }
+    table.assign(size, DecodeEntry{});
+    for (uint32_t v = 0; v < size; ++v) {
+        DecodeEntry &e = table[v];
+        e.count = 0;
+        e.bits = 0;
+        uint32_t window = v;
+        while (e.count < MAX_SYMS_PER_PROBE) {
+            int len = lenOf[window];
+            if (len == 0 || e.bits + len > TABLE_BITS) break;
+            e.syms[e.count++] = symOf[window];
+            e.bits += uint8_t(len);
+            window = (window << len) & (size - 1);
+        }
     }
-    writer.flush();
-    deleteTree(root);
     return true;
 }
 
-bool Huffman::decompressFile(const string &inputPath, const string &outputPath) {
+void Huffman::Encoder::count(const char *data, size_t len) {
+    // Four interleaved sub-histograms so consecutive equal bytes don't serialize on one
+    // counter; the loop has no cross-iteration dependency and the compiler can unroll it.
+    uint64_t sub[4][256] = {};
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        sub[0][p[i]]++;
+        sub[1][p[i + 1]]++;
+        sub[2][p[i + 2]]++;
+        sub[3][p[i + 3]]++;
+    }
+    for (; i < len; ++i) sub[0][p[i]]++;
+    for (int b = 0; b < 256; ++b) freq[b] += sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+    total += len;
+}
+
+bool Huffman::Encoder::begin(string &out) {
+    if (total == 0) return false;
+    lengths = computeCodeLengths(freq);
+    if (!assignCanonicalCodes(lengths, codes)) return false;
+    out.append(MAGIC_V2, sizeof(MAGIC_V2));
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((total >> (8 * i)) & 0xFF));
+    out.append(reinterpret_cast<const char*>(lengths.data()), lengths.size());
+    acc = 0;
+    accBits = 0;
+    return true;
+}
+
+void Huffman::Encoder::encode(const char *data, size_t len, string &out) {
+    // Reserve the worst case up front and write through a raw pointer; trimmed at the end.
+    size_t start = out.size();
+    out.resize(start + (len * MAX_CODE_LEN) / 8 + 8);
+    char *dst = &out[start];
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+    uint64_t a = acc;
+    int n = accBits;
+    size_t i = 0;
+    // Two codes per flush check: at most 31 + 2 * MAX_CODE_LEN bits are ever pending.
+    for (; i + 2 <= len; i += 2) {
+        a = (a << lengths[p[i]]) | codes[p[i]];
+        n += lengths[p[i]];
+        a = (a << lengths[p[i + 1]]) | codes[p[i + 1]];
+        n += lengths[p[i + 1]];
+        if (n >= 32) { // emit the oldest 32 bits as one big-endian word
+            n -= 32;
+            uint32_t w = uint32_t(a >> n);
+            dst[0] = char(w >> 24);
+            dst[1] = char(w >> 16);
+            dst[2] = char(w >> 8);
+            dst[3] = char(w);
+            dst += 4;
+        }
+    }
+    for (; i < len; ++i) {
+        a = (a << lengths[p[i]]) | codes[p[i]];
+        n += lengths[p[i]];
+        if (n >= 32) {
+            n -= 32;
+            uint32_t w = uint32_t(a >> n);
+            dst[0] = char(w >> 24);
+            dst[1] = char(w >> 16);
+            dst[2] = char(w >> 8);
+            dst[3] = char(w);
+            dst += 4;
+        }
+    }
+    acc = a;
+    accBits = n;
+    out.resize(size_t(dst - out.data()));
+}
+
+void Huffman::Encoder::finish(string &out) {
+    // Whole bytes first, then the last partial byte padded with zeros.
+    while (accBits >= 8) {
+        accBits -= 8;
+        out.push_back(static_cast<char>(acc >> accBits));
+    }
+    if (accBits > 0) out.push_back(static_cast<char>(acc << (8 - accBits)));
+    acc = 0;
+    accBits = 0;
+}
+
+bool Huffman::compressFile(const string &inputPath, const string &outputPath) {
     ifstream in(inputPath, ios::binary);
     if (!in) return false;
+    BlockArchiveWriter writer;
+    if (!writer.open(outputPath)) return false;
+    vector<char> buf(IO_BLOCK);
+    while (in) {
+        in.read(buf.data(), IO_BLOCK);
+        if (!writer.write(buf.data(), size_t(in.gcount()))) return false;
+    }
+    // An empty input has nothing to encode; keep the old "compression failed" answer.
+    return writer.close() && writer.rawBytes() > 0;
+}
+
+// Header after the magic: original length (u64 LE) and 256 code lengths.
+static constexpr size_t CANONICAL_HEADER = 8 + 256;
 
+static bool parseCanonicalHeader(const unsigned char *hdr, uint64_t &length, vector<DecodeEntry> &table) {
+    length = 0;
+    for (int i = 7; i >= 0; --i) length = (length << 8) | hdr[i];
+    vector<uint8_t> lengths(hdr + 8, hdr + CANONICAL_HEADER);
+    return buildDecodeTable(lengths, table);
+}
+
+// Table-driven decoder for the canonical format. Keeps up to 64 bits of lookahead, refilled
+// a byte at a time from whatever block 'refill(data, len)' hands over (false = no more input);
+// each probe emits every whole code in the window. Output leaves through 'emit(data, len)'.
+template <typename Refill, typename Emit>
+static bool decodeCanonical(const vector<DecodeEntry> &table, uint64_t remaining, Refill refill, Emit emit) {
+    vector<char> outBuf(IO_BLOCK + MAX_SYMS_PER_PROBE);
+    const char *in = nullptr;
+    size_t inLen = 0, outLen = 0;
+    bool eof = false;
+    uint64_t bitBuf = 0; // next bits, MSB-aligned
+    int bitCount = 0;
+    while (remaining > 0) {
+        while (bitCount <= 56) {
+            if (inLen == 0) {
+                if (eof || !refill(in, inLen) || inLen == 0) { eof = true; break; }
+            }
+            bitBuf |= uint64_t(static_cast<uint8_t>(*in++)) << (56 - bitCount);
+            --inLen;
+            bitCount += 8;
+        }
+        if (bitCount <= 0) return false; // stream ended before the recorded length
+        const DecodeEntry &e = table[bitBuf >> (64 - TABLE_BITS)];
+        if (e.count == 0) return false;
+        // Past the end the window is zero-filled; only the last, clamped probe may read into it.
+        size_t n = size_t(min<uint64_t>(e.count, remaining));
+        if (n == e.count && e.bits > bitCount) return false;
+        for (size_t i = 0; i < n; ++i) outBuf[outLen++] = static_cast<char>(e.syms[i]);
+        remaining -= n;
+        bitBuf <<= e.bits;
+        bitCount -= e.bits;
+        if (outLen >= IO_BLOCK) {
+            if (!emit(outBuf.data(), outLen)) return false;
+            outLen = 0;
+        }
+    }
+    return outLen == 0 || emit(outBuf.data(), outLen);
+}
+
+static bool decompressCanonical(ifstream &in, ofstream &out) {
+    unsigned char hdr[CANONICAL_HEADER];
+    in.read(reinterpret_cast<char*>(hdr), CANONICAL_HEADER);
+    if (size_t(in.gcount()) != CANONICAL_HEADER) return false;
+    uint64_t length;
+    vector<DecodeEntry> table;
+    if (!parseCanonicalHeader(hdr, length, table)) return false;
+    vector<char> inBuf(IO_BLOCK);
+    auto refill = [&](const char *&data, size_t &len) {
+        in.read(inBuf.data(), IO_BLOCK);
+        data = inBuf.data();
+        len = size_t(in.gcount());
+        return len > 0;
+    };
+    auto emit = [&](const char *data, size_t len) {
+        out.write(data, len);
+        return bool(out);
+    };
+    return decodeCanonical(table, length, refill, emit);
+}
+
+bool Huffman::compressBuffer(const char *data, size_t len, string &out) {
+    Encoder enc;
+    enc.count(data, len);
+    if (!enc.begin(out)) return false;
+    enc.encode(data, len, out);
+    enc.finish(out);
+    return true;
+}
+
+bool Huffman::decompressBuffer(const char *data, size_t len, string &out, size_t rawSize) {
+    if (len < sizeof(MAGIC_V2) + CANONICAL_HEADER || memcmp(data, MAGIC_V2, sizeof(MAGIC_V2)) != 0) return false;
+    const unsigned char *hdr = reinterpret_cast<const unsigned char*>(data + sizeof(MAGIC_V2));
+    uint64_t length;
+    vector<DecodeEntry> table;
+    const char *body = data + sizeof(MAGIC_V2) + CANONICAL_HEADER;
+    size_t bodyLen = len - sizeof(MAGIC_V2) - CANONICAL_HEADER;
+    // Every code is at least one bit, so the body bounds the length too.
+    if (!parseCanonicalHeader(hdr, length, table) || length != rawSize || length > uint64_t(bodyLen) * 8) return false;
+    out.reserve(out.size() + length);
+    bool given = false;
+    auto refill = [&](const char *&p, size_t &n) {
+        if (given) return false;
+        given = true;
+        p = body;
+        n = bodyLen;
+        return true;
+    };
+    auto emit = [&](const char *p, size_t n) {
+        out.append(p, n);
+        return true;
+    };
+    return decodeCanonical(table, length, refill, emit);
+}
+
+// Pre-canonical archives: preorder tree, separator, then bits until EOF.
+static bool decompressLegacy(ifstream &in, ofstream &out) {
     // Rebuild tree
     function<Node*()> readTree = [&]() -> Node* {
         int flag = in.get();
@@ -189,9 +414,6 @@ bool Huffman::decompressFile(const string &inputPath, const string &outputPath)
     // Read separator
     in.get(); // assume the marker
 
-    ofstream out(outputPath, ios::binary);
-    if (!out) { deleteTree(root); return false; }
-
     BitReader reader(in);
     Node* node = root;
     while (true) {
@@ -210,3 +432,21 @@ bool Huffman::decompressFile(const string &inputPath, const string &outputPath)
     deleteTree(root);
     return true;
 }
+
+bool Huffman::decompressFile(const string &inputPath, const string &outputPath) {
+    if (BlockArchiveReader::isBlockArchive(inputPath)) {
+        BlockArchiveReader reader;
+        return reader.open(inputPath) && reader.decompressTo(outputPath);
+    }
+    ifstream in(inputPath, ios::binary);
+    if (!in) return false;
+    char magic[4] = {0};
+    in.read(magic, 4);
+    bool canonical = in.gcount() == 4 && memcmp(magic, MAGIC_V2, 4) == 0;
+    in.clear();
+    if (!canonical) in.seekg(0);
+
+    ofstream out(outputPath, ios::binary);
+    if (!out) return false;
+    return canonical ? decompressCanonical(in, out) : decompressLegacy(in, out);
+}
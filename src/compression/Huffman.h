@@ -1,6 +1,8 @@
 // Huffman.h
 #pragma once
+#include <cstdint>
 #include <string>
+#include <vector>
 using namespace std;
 
 class Huffman {
@@ -9,4 +11,30 @@ class Huffman {
      static bool compressFile(const string &inputPath, const string &outputPath);
         static bool decompressFile(const string &inputPath, const string &outputPath);
 
+    // One self-contained canonical stream in memory (header included); output is appended.
+    // Decoding fails unless the stream holds exactly 'rawSize' bytes.
+    static bool compressBuffer(const char *data, size_t len, string &out);
+    static bool decompressBuffer(const char *data, size_t len, string &out, size_t rawSize);
+
+    // Incremental encoder for callers that produce the input as a stream of chunks.
+    // Huffman needs the byte histogram before the first code is written, so it takes two passes:
+    // count() every chunk, then begin() once and encode() the same bytes in the same order.
+    // All output is appended to the caller's string; concatenated it is one canonical stream
+    // (see Huffman.cpp for the layout).
+    class Encoder {
+    public:
+        void count(const char *data, size_t len);
+        bool begin(string &out); // writes the header; false if nothing was counted
+        void encode(const char *data, size_t len, string &out);
+        void finish(string &out); // pads and flushes the last partial byte
+
+    private:
+        vector<size_t> freq = vector<size_t>(256, 0);
+        uint64_t total = 0;
+        vector<uint8_t> lengths;
+        vector<uint32_t> codes;
+        uint64_t acc = 0; // pending bits, low 'accBits' are valid
+        int accBits = 0;
+    };
+
 };
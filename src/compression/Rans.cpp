@@ -0,0 +1,228 @@
+#include "Rans.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// Layout: "RAN1" | length (varint) | 32-byte bitmap of the symbols present |
+//         frequency of each present symbol (varint, summing to PROB_SCALE) |
+//         initial states of streams 0..3 (u32 LE each) | renormalization words (u16 LE).
+// The encoder runs backwards over the input and writes the stream back to front, so the
+// decoder reads everything strictly forwards. States are 32-bit and renormalize by a whole
+// 16-bit word, so each step moves at most one word and needs no loop (rans_word style).
+static const char MAGIC[4] = {'R', 'A', 'N', '1'};
+static constexpr uint32_t PROB_BITS = 12;
+static constexpr uint32_t PROB_SCALE = 1u << PROB_BITS;
+static constexpr uint32_t RANS_L = 1u << 16; // states live in [RANS_L, 2^32)
+static constexpr int STREAMS = 4;
+
+// x / freq as a multiply and shift. After renormalization x < 2^20 * freq, which keeps
+// x * rcpFreq inside 64 bits and the rounding error below one, so the quotient is exact.
+static constexpr int RCP_SHIFT = 44;
+
+struct EncSymbol {
+    uint64_t xMax; // renormalize first if the state is at least this (2^32 for a lone symbol)
+    uint64_t rcpFreq;
+    uint32_t freq;
+    uint32_t bias;     // start
+    uint32_t cmplFreq; // PROB_SCALE - freq
+
+    void init(uint32_t start, uint32_t f) {
+        xMax = uint64_t((RANS_L >> PROB_BITS) << 16) * f;
+        rcpFreq = ((uint64_t(1) << RCP_SHIFT) + f - 1) / f;
+        freq = f;
+        bias = start;
+        cmplFreq = PROB_SCALE - f;
+    }
+};
+
+struct DecodeSlot {
+    uint16_t freq;
+    uint16_t offset; // slot - start of its symbol
+    uint8_t symbol;
+};
+
+// Writes the low word below ptr unconditionally and only keeps it if the state needed it,
+// which keeps the data-dependent branch out of the loop.
+static inline void encodePut(uint32_t &x, uint8_t *&ptr, const EncSymbol &s) {
+    uint32_t renorm = uint32_t(x >= s.xMax); // arithmetic rather than ?: so it stays branch-free
+    ptr[-2] = uint8_t(x);
+    ptr[-1] = uint8_t(x >> 8);
+    ptr -= 2 * renorm;
+    x >>= 16 * renorm;
+    uint32_t q = uint32_t((uint64_t(x) * s.rcpFreq) >> RCP_SHIFT);
+    x += s.bias + q * s.cmplFreq; // == (q << PROB_BITS) + x % freq + start
+}
+
+// Needs two readable bytes at ptr, whether or not they get used.
+static inline void decodeGet(uint32_t &x, const uint8_t *&ptr, const DecodeSlot *table, uint8_t &symbol) {
+    const DecodeSlot &d = table[x & (PROB_SCALE - 1)];
+    symbol = d.symbol;
+    x = d.freq * (x >> PROB_BITS) + d.offset;
+    uint32_t renorm = uint32_t(x < RANS_L);
+    uint32_t word = uint32_t(ptr[0]) | uint32_t(ptr[1]) << 8;
+    x = (x << (16 * renorm)) | (word & (0u - renorm));
+    ptr += 2 * renorm;
+}
+
+static inline bool decodeGetChecked(uint32_t &x, const uint8_t *&ptr, const uint8_t *end,
+                                    const DecodeSlot *table, uint8_t &symbol) {
+    const DecodeSlot &d = table[x & (PROB_SCALE - 1)];
+    symbol = d.symbol;
+    x = d.freq * (x >> PROB_BITS) + d.offset;
+    if (x < RANS_L) {
+        if (end - ptr < 2) return false;
+        x = (x << 16) | uint32_t(ptr[0]) | uint32_t(ptr[1]) << 8;
+        ptr += 2;
+    }
+    return true;
+}
+
+static void putVarint(string &s, uint64_t v) {
+    while (v >= 0x80) {
+        s.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    s.push_back(char(v));
+}
+
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p != end; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Scales the histogram to PROB_SCALE, keeping every present symbol at least 1.
+static void normalizeFrequencies(const uint64_t *counts, uint64_t total, uint32_t *freq) {
+    uint32_t sum = 0;
+    for (int s = 0; s < 256; ++s) {
+        freq[s] = 0;
+        if (!counts[s]) continue;
+        uint64_t f = counts[s] * PROB_SCALE / total;
+        freq[s] = f ? uint32_t(f) : 1;
+        sum += freq[s];
+    }
+    // Rounding leaves the sum off by a little; settle the difference on the largest symbols,
+    // where it costs the least.
+    while (sum != PROB_SCALE) {
+        int largest = 0;
+        for (int s = 1; s < 256; ++s)
+            if (freq[s] > freq[largest]) largest = s;
+        if (sum < PROB_SCALE) {
+            freq[largest] += PROB_SCALE - sum;
+            sum = PROB_SCALE;
+        } else {
+            uint32_t take = min(sum - PROB_SCALE, freq[largest] - 1);
+            freq[largest] -= take;
+            sum -= take;
+        }
+    }
+}
+
+bool Rans::compressBuffer(const char *data, size_t len, string &out) {
+    if (len == 0) return false;
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(data);
+
+    uint64_t hist[4][256] = {};
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        ++hist[0][in[i]];
+        ++hist[1][in[i + 1]];
+        ++hist[2][in[i + 2]];
+        ++hist[3][in[i + 3]];
+    }
+    for (; i < len; ++i) ++hist[0][in[i]];
+    uint64_t counts[256];
+    for (int s = 0; s < 256; ++s) counts[s] = hist[0][s] + hist[1][s] + hist[2][s] + hist[3][s];
+
+    uint32_t freq[256];
+    normalizeFrequencies(counts, len, freq);
+    EncSymbol syms[256];
+    uint32_t start = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (freq[s]) syms[s].init(start, freq[s]);
+        start += freq[s];
+    }
+
+    // At most one word per symbol, the final states, and room for encodePut's speculative write.
+    vector<uint8_t> buf(2 * len + STREAMS * 4 + 2);
+    uint8_t *end = buf.data() + buf.size();
+    uint8_t *ptr = end;
+    uint32_t x0 = RANS_L, x1 = RANS_L, x2 = RANS_L, x3 = RANS_L;
+    i = len;
+    switch (len & 3) { // the trailing partial group, last symbol first
+    case 3: encodePut(x2, ptr, syms[in[--i]]); // fall through
+    case 2: encodePut(x1, ptr, syms[in[--i]]); // fall through
+    case 1: encodePut(x0, ptr, syms[in[--i]]);
+    }
+    for (; i > 0; i -= 4) {
+        encodePut(x3, ptr, syms[in[i - 1]]);
+        encodePut(x2, ptr, syms[in[i - 2]]);
+        encodePut(x1, ptr, syms[in[i - 3]]);
+        encodePut(x0, ptr, syms[in[i - 4]]);
+    }
+    for (uint32_t x : {x3, x2, x1, x0}) {
+        ptr -= 4;
+        for (int b = 0; b < 4; ++b) ptr[b] = uint8_t(x >> (8 * b));
+    }
+
+    out.append(MAGIC, sizeof(MAGIC));
+    putVarint(out, len);
+    char bitmap[32] = {};
+    for (int s = 0; s < 256; ++s)
+        if (freq[s]) bitmap[s >> 3] |= char(1 << (s & 7));
+    out.append(bitmap, sizeof(bitmap));
+    for (int s = 0; s < 256; ++s)
+        if (freq[s]) putVarint(out, freq[s]);
+    out.append(reinterpret_cast<const char*>(ptr), size_t(end - ptr));
+    return true;
+}
+
+bool Rans::decompressBuffer(const char *data, size_t len, string &out, size_t rawSize) {
+    if (len < sizeof(MAGIC) || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) return false;
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(data) + sizeof(MAGIC);
+    const uint8_t *end = reinterpret_cast<const uint8_t*>(data) + len;
+    uint64_t length;
+    if (!getVarint(p, end, length) || length != rawSize || end - p < 32) return false;
+    const uint8_t *bitmap = p;
+    p += 32;
+
+    vector<DecodeSlot> table(PROB_SCALE);
+    uint32_t start = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (!(bitmap[s >> 3] & (1 << (s & 7)))) continue;
+        uint64_t f;
+        if (!getVarint(p, end, f) || f == 0 || f > PROB_SCALE - start) return false;
+        for (uint32_t k = 0; k < f; ++k) table[start + k] = DecodeSlot{uint16_t(f), uint16_t(k), uint8_t(s)};
+        start += uint32_t(f);
+    }
+    if (start != PROB_SCALE || end - p < STREAMS * 4) return false;
+
+    uint32_t x[STREAMS];
+    for (int s = 0; s < STREAMS; ++s, p += 4)
+        x[s] = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+
+    size_t base = out.size();
+    out.resize(base + length);
+    uint8_t *o = reinterpret_cast<uint8_t*>(&out[base]);
+    const DecodeSlot *t = table.data();
+    uint32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+    size_t i = 0;
+    // Four symbols read at most four words; past that point every read is bounds-checked.
+    for (; i + 4 <= length && end - p >= 2 * STREAMS; i += 4) {
+        decodeGet(x0, p, t, o[i]);
+        decodeGet(x1, p, t, o[i + 1]);
+        decodeGet(x2, p, t, o[i + 2]);
+        decodeGet(x3, p, t, o[i + 3]);
+    }
+    x[0] = x0; x[1] = x1; x[2] = x2; x[3] = x3;
+    bool ok = true;
+    for (; i < length && ok; ++i) ok = decodeGetChecked(x[i & 3], p, end, t, o[i]);
+    // A well-formed stream ends exactly where the encoder started: every state back at RANS_L.
+    return ok && p == end && x[0] == RANS_L && x[1] == RANS_L && x[2] == RANS_L && x[3] == RANS_L;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <string>
+using namespace std;
+
+// Order-0 range ANS (rANS) with 12-bit probabilities. Symbols are spread round-robin over four
+// coder states that share one byte stream, so consecutive symbols carry no data dependency and
+// the CPU can work on four at once. Costs fractional bits per symbol where Huffman rounds up
+// to whole bits, which matters most on skewed inputs.
+class Rans {
+public:
+    // One self-contained stream in memory (frequency header included); output is appended.
+    // Decoding fails unless the stream holds exactly 'rawSize' bytes.
+    static bool compressBuffer(const char *data, size_t len, string &out);
+    static bool decompressBuffer(const char *data, size_t len, string &out, size_t rawSize);
+};
@@ -0,0 +1,439 @@
+#include "TransactionCodec.h"
+#include "EntropyCodec.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// Layout (integers are LEB128 varints unless noted):
+//   version u8 | line count | flags u8 | dictionary size | per entry: length, bytes
+//   then for each column in Column order: raw length | method u8 | stored length | bytes
+// Lines are '\n'-terminated; flag bit 0 means the final line had no terminator.
+static constexpr uint8_t VERSION = 1;
+static constexpr uint8_t FLAG_UNTERMINATED = 1;
+static constexpr size_t MAX_TYPES = 256;
+static constexpr size_t MAX_DIGITS = 18;  // keeps every mantissa inside int64
+static constexpr size_t MAX_VARINT = 10;
+static constexpr size_t MAX_RECORD_TEXT = 66; // a record's text less its type: 20+1+1+21+1+20+'\n'
+
+enum LineKind : uint8_t { RECORD = 0, RECORD_NO_TIME = 1, RAW = 2 };
+enum Column { KINDS, TYPES, TIMES, AMOUNTS, SCALES, ACCOUNTS, RAW_LINES, COLUMN_COUNT };
+// Any other column method is the EntropyCodec id the column was coded with.
+enum ColumnMethod : uint8_t { COLUMN_STORED = 0, COLUMN_CONSTANT = 2 };
+
+static void putVarint(string &s, uint64_t v) {
+    while (v >= 0x80) {
+        s.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    s.push_back(char(v));
+}
+
+// Append-only byte column written through a raw pointer; callers reserve() the worst case for
+// a record first so the per-field writes carry no capacity checks.
+class ColumnWriter {
+public:
+    explicit ColumnWriter(size_t initial = 0) { grow(initial); }
+    void reserve(size_t n) { if (size_t(limit - pos) < n) grow(n); }
+    void put(uint8_t b) { *pos++ = char(b); }
+    void putVarint(uint64_t v) {
+        while (v >= 0x80) {
+            *pos++ = char(v | 0x80);
+            v >>= 7;
+        }
+        *pos++ = char(v);
+    }
+    void append(const char *p, size_t n) {
+        reserve(n);
+        memcpy(pos, p, n);
+        pos += n;
+    }
+    const char *data() const { return bytes.data(); }
+    size_t size() const { return size_t(pos - bytes.data()); }
+
+private:
+    vector<char> bytes;
+    char *pos = nullptr;
+    char *limit = nullptr;
+
+    void grow(size_t n) {
+        size_t used = size();
+        bytes.resize(max(bytes.size() * 2, used + n + 64));
+        pos = bytes.data() + used;
+        limit = bytes.data() + bytes.size();
+    }
+};
+
+static uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+struct Cursor {
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) break;
+            uint8_t b = uint8_t(*p++);
+            v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    uint8_t byte() {
+        if (p == end) { ok = false; return 0; }
+        return uint8_t(*p++);
+    }
+    const char *take(size_t n) {
+        if (size_t(end - p) < n) { ok = false; return nullptr; }
+        const char *r = p;
+        p += n;
+        return r;
+    }
+};
+
+static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+static bool digitsAt(const char *p, int n, int &v) {
+    v = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!isDigit(p[i])) return false;
+        v = v * 10 + (p[i] - '0');
+    }
+    return true;
+}
+
+// "YYYY-MM-DDTHH:MM:SSZ" packed as a mixed-radix number, so later times compare greater and
+// consecutive records differ by a small delta. Field ranges are checked rather than dates
+// validated: anything that fits the radices prints back identically.
+static bool parseTimestamp(const char *p, uint64_t &v) {
+    if (p[4] != '-' || p[7] != '-' || p[10] != 'T' || p[13] != ':' || p[16] != ':' || p[19] != 'Z')
+        return false;
+    int y, mo, d, h, mi, s;
+    if (!digitsAt(p, 4, y) || !digitsAt(p + 5, 2, mo) || !digitsAt(p + 8, 2, d) ||
+        !digitsAt(p + 11, 2, h) || !digitsAt(p + 14, 2, mi) || !digitsAt(p + 17, 2, s))
+        return false;
+    if (mo > 12 || d > 31 || h > 23 || mi > 59 || s > 60) return false;
+    v = ((((uint64_t(y) * 13 + mo) * 32 + d) * 24 + h) * 60 + mi) * 61 + s;
+    return true;
+}
+
+static bool samePrefix17(const char *a, const char *b) {
+    uint64_t a0, a1, b0, b1;
+    memcpy(&a0, a, 8); memcpy(&a1, a + 8, 8);
+    memcpy(&b0, b, 8); memcpy(&b1, b + 8, 8);
+    return a0 == b0 && a1 == b1 && a[16] == b[16];
+}
+
+// Consecutive records mostly share everything up to the minute, so only the seconds
+// need parsing when the prefix matches the previous timestamp.
+static bool parseTimestampAfter(const char *p, const char *prevText, uint64_t prevTime, uint64_t &v) {
+    if (!prevText || !samePrefix17(p, prevText)) return parseTimestamp(p, v);
+    int s;
+    if (!digitsAt(p + 17, 2, s) || s > 60 || p[19] != 'Z') return false;
+    v = prevTime - prevTime % 61 + s;
+    return true;
+}
+
+static char *putDigits(char *o, uint64_t v, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        o[i] = char('0' + v % 10);
+        v /= 10;
+    }
+    return o + width;
+}
+
+// Inverse of parseTimestamp. The text up to the minute is kept from the previous call, so a run
+// of records within one minute only formats the seconds.
+class TimestampPrinter {
+public:
+    char *print(char *o, uint64_t v) {
+        uint64_t minute = v / 61;
+        if (minute != cachedMinute) {
+            uint64_t m = minute;
+            uint64_t mi = m % 60; m /= 60;
+            uint64_t h = m % 24; m /= 24;
+            uint64_t d = m % 32; m /= 32;
+            uint64_t mo = m % 13; m /= 13;
+            if (m > 9999) return nullptr;
+            char *t = putDigits(prefix, m, 4); *t++ = '-';
+            t = putDigits(t, mo, 2); *t++ = '-';
+            t = putDigits(t, d, 2); *t++ = 'T';
+            t = putDigits(t, h, 2); *t++ = ':';
+            t = putDigits(t, mi, 2); *t++ = ':';
+            cachedMinute = minute;
+        }
+        memcpy(o, prefix, sizeof(prefix));
+        o = putDigits(o + sizeof(prefix), v % 61, 2);
+        *o++ = 'Z';
+        return o;
+    }
+
+private:
+    uint64_t cachedMinute = UINT64_MAX;
+    char prefix[17];
+};
+
+// Plain decimals as printed by ostream ("-12.50", "7", "0.05"), read up to the '|' that ends
+// the field. Exponent forms, leading zeros and "-0" are refused so that the mantissa/scale pair
+// prints back to the same text.
+static bool parseAmount(const char *&p, const char *end, int64_t &mantissa, uint8_t &scale) {
+    bool negative = p != end && *p == '-';
+    if (negative) ++p;
+    const char *intStart = p;
+    uint64_t m = 0; // unsigned so overlong input wraps harmlessly before the digit check
+    while (p != end && isDigit(*p)) m = m * 10 + (*p++ - '0');
+    size_t intDigits = size_t(p - intStart);
+    if (intDigits == 0 || intDigits > MAX_DIGITS || (intDigits > 1 && *intStart == '0')) return false;
+    size_t fracDigits = 0;
+    if (p != end && *p == '.') {
+        const char *fracStart = ++p;
+        while (p != end && isDigit(*p)) m = m * 10 + (*p++ - '0');
+        fracDigits = size_t(p - fracStart);
+        if (fracDigits == 0 || intDigits + fracDigits > MAX_DIGITS) return false;
+    }
+    if (p == end || *p++ != '|' || (negative && m == 0)) return false;
+    mantissa = negative ? -int64_t(m) : int64_t(m);
+    scale = uint8_t(fracDigits);
+    return true;
+}
+
+// Account numbers as printed by operator<< on int (optional '-', no leading zeros), read up to
+// the end of the line.
+static bool parseAccount(const char *&p, const char *end, int64_t &v) {
+    bool negative = p != end && *p == '-';
+    if (negative) ++p;
+    const char *start = p;
+    uint64_t m = 0;
+    while (p != end && isDigit(*p)) m = m * 10 + (*p++ - '0');
+    size_t digits = size_t(p - start);
+    if (digits == 0 || digits > MAX_DIGITS || (digits > 1 && *start == '0')) return false;
+    if (p != end && *p++ != '\n') return false;
+    if (negative && m == 0) return false;
+    v = negative ? -int64_t(m) : int64_t(m);
+    return true;
+}
+
+// Signed decimal with at least minDigits digits and a '.' before the last 'point' of them.
+static char *putDecimal(char *o, int64_t v, size_t minDigits, size_t point) {
+    if (v < 0) *o++ = '-';
+    uint64_t magnitude = v < 0 ? uint64_t(0) - uint64_t(v) : uint64_t(v);
+    char buf[24];
+    char *b = buf + sizeof(buf);
+    size_t digits = 0;
+    do {
+        if (point && digits == point) *--b = '.';
+        *--b = char('0' + magnitude % 10);
+        magnitude /= 10;
+        ++digits;
+    } while (magnitude || digits < minDigits);
+    size_t n = size_t(buf + sizeof(buf) - b);
+    memcpy(o, b, n);
+    return o + n;
+}
+
+static void putColumn(string &out, const ColumnWriter &col, const EntropyCodec &entropy) {
+    const char *d = col.data();
+    size_t n = col.size();
+    putVarint(out, n);
+    string coded;
+    if (n && all_of(d, d + n, [d](char c) { return c == d[0]; })) {
+        out.push_back(char(COLUMN_CONSTANT));
+        putVarint(out, 1);
+        out.push_back(d[0]);
+    } else if (n && entropy.compress(d, n, coded) && coded.size() < n) {
+        out.push_back(char(entropy.id()));
+        putVarint(out, coded.size());
+        out += coded;
+    } else {
+        out.push_back(char(COLUMN_STORED));
+        putVarint(out, n);
+        out.append(d, n);
+    }
+}
+
+// Every column takes no more bytes than the text it came from, so 'maxLen' is the text's size.
+static bool getColumn(Cursor &in, string &col, size_t maxLen) {
+    uint64_t rawLen = in.varint();
+    uint8_t method = in.byte();
+    uint64_t storedLen = in.varint();
+    const char *bytes = in.ok ? in.take(storedLen) : nullptr;
+    if (!bytes || rawLen > maxLen) return false;
+    col.clear();
+    const EntropyCodec *entropy = EntropyCodec::byId(method);
+    if (method == COLUMN_STORED) {
+        col.assign(bytes, storedLen);
+    } else if (method == COLUMN_CONSTANT) {
+        if (storedLen != 1) return false;
+        col.assign(rawLen, bytes[0]);
+    } else if (!entropy || !entropy->decompress(bytes, storedLen, col, size_t(rawLen))) {
+        return false;
+    }
+    return col.size() == rawLen;
+}
+
+bool TransactionCodec::encode(const char *data, size_t len, string &out, const EntropyCodec &entropy) {
+    vector<string> dictionary;
+    // Sized for lines of ~32 bytes so typical logs never reallocate.
+    ColumnWriter cols[COLUMN_COUNT] = {
+        ColumnWriter(len / 32), ColumnWriter(len / 32), ColumnWriter(len / 16),
+        ColumnWriter(len / 16), ColumnWriter(len / 32), ColumnWriter(len / 16), ColumnWriter()};
+    uint64_t lines = 0;
+    uint64_t prevTime = 0;
+    const char *prevText = nullptr; // text of the last parsed timestamp, inside 'data'
+
+    // Records are parsed in a single pass over the line; anything unexpected sends the whole
+    // line to the raw column instead.
+    const char *p = data;
+    const char *end = data + len;
+    while (p != end) {
+        const char *line = p;
+        ++lines;
+        uint64_t time = 0;
+        int64_t mantissa = 0, account = 0;
+        uint8_t scale = 0;
+        size_t typeIndex = 0;
+        bool timed = *p != '|';
+        bool parsed = !timed || (end - p > 20 && p[20] == '|' && parseTimestampAfter(p, prevText, prevTime, time));
+        if (parsed) {
+            p += timed ? 21 : 1;
+            // Types repeat, so try the dictionary against the text before scanning for the '|'.
+            size_t left = size_t(end - p);
+            while (typeIndex < dictionary.size()) {
+                const string &t = dictionary[typeIndex];
+                if (left > t.size() && p[t.size()] == '|' && memcmp(p, t.data(), t.size()) == 0) break;
+                ++typeIndex;
+            }
+            if (typeIndex < dictionary.size()) {
+                p += dictionary[typeIndex].size();
+            } else {
+                const char *type = p;
+                while (p != end && *p != '|' && *p != '\n') ++p;
+                if (p != end && *p == '|' && dictionary.size() < MAX_TYPES) dictionary.emplace_back(type, p);
+                else parsed = false;
+            }
+            parsed = parsed && *p++ == '|' && parseAmount(p, end, mantissa, scale) && parseAccount(p, end, account);
+        }
+        if (parsed) {
+            cols[KINDS].reserve(1);
+            if (timed) {
+                cols[KINDS].put(RECORD);
+                cols[TIMES].reserve(MAX_VARINT);
+                cols[TIMES].putVarint(zigzag(int64_t(time - prevTime)));
+                prevTime = time;
+                prevText = line;
+            } else {
+                cols[KINDS].put(RECORD_NO_TIME);
+            }
+            cols[TYPES].reserve(1);
+            cols[TYPES].put(uint8_t(typeIndex));
+            cols[AMOUNTS].reserve(MAX_VARINT);
+            cols[AMOUNTS].putVarint(zigzag(mantissa));
+            cols[SCALES].reserve(1);
+            cols[SCALES].put(scale);
+            cols[ACCOUNTS].reserve(MAX_VARINT);
+            cols[ACCOUNTS].putVarint(zigzag(account));
+        } else {
+            const char *nl = static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+            p = nl ? nl + 1 : end;
+            cols[KINDS].reserve(1);
+            cols[KINDS].put(RAW);
+            cols[RAW_LINES].append(line, size_t(p - line));
+            if (!nl) {
+                cols[RAW_LINES].reserve(1);
+                cols[RAW_LINES].put('\n');
+            }
+        }
+    }
+
+    out.push_back(char(VERSION));
+    putVarint(out, lines);
+    out.push_back(char(len && data[len - 1] != '\n' ? FLAG_UNTERMINATED : 0));
+    putVarint(out, dictionary.size());
+    for (const string &t : dictionary) {
+        putVarint(out, t.size());
+        out += t;
+    }
+    for (const ColumnWriter &col : cols) putColumn(out, col, entropy);
+    return true;
+}
+
+bool TransactionCodec::decode(const char *data, size_t len, string &out, size_t rawSize) {
+    Cursor in{data, data + len};
+    if (in.byte() != VERSION) return false;
+    uint64_t lines = in.varint();
+    uint8_t flags = in.byte();
+    uint64_t dictSize = in.varint();
+    if (!in.ok || dictSize > MAX_TYPES || lines > rawSize) return false;
+    vector<string> dictionary(dictSize);
+    size_t longestType = 0;
+    for (string &t : dictionary) {
+        uint64_t n = in.varint();
+        const char *bytes = in.ok ? in.take(n) : nullptr;
+        if (!bytes) return false;
+        t.assign(bytes, n);
+        longestType = max(longestType, t.size());
+    }
+    string cols[COLUMN_COUNT];
+    for (string &col : cols)
+        if (!getColumn(in, col, rawSize)) return false;
+    const string &kinds = cols[KINDS], &types = cols[TYPES], &scales = cols[SCALES];
+    if (in.p != in.end || kinds.size() != lines || types.size() != scales.size()) return false;
+
+    // Render straight into 'out', sized for the longest possible text (but no more than one
+    // line past 'rawSize', which is checked line by line) and trimmed at the end.
+    size_t base = out.size();
+    size_t room = types.size() * (MAX_RECORD_TEXT + longestType) + cols[RAW_LINES].size();
+    out.resize(base + min(room, rawSize + 1 + MAX_RECORD_TEXT + longestType + cols[RAW_LINES].size()));
+    char *o = &out[base];
+    const char *limit = o + rawSize;
+    Cursor times{cols[TIMES].data(), cols[TIMES].data() + cols[TIMES].size()};
+    Cursor amounts{cols[AMOUNTS].data(), cols[AMOUNTS].data() + cols[AMOUNTS].size()};
+    Cursor accounts{cols[ACCOUNTS].data(), cols[ACCOUNTS].data() + cols[ACCOUNTS].size()};
+    Cursor raw{cols[RAW_LINES].data(), cols[RAW_LINES].data() + cols[RAW_LINES].size()};
+    TimestampPrinter timestamps;
+    size_t record = 0;
+    uint64_t prevTime = 0;
+
+    for (uint64_t i = 0; i < lines; ++i) {
+        uint8_t kind = uint8_t(kinds[i]);
+        if (kind == RAW) {
+            const char *nl = static_cast<const char*>(memchr(raw.p, '\n', size_t(raw.end - raw.p)));
+            if (!nl) return false;
+            memcpy(o, raw.p, size_t(nl + 1 - raw.p));
+            o += nl + 1 - raw.p;
+            raw.p = nl + 1;
+            if (o > limit + 1) return false;
+            continue;
+        }
+        if (record == types.size()) return false;
+        if (kind == RECORD) {
+            prevTime += uint64_t(unzigzag(times.varint()));
+            if (!(o = timestamps.print(o, prevTime))) return false;
+        } else if (kind != RECORD_NO_TIME) {
+            return false;
+        }
+        *o++ = '|';
+        size_t typeIndex = uint8_t(types[record]);
+        uint8_t scale = uint8_t(scales[record]);
+        if (typeIndex >= dictionary.size() || scale >= MAX_DIGITS) return false;
+        const string &type = dictionary[typeIndex];
+        memcpy(o, type.data(), type.size());
+        o += type.size();
+        *o++ = '|';
+        o = putDecimal(o, unzigzag(amounts.varint()), size_t(scale) + 1, scale);
+        *o++ = '|';
+        o = putDecimal(o, unzigzag(accounts.varint()), 1, 0);
+        *o++ = '\n';
+        ++record;
+        if (o > limit + 1) return false; // longer than the block it claims to be
+    }
+    if (lines && (flags & FLAG_UNTERMINATED)) --o;
+    out.resize(size_t(o - out.data()));
+    return out.size() - base == rawSize && times.ok && amounts.ok && accounts.ok && raw.p == raw.end && times.p == times.end &&
+           amounts.p == amounts.end && accounts.p == accounts.end && record == types.size();
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <string>
+using namespace std;
+
+class EntropyCodec;
+
+// Columnar codec for transaction log text (Transaction::serialize lines, '\n'-terminated).
+// Each line "timestamp|type|amount|relatedAccount" is split into columns:
+//   timestamps  delta from the previous record, zigzag varint
+//   types       index into a per-block dictionary
+//   amounts     decimal mantissa as zigzag varint, plus the number of fraction digits
+//   accounts    zigzag varint
+// and every column is then entropy-coded on its own. A field is only taken apart if
+// printing it back gives the exact same text; any other line is kept verbatim in a raw
+// column, so arbitrary input round-trips byte for byte.
+class TransactionCodec {
+public:
+    // Appends the encoded form of data[0, len) to 'out', entropy-coding columns with 'entropy'.
+    static bool encode(const char *data, size_t len, string &out, const EntropyCodec &entropy);
+    // Appends the original text, exactly 'rawSize' bytes of it, to 'out'; false if the input is
+    // malformed or decodes to any other size. No column may claim more than 'rawSize' bytes, so
+    // a damaged length cannot make it allocate more than a few times that.
+    static bool decode(const char *data, size_t len, string &out, size_t rawSize);
+};
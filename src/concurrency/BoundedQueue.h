@@ -0,0 +1,47 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+using namespace std;
+
+// Blocking FIFO with a fixed capacity, for handing work between pipeline stages.
+// push() waits while full, pop() waits while empty; close() wakes everybody up:
+// further pushes fail and pops drain what is left, then fail.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+    bool push(T item) {
+        unique_lock<mutex> lk(mtx);
+        notFull.wait(lk, [this] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T &out) {
+        unique_lock<mutex> lk(mtx);
+        notEmpty.wait(lk, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        out = move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        lock_guard<mutex> lk(mtx);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex mtx;
+    condition_variable notFull, notEmpty;
+};
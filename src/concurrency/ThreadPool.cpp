@@ -0,0 +1,45 @@
+#include "ThreadPool.h"
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0) threadCount = 1;
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto &w : workers) w.join();
+}
+
+void ThreadPool::post(function<void()> task) {
+    {
+        lock_guard<mutex> lk(mtx);
+        tasks.push_back(move(task));
+    }
+    cv.notify_one();
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lk(mtx);
+            cv.wait(lk, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return; // stopping and drained
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
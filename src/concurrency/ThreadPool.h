@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed set of worker threads draining one FIFO queue.
+// A pool of one thread is a serial executor: tasks run in the order they were posted.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = thread::hardware_concurrency());
+    ~ThreadPool(); // runs everything already queued, then joins
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void post(function<void()> task);
+
+    template <typename F>
+    auto submit(F &&fn) -> future<decltype(fn())> {
+        using R = decltype(fn());
+        auto task = make_shared<packaged_task<R()>>(forward<F>(fn));
+        future<R> result = task->get_future();
+        post([task]() { (*task)(); });
+        return result;
+    }
+
+    size_t size() const;
+
+private:
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex mtx;
+    condition_variable cv;
+    bool stopping = false;
+
+    void workerLoop();
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+using namespace std;
+
+// A vector whose contents are published as immutable, versioned snapshots (read-copy-update).
+// The owner changes it under its own lock and calls publish() when a change is complete;
+// snapshot() hands readers the last published version in O(1), without that lock, and they
+// may keep it as long as they like. Elements live in fixed-size chunks shared between
+// versions: the first change to a chunk after a publish copies that chunk only, and publish()
+// copies the chunk table, never the elements in bulk. A version, and any chunk only it still
+// refers to, is freed when its last snapshot is released. Chunks come from 'Alloc'.
+template <typename T, typename Alloc = allocator<T>>
+class VersionedVector {
+public:
+    static constexpr size_t CHUNK = 256;
+    using Chunk = vector<T, Alloc>;
+
+    class Snapshot {
+    public:
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T &operator[](size_t i) const { return (*chunks[i / CHUNK])[i % CHUNK]; }
+        uint64_t version() const { return ver; } // increases with every publish
+
+    private:
+        friend class VersionedVector;
+        vector<shared_ptr<const Chunk>> chunks;
+        size_t count = 0;
+        uint64_t ver = 0;
+    };
+
+    VersionedVector() : published(make_shared<const Snapshot>()) {}
+    VersionedVector(const VersionedVector&) = delete;
+    VersionedVector& operator=(const VersionedVector&) = delete;
+
+    // Reader side: safe from any thread at any time.
+    shared_ptr<const Snapshot> snapshot() const { return atomic_load(&published); }
+
+    // Writer side: the owner serializes these.
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T &operator[](size_t i) const { return (*chunks[i / CHUNK])[i % CHUNK]; }
+    T &edit(size_t i) { return own(i / CHUNK)[i % CHUNK]; }
+    const T &back() const { return (*this)[count - 1]; }
+
+    void push_back(T value) {
+        if (count % CHUNK == 0) {
+            chunks.push_back(allocate_shared<Chunk>(Alloc()));
+            chunks.back()->reserve(CHUNK);
+            owned.push_back(true);
+        }
+        own(count / CHUNK).push_back(move(value));
+        ++count;
+    }
+
+    void pop_back() {
+        own((count - 1) / CHUNK).pop_back();
+        if (--count % CHUNK == 0) {
+            chunks.pop_back();
+            owned.pop_back();
+        }
+    }
+
+    void clear() {
+        chunks.clear();
+        owned.clear();
+        count = 0;
+    }
+
+    void publish() {
+        auto next = make_shared<Snapshot>();
+        next->chunks.assign(chunks.begin(), chunks.end());
+        next->count = count;
+        next->ver = ++ver;
+        atomic_store(&published, shared_ptr<const Snapshot>(move(next)));
+        owned.assign(chunks.size(), false); // now shared with readers
+    }
+
+private:
+    vector<shared_ptr<Chunk>> chunks;
+    vector<bool> owned; // chunk changed since the last publish, so not visible to readers
+    size_t count = 0;
+    uint64_t ver = 0;
+    shared_ptr<const Snapshot> published;
+
+    Chunk &own(size_t chunk) {
+        if (!owned[chunk]) {
+            auto copy = allocate_shared<Chunk>(Alloc());
+            copy->reserve(CHUNK); // every chunk is a full-size block, so freed ones get reused
+            copy->assign(chunks[chunk]->begin(), chunks[chunk]->end());
+            chunks[chunk] = move(copy);
+            owned[chunk] = true;
+        }
+        return *chunks[chunk];
+    }
+};
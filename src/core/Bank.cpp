@@ -1,75 +1,122 @@
 #include "Bank.h"
 #include "BankAccount.cpp"
 #include "../crypto/CryptoUtils.h"
-#include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <filesystem>
 #include <chrono>
 
 using namespace std;
 
-Bank::Bank(const string &dataFile, const string &logFile, const string &masterPassword){
+Bank::Bank(const string &dataFile, const string &logFile, string_view masterPassword){
 
     dataFilePath=dataFile;
     logFilePath=logFile;
-    tempPlainData="temp_accounts.txt";
-    tempPlainLog="temp_transactions.txt";
     masterPwd=masterPassword;
+    chain=make_unique<JournalChain>(logFilePath, masterPassword);
+    worker=make_unique<ThreadPool>(1);
 
 }
 
+Bank::~Bank() {
+    worker.reset();
+}
+
+// Plaintext of an encrypted file. It is only ever held in memory, in the secure arena.
+static bool decryptToMemory(const string &path, string_view password, SecureString &text) {
+    text.clear();
+    return CryptoUtils::decryptStream(path, password, [&text](const unsigned char *data, size_t len) {
+        text.append(reinterpret_cast<const char*>(data), len);
+        return true;
+    });
+}
+
+// Encrypts 'text' aside and renames it over 'path', so a failed or interrupted write (a full
+// disk included) leaves the previous file as it was.
+static bool replaceEncrypted(const SecureString &text, const string &path, string_view password) {
+    string tmp = path + ".tmp";
+    error_code ec;
+    bool ok = CryptoUtils::encryptBuffer(text.data(), text.size(), tmp, password);
+    if (ok) filesystem::rename(tmp, path, ec);
+    ok = ok && !ec;
+    if (!ok) filesystem::remove(tmp, ec);
+    return ok;
+}
+
+template <typename R, typename F>
+future<R> Bank::runAsync(F op, function<void(R)> done) {
+    return worker->submit([op, done]() {
+        R result = op();
+        if (done) done(result);
+        return result;
+    });
+}
+
 int Bank::nextAccountNumber() {
     int maxNo = 1000;
-    for (auto &acc : accounts) {
-        if (acc.getAccountNumber() >= maxNo) maxNo = acc.getAccountNumber() + 1;
+    for (size_t i = 0; i < accounts.size(); ++i) {
+        if (accounts[i].getAccountNumber() >= maxNo) maxNo = accounts[i].getAccountNumber() + 1;
     }
-    return maxNo;
+    int off = ((maxNo - numberResidue) % numberStride + numberStride) % numberStride;
+    return off ? maxNo + numberStride - off : maxNo;
+}
+
+void Bank::setAccountNumbering(int stride, int residue) {
+    lock_guard<mutex> lk(mtx);
+    numberStride = stride > 0 ? stride : 1;
+    numberResidue = residue;
 }
 
 bool Bank::load() {
     lock_guard<mutex> lk(mtx);
     accounts.clear();
-    // Decrypt dataFilePath to tempPlainData if exists
+    positions.clear();
+    bool ok = true;
+    // Decrypt dataFilePath in memory if it exists
     if (filesystem::exists(dataFilePath)) {
-        if (!CryptoUtils::decryptFile(dataFilePath, tempPlainData, masterPwd)) return false;
-        if (!loadPlainData(tempPlainData)) return false;
-        filesystem::remove(tempPlainData);
+        SecureString text;
+        ok = decryptToMemory(dataFilePath, masterPwd, text) && loadPlainData(text);
     }
-    // Load transactions if needed: we keep log encrypted on disk; for appending, decrypt to temp each time
-    return true;
+    holders.rebuild(accounts);
+    // The journal stays on disk: appends go to its end as sealed records, see writeLog
+    accounts.publish();
+    ChangeEvent reset;
+    reset.kind = ChangeEvent::Reset;
+    feed.publish(reset);
+    return ok;
 }
 
 bool Bank::save() {
-    lock_guard<mutex> lk(mtx);
-    // Serialize accounts to tempPlainData
-    if (!savePlainData(tempPlainData)) return false;
-    // Encrypt to dataFilePath
-    if (!CryptoUtils::encryptFile(tempPlainData, dataFilePath, masterPwd)) return false;
-    filesystem::remove(tempPlainData);
+    return save(*accountsSnapshot());
+}
+
+bool Bank::save(const AccountsView &view) {
+    lock_guard<mutex> saveLk(saveMtx);
+    // Serialize accounts in memory and encrypt them to dataFilePath
+    SecureString text;
+    savePlainData(view, text);
     // For log: we assume log file is appended separately in logTransaction
-    return true;
+    return replaceEncrypted(text, dataFilePath, masterPwd);
 }
 
-bool Bank::loadPlainData(const string &plainPath) {
-    ifstream in(plainPath);
-    if (!in) return false;
-    string line;
-    while (getline(in, line)) {
+bool Bank::loadPlainData(string_view text) {
+    while (!text.empty()) {
+        size_t nl = text.find('\n');
+        string line(text.substr(0, nl));
+        text.remove_prefix(nl == string_view::npos ? text.size() : nl + 1);
         if (line.empty()) continue;
         BankAccount acc = BankAccount::deserialize(line);
         // Optionally load transactions per account from the log file
+        positions[acc.getAccountNumber()] = accounts.size();
         accounts.push_back(acc);
     }
     return true;
 }
 
-bool Bank::savePlainData(const string &plainPath) {
-    ofstream out(plainPath, ios::trunc);
-    if (!out) return false;
-    for (auto &acc : accounts) {
-        out << acc.serialize() << "\n";
+void Bank::savePlainData(const AccountsView &view, SecureString &text) {
+    for (size_t i = 0; i < view.size(); ++i) {
+        text.append(view[i].serialize()).append(1, '\n');
     }
-    return true;
 }
 
 bool Bank::loadPlainLog(const string &plainPath) {
@@ -82,71 +129,417 @@ bool Bank::savePlainLog(const string &plainPath) {
     return true;
 }
 
-BankAccount* Bank::createAccount(const string &holderName, double initDeposit) {
+int Bank::createAccount(const string &holderName, double initDeposit) {
+    lock_guard<mutex> lk(mtx);
+    if (readOnly) return -1;
     int accNo = nextAccountNumber();
     BankAccount acc(accNo, holderName, initDeposit);
+    positions[accNo] = accounts.size();
     accounts.push_back(acc);
+    holders.add(holderName, accNo);
+    accounts.publish();
+    publishChange(ChangeEvent::AccountCreated, accounts.back(), accounts.size() - 1);
+    replicate("C|" + to_string(accNo) + "|" + formatAmount(initDeposit) + "|" + holderName);
     if (initDeposit > 0) {
-        string now_time = getCurrentIsoTimestamp();
-        Transaction tr{ Transaction().timestamp=now_time, "Deposit", initDeposit, -1 };
-        logTransaction(tr);
+        Transaction tr{ getCurrentIsoTimestamp(), "Deposit", initDeposit, accNo };
+        appendLog(tr);
     }
-    return &accounts.back();
+    return accNo;
 }
 
-BankAccount* Bank::findAccount(int accountNumber) {
-    for (auto &acc : accounts) {
-        if (acc.getAccountNumber() == accountNumber) return &acc;
-    }
-    return nullptr;
+bool Bank::findAccount(int accountNumber, BankAccount &out) {
+    lock_guard<mutex> lk(mtx);
+    auto it = positions.find(accountNumber);
+    if (it == positions.end()) return false;
+    out = accounts[it->second];
+    return true;
 }
 
-bool Bank::deleteAccount(int accountNumber) {
-    for (auto it = accounts.begin(); it != accounts.end(); ++it) {
-        if (it->getAccountNumber() == accountNumber) {
-            accounts.erase(it);
-            return true;
+bool Bank::searchHolders(const HolderQuery &query, HolderPage &page) {
+    lock_guard<mutex> lk(mtx);
+    page = HolderPage();
+    page.view = accounts.snapshot(); // published under mtx, so the table as it is now
+    SecureString key = HolderIndex::normalize(query.text);
+    bool whole = query.mode != HolderQuery::Prefix;
+    bool first = query.after.first.empty() && query.after.second == 0;
+    holders.scan(key, first ? nullptr : &query.after, [&](const HolderIndex::Key &k) {
+        if (whole && k.first.size() != key.size()) return false; // past the keys equal to 'key'
+        auto it = positions.find(k.second);
+        if (it == positions.end()) return true;
+        const BankAccount &acc = accounts[it->second];
+        SecureString name = HolderIndex::normalize(acc.getHolderName());
+        if (whole) {
+            if (name.size() != k.first.size()) return true; // a later word, not the whole name
+            if (query.mode == HolderQuery::Exact && string_view(acc.getHolderName()) != query.text) return true;
+        } else if (HolderIndex::firstWordWith(name, key) != name.size() - k.first.size()) {
+            return true; // listed under the first word that matches
         }
+        if (page.positions.size() >= query.limit) {
+            page.more = true;
+            return false;
+        }
+        page.positions.push_back(it->second);
+        page.next = k;
+        return true;
+    });
+    return true;
+}
+
+BankAccount *Bank::editAccount(int accountNumber) {
+    auto it = positions.find(accountNumber);
+    return it == positions.end() ? nullptr : &accounts.edit(it->second);
+}
+
+bool Bank::deleteAccount(int accountNumber) {
+    lock_guard<mutex> lk(mtx);
+    if (readOnly) return false;
+    auto it = positions.find(accountNumber);
+    if (it == positions.end()) return false;
+    size_t pos = it->second;
+    BankAccount removed = accounts[pos];
+    positions.erase(it);
+    holders.remove(removed.getHolderName(), removed.getAccountNumber());
+    // Swap with the last account so positions of everything else stay put.
+    if (pos != accounts.size() - 1) {
+        accounts.edit(pos) = accounts.back();
+        positions[accounts[pos].getAccountNumber()] = pos;
     }
-    return false;
+    accounts.pop_back();
+    accounts.publish();
+    publishChange(ChangeEvent::AccountDeleted, removed, pos);
+    replicate("D|" + to_string(accountNumber));
+    // Journaled with what was left, so replaying the journal accounts for every cent.
+    Transaction tr{ getCurrentIsoTimestamp(), "Close", removed.getBalance(), accountNumber };
+    return appendLog(tr);
 }
 
 bool Bank::deposit(int accountNumber, double amount) {
     lock_guard<mutex> lk(mtx);
-    BankAccount* acc = findAccount(accountNumber);
+    if (readOnly) return false;
+    BankAccount* acc = editAccount(accountNumber);
     if (!acc) return false;
     if (!acc->deposit(amount)) return false;
-    Transaction tr{ Transaction().timestamp, "Deposit", amount, accountNumber };
-    return logTransaction(tr);
+    accounts.publish();
+    publishChange(ChangeEvent::BalanceChanged, *acc, positions[accountNumber]);
+    replicate("B|" + to_string(accountNumber) + "|" + formatAmount(acc->getBalance()));
+    Transaction tr{ getCurrentIsoTimestamp(), "Deposit", amount, accountNumber };
+    return appendLog(tr);
 }
 
 bool Bank::withdraw(int accountNumber, double amount) {
     lock_guard<mutex> lk(mtx);
-    BankAccount* acc = findAccount(accountNumber);
+    if (readOnly) return false;
+    BankAccount* acc = editAccount(accountNumber);
     if (!acc) return false;
     if (!acc->withdraw(amount)) return false;
-    Transaction tr{ Transaction().timestamp, "Withdraw", amount, accountNumber };
-    return logTransaction(tr);
+    accounts.publish();
+    publishChange(ChangeEvent::BalanceChanged, *acc, positions[accountNumber]);
+    replicate("B|" + to_string(accountNumber) + "|" + formatAmount(acc->getBalance()));
+    Transaction tr{ getCurrentIsoTimestamp(), "Withdraw", amount, accountNumber };
+    return appendLog(tr);
 }
 
 bool Bank::logTransaction(const Transaction &tr) {
-    // Decrypt existing log to temp, append, then encrypt back
     lock_guard<mutex> lk(mtx);
-    if (filesystem::exists(logFilePath)) {
-        if (!CryptoUtils::decryptFile(logFilePath, tempPlainLog, masterPwd)) return false;
+    if (readOnly) return false;
+    return appendLog(tr);
+}
+
+bool Bank::appendLog(const Transaction &tr) {
+    if (!writeLog(tr)) return false;
+    replicate("J|" + tr.serialize());
+    return true;
+}
+
+bool Bank::writeJournal(const string &path, string_view text, string_view password) {
+    vector<string_view> lines;
+    for (size_t at = 0; at < text.size();) {
+        size_t nl = text.find('\n', at);
+        size_t end = nl == string_view::npos ? text.size() : nl + 1;
+        lines.push_back(text.substr(at, end - at));
+        at = end;
+    }
+    string tmp = path + ".new"; // SealedLog itself writes aside to path + ".tmp"
+    error_code ec;
+    filesystem::remove(tmp, ec);
+    bool ok;
+    {
+        CryptoUtils::SealedLog log;
+        ok = log.open(tmp, password, nullptr) && (lines.empty() || log.append(lines));
+    }
+    if (ok) filesystem::rename(tmp, path, ec);
+    ok = ok && !ec;
+    if (!ok) filesystem::remove(tmp, ec);
+    return ok;
+}
+
+// A journal from before sealed logs (a container, or CBC) is converted on first use; its lines
+// become records, so the plaintext, and every offset the chain and the archives hold, stay put.
+bool Bank::openJournal() {
+    if (journal.opened()) return true;
+    if (filesystem::exists(logFilePath) && !CryptoUtils::isSealedLog(logFilePath)) {
+        SecureString text;
+        if (!decryptToMemory(logFilePath, masterPwd, text) || !writeJournal(logFilePath, text, masterPwd))
+            return false;
+    }
+    return journal.open(logFilePath, masterPwd, nullptr);
+}
+
+bool Bank::writeLog(const Transaction &tr) {
+    lock_guard<mutex> logLk(logMtx);
+    if (!chain->open()) return false; // never write past a chain that cannot be extended
+    if (!openJournal()) return false;
+    string line = tr.serialize();
+    if (!journal.append(line + "\n")) return false;
+    return chain->append(line);
+}
+
+bool Bank::snapshotLog(const string &copyPath) {
+    lock_guard<mutex> lk(mtx);
+    lock_guard<mutex> logLk(logMtx);
+    if (!filesystem::exists(logFilePath)) return false;
+    error_code ec;
+    filesystem::copy_file(logFilePath, copyPath, filesystem::copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool Bank::trimLog(uint64_t plainBytes) {
+    lock_guard<mutex> lk(mtx);
+    lock_guard<mutex> logLk(logMtx);
+    if (!filesystem::exists(logFilePath)) return plainBytes == 0;
+    if (!chain->open()) return false;
+    SecureString text;
+    if (!decryptToMemory(logFilePath, masterPwd, text)) return false;
+    if (text.size() < plainBytes) return false; // not the log that was archived: keep everything
+    string_view plain(text);
+    journal.close(); // reopened over the new file by the next append
+    if (!writeJournal(logFilePath, plain.substr(plainBytes), masterPwd)) return false;
+    // The chain re-anchors at the first kept record, hashed from the plaintext before the cut.
+    return chain->trim(plain.substr(0, plainBytes));
+}
+
+bool Bank::verifyJournal(bool incremental, JournalVerifyReport &report, size_t threads) {
+    string copy = logFilePath + ".verify";
+    {
+        lock_guard<mutex> logLk(logMtx);
+        if (!chain->open() && !chain->loadedOnly()) return false; // a gap is verify's to report
+        if (incremental) return chain->verify(logFilePath, true, report, threads);
+        if (!chain->snapshot(copy)) return false;
+    }
+    bool ok = chain->verify(copy, false, report, threads);
+    error_code ec;
+    for (const char *suffix : {"", ".chain", ".chainhead"})
+        filesystem::remove(copy + suffix, ec);
+    return ok;
+}
+
+bool Bank::loadJournalTail(size_t maxEntries, vector<Transaction> &out) {
+    lock_guard<mutex> logLk(logMtx);
+    out.clear();
+    if (!filesystem::exists(logFilePath)) return true;
+    string text;
+    if (CryptoUtils::isChunkedFile(logFilePath)) {
+        // Read back from the end in growing windows until enough whole lines are in.
+        CryptoUtils::ChunkedReader reader;
+        if (!reader.open(logFilePath, masterPwd)) return false;
+        uint64_t size = reader.size();
+        for (uint64_t window = 64 << 10;; window *= 4) {
+            uint64_t from = size > window ? size - window : 0;
+            if (!reader.read(from, size_t(size - from), text)) return false;
+            if (from == 0) break;
+            size_t nl = text.find('\n'); // the first line is cut by the window
+            text.erase(0, nl == string::npos ? text.size() : nl + 1);
+            if (size_t(count(text.begin(), text.end(), '\n')) >= maxEntries) break;
+        }
     } else {
-        // create empty
-        ofstream tmp(tempPlainLog);
-    }
-    ofstream out(tempPlainLog, ios::app);
-    if (!out) return false;
-    out << tr.serialize() << "\n";
-    out.close();
-    if (!CryptoUtils::encryptFile(tempPlainLog, logFilePath, masterPwd)) return false;
-    filesystem::remove(tempPlainLog);
+        // Legacy CBC log: no way in but from the start.
+        bool ok = CryptoUtils::decryptStream(logFilePath, masterPwd, [&text](const unsigned char *data, size_t len) {
+            text.append(reinterpret_cast<const char*>(data), len);
+            return true;
+        });
+        if (!ok) return false;
+    }
+    vector<string> lines;
+    istringstream in(text);
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty()) lines.push_back(move(line));
+    }
+    for (size_t i = lines.size() > maxEntries ? lines.size() - maxEntries : 0; i < lines.size(); ++i)
+        out.push_back(Transaction::deserialize(lines[i]));
     return true;
 }
 
-const vector<BankAccount>& Bank::getAllAccounts() const {
-    return accounts;
+shared_ptr<const Bank::AccountsView> Bank::accountsSnapshot() const {
+    return accounts.snapshot();
+}
+
+void Bank::publishChange(ChangeEvent::Kind kind, const BankAccount &acc, size_t position) {
+    ChangeEvent ev;
+    ev.kind = kind;
+    ev.accountNumber = acc.getAccountNumber();
+    ev.balance = acc.getBalance();
+    if (kind == ChangeEvent::AccountCreated) {
+        const SecureString &name = acc.getHolderName();
+        ev.holderName.assign(name.data(), name.size());
+    }
+    ev.position = position;
+    feed.publish(move(ev));
+}
+
+void Bank::replicate(const string &record) {
+    if (replicationSink) replicationSink(record);
+}
+
+void Bank::setReplicationSink(ReplicationSink sink) {
+    lock_guard<mutex> lk(mtx);
+    replicationSink = move(sink);
+}
+
+bool Bank::captureState(const string &journalCopy, const function<void(shared_ptr<const AccountsView>)> &capture) {
+    lock_guard<mutex> lk(mtx);
+    {
+        lock_guard<mutex> logLk(logMtx);
+        error_code ec;
+        if (filesystem::exists(logFilePath))
+            filesystem::copy_file(logFilePath, journalCopy, filesystem::copy_options::overwrite_existing, ec);
+        else
+            filesystem::remove(journalCopy, ec); // no journal yet: the image has none either
+        if (ec) return false;
+    }
+    capture(accounts.snapshot());
+    return true;
+}
+
+void Bank::setReadOnly(bool ro) {
+    lock_guard<mutex> lk(mtx);
+    readOnly = ro;
+}
+
+// Replicated records carry the primary's resulting state rather than the operation, so
+// applying one twice (a standby replaying after a crash) leaves the same accounts.
+bool Bank::applyReplicated(const string &record) {
+    lock_guard<mutex> lk(mtx);
+    if (record.size() < 2 || record[1] != '|') return false;
+    string body = record.substr(2);
+    if (record[0] == 'J') return writeLog(Transaction::deserialize(body));
+
+    istringstream iss(body);
+    string acc_s, bal_s;
+    if (!getline(iss, acc_s, '|')) return false;
+    int accNo = 0;
+    double balance = 0.0;
+    try {
+        accNo = stoi(acc_s);
+        if (record[0] != 'D') {
+            if (!getline(iss, bal_s, '|')) return false;
+            balance = stod(bal_s);
+        }
+    } catch (const exception&) {
+        return false;
+    }
+    auto it = positions.find(accNo);
+    switch (record[0]) {
+    case 'C': {
+        string holder;
+        getline(iss, holder); // the rest of the record, '|' included
+        if (it != positions.end()) { // replayed
+            holders.remove(accounts[it->second].getHolderName(), accNo);
+            holders.add(holder, accNo);
+            accounts.edit(it->second) = BankAccount(accNo, holder, balance);
+            accounts.publish();
+            publishChange(ChangeEvent::BalanceChanged, accounts[it->second], it->second);
+            return true;
+        }
+        positions[accNo] = accounts.size();
+        accounts.push_back(BankAccount(accNo, holder, balance));
+        holders.add(holder, accNo);
+        accounts.publish();
+        publishChange(ChangeEvent::AccountCreated, accounts.back(), accounts.size() - 1);
+        return true;
+    }
+    case 'D': {
+        if (it == positions.end()) return true; // replayed
+        size_t pos = it->second;
+        BankAccount removed = accounts[pos];
+        positions.erase(it);
+        holders.remove(removed.getHolderName(), removed.getAccountNumber());
+        if (pos != accounts.size() - 1) {
+            accounts.edit(pos) = accounts.back();
+            positions[accounts[pos].getAccountNumber()] = pos;
+        }
+        accounts.pop_back();
+        accounts.publish();
+        publishChange(ChangeEvent::AccountDeleted, removed, pos);
+        return true;
+    }
+    case 'B': {
+        if (it == positions.end()) return false;
+        BankAccount &acc = accounts.edit(it->second);
+        acc.setBalance(balance);
+        accounts.publish();
+        publishChange(ChangeEvent::BalanceChanged, acc, it->second);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool Bank::restoreState(const vector<BankAccount> &state, const string &journal) {
+    lock_guard<mutex> lk(mtx);
+    {
+        lock_guard<mutex> logLk(logMtx);
+        this->journal.close();
+        error_code ec;
+        if (filesystem::exists(journal)) {
+            string tmp = logFilePath + ".tmp";
+            filesystem::copy_file(journal, tmp, filesystem::copy_options::overwrite_existing, ec);
+            if (!ec) filesystem::rename(tmp, logFilePath, ec);
+        } else {
+            filesystem::remove(logFilePath, ec);
+        }
+        if (ec) return false;
+        chain->reset(); // a new chain is started over the restored journal on its next use
+    }
+    accounts.clear();
+    positions.clear();
+    for (const BankAccount &acc : state) {
+        positions[acc.getAccountNumber()] = accounts.size();
+        accounts.push_back(acc);
+    }
+    holders.rebuild(accounts);
+    accounts.publish();
+    ChangeEvent reset;
+    reset.kind = ChangeEvent::Reset;
+    feed.publish(reset);
+    return true;
+}
+
+shared_ptr<ChangeSubscription> Bank::subscribe(size_t capacity, function<void()> notify) {
+    return feed.subscribe(capacity, move(notify));
+}
+
+void Bank::unsubscribe(const shared_ptr<ChangeSubscription> &sub) {
+    feed.unsubscribe(sub);
+}
+
+future<bool> Bank::loadAsync(function<void(bool)> done) {
+    return runAsync<bool>([this] { return load(); }, done);
+}
+
+future<bool> Bank::saveAsync(function<void(bool)> done) {
+    return runAsync<bool>([this] { return save(); }, done);
+}
+
+future<int> Bank::createAccountAsync(const string &holderName, double initDeposit, function<void(int)> done) {
+    return runAsync<int>([this, holderName, initDeposit] { return createAccount(holderName, initDeposit); }, done);
+}
+
+future<bool> Bank::depositAsync(int accountNumber, double amount, function<void(bool)> done) {
+    return runAsync<bool>([this, accountNumber, amount] { return deposit(accountNumber, amount); }, done);
+}
+
+future<bool> Bank::withdrawAsync(int accountNumber, double amount, function<void(bool)> done) {
+    return runAsync<bool>([this, accountNumber, amount] { return withdraw(accountNumber, amount); }, done);
 }
@@ -3,18 +3,46 @@
 #include <string>
 #include "BankAccount.h"
 #include "Transaction.h"
+#include "ChangeFeed.h"
+#include "HolderIndex.h"
+#include "JournalChain.h"
+#include "../concurrency/ThreadPool.h"
+#include "../crypto/CryptoUtils.h"
+#include "../concurrency/VersionedVector.h"
+#include "../crypto/SecureArena.h"
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
 using namespace std;
 
+struct HolderQuery {
+    enum Mode {
+        Exact,           // the holder name exactly as stored
+        CaseInsensitive, // the whole name, ignoring ASCII case and spacing
+        Prefix           // the start of any word of the name, ignoring case and spacing
+    };
+    Mode mode = CaseInsensitive;
+    string text;
+    size_t limit = 100;
+    HolderIndex::Key after; // the previous page's 'next'; left empty for the first page
+};
+
 class Bank {
 public:
-    Bank(const string &dataFile, const string &logFile, const string &masterPassword);
+    Bank(const string &dataFile, const string &logFile, string_view masterPassword);
+    ~Bank(); // finishes queued async work before the data goes away
 
     bool load();   // decrypt & load accounts and transactions
-    bool save();   // serialize & encrypt accounts and transactions
+    bool save();   // serialize & encrypt accounts (the current snapshot; changes carry on meanwhile)
 
-    BankAccount* createAccount(const string &holderName, double initDeposit);
-    BankAccount* findAccount(int accountNumber);
+    int createAccount(const string &holderName, double initDeposit); // account number, -1 on failure
+    // New account numbers are kept to 'residue' mod 'stride' (ShardedBank gives each partition
+    // its own class of numbers this way).
+    void setAccountNumbering(int stride, int residue);
+    bool findAccount(int accountNumber, BankAccount &out);
     bool deleteAccount(int accountNumber);
 
     bool deposit(int accountNumber, double amount);
@@ -22,22 +50,113 @@ public:
 
     // Log transaction: append to log file (encrypted on disk)
     bool logTransaction(const Transaction &tr);
+    // The journal is a CryptoUtils::SealedLog with one record per line, newline included, so
+    // an append writes one record and its plaintext reads back as the lines in order. Writes
+    // 'text' (whole lines) as a new journal at 'path', aside and renamed over it.
+    static bool writeJournal(const string &path, string_view text, string_view password);
+    // The last 'maxEntries' logged transactions, oldest first. Only the end of the log is
+    // decrypted, so this stays cheap as the log grows; it can run alongside load().
+    bool loadJournalTail(size_t maxEntries, vector<Transaction> &out);
+
+    // Immutable view of all accounts as of the last completed change, in table order (the
+    // positions ChangeFeed events refer to). O(1), takes no lock and never waits for writers;
+    // holding it keeps that version alive while the bank moves on.
+    using AccountsView = VersionedVector<BankAccount, SecureAllocator<BankAccount>>::Snapshot;
+    shared_ptr<const AccountsView> accountsSnapshot() const;
+    // Saves 'view', a snapshot of this bank, as its accounts file.
+    bool save(const AccountsView &view);
+
+    // Accounts by holder name through the name index (see HolderIndex), one page of at most
+    // 'query.limit' at a time, each account once. Costs O(log n) plus the page, not a scan.
+    struct HolderPage {
+        shared_ptr<const AccountsView> view; // the table the positions refer to
+        vector<size_t> positions;            // matches, in (normalized name, account number) order
+        HolderIndex::Key next;               // pass as 'after' for the next page
+        bool more = false;
+    };
+    bool searchHolders(const HolderQuery &query, HolderPage &page);
+
+    // Log archiving support. snapshotLog copies the encrypted log as it is right now, so it
+    // can be read while the bank keeps appending. trimLog then drops the first 'plainBytes'
+    // bytes of plaintext (the part that was archived) and atomically replaces the log,
+    // keeping anything appended since the snapshot.
+    bool snapshotLog(const string &copyPath);
+    bool trimLog(uint64_t plainBytes);
+
+    // Checks the journal against its hash chain (see JournalChain). Incremental runs only
+    // look at records added since the last checkpoint an earlier run got to, under the log
+    // lock; a full run checks everything on a copy, so appends carry on meanwhile. Returns
+    // false if the check could not be made; 'report' says whether the journal is intact.
+    bool verifyJournal(bool incremental, JournalVerifyReport &report, size_t threads = 0);
 
-    const vector<BankAccount>& getAllAccounts() const;
+    // Async variants: queued on the bank's own worker thread and run in submission order,
+    // so a deposit followed by saveAsync() is persisted in that order.
+    // 'done' (optional) is called on the worker thread with the same result as the future.
+    future<bool> loadAsync(function<void(bool)> done = nullptr);
+    future<bool> saveAsync(function<void(bool)> done = nullptr);
+    future<int> createAccountAsync(const string &holderName, double initDeposit,
+                                   function<void(int)> done = nullptr); // account number, -1 on failure
+    future<bool> depositAsync(int accountNumber, double amount, function<void(bool)> done = nullptr);
+    future<bool> withdrawAsync(int accountNumber, double amount, function<void(bool)> done = nullptr);
+
+    // Row-level change notifications (create/delete/balance, plus Reset after load).
+    // 'notify' runs on the mutating thread whenever the subscription goes from empty to pending.
+    shared_ptr<ChangeSubscription> subscribe(size_t capacity = 4096, function<void()> notify = nullptr);
+    void unsubscribe(const shared_ptr<ChangeSubscription> &sub);
+
+    // Replication (see src/replication). While a sink is set, every account change and every
+    // journal entry is handed to it under the bank's lock, in the order they happened, as a
+    // self-contained record that applyReplicated() turns back into the same change.
+    using ReplicationSink = function<void(const string &record)>;
+    void setReplicationSink(ReplicationSink sink);
+    // Copies the journal to 'journalCopy' and passes the accounts to 'capture', both under the
+    // bank's lock: the state reached by exactly the records the sink has been given so far.
+    bool captureState(const string &journalCopy, const function<void(shared_ptr<const AccountsView>)> &capture);
+
+    // Standby side. A read-only bank refuses local changes and only takes replicated ones.
+    void setReadOnly(bool readOnly);
+    bool isReadOnly() const { return readOnly; }
+    bool applyReplicated(const string &record);
+    // Replaces the accounts (in table order) and the journal (with a copy of 'journal', none
+    // if it does not exist), as captured on the primary; subscribers get a Reset.
+    bool restoreState(const vector<BankAccount> &state, const string &journal);
 
 private:
-    vector<BankAccount> accounts;
+    // Published after every change, before its ChangeFeed event. Records live in the secure
+    // arena, so names left in freed chunks are wiped.
+    VersionedVector<BankAccount, SecureAllocator<BankAccount>> accounts;
+    unordered_map<int, size_t> positions; // account number -> index in accounts
+    HolderIndex holders; // under mtx, like positions
+    ChangeFeed feed; // published under mtx, so each subscription sees a single producer
     string dataFilePath; // encrypted file path
     string logFilePath;  // encrypted transaction log
-    string tempPlainData; // temp plaintext filename
-    string tempPlainLog;  // temp plaintext log filename
-    string masterPwd;
+    SecureString masterPwd;
+
+    ReplicationSink replicationSink; // called under mtx
+    atomic<bool> readOnly{false};
+
+    int numberStride = 1; // see setAccountNumbering
+    int numberResidue = 0;
 
     mutex mtx;
+    mutex saveMtx; // one save at a time writes the accounts file
+    mutex logMtx; // guards the log file itself; taken after mtx when both are needed
+    unique_ptr<JournalChain> chain; // under logMtx
+    CryptoUtils::SealedLog journal; // under logMtx, opened by the first append
+    unique_ptr<ThreadPool> worker; // single thread: serial executor for the *Async calls
+
+    template <typename R, typename F>
+    future<R> runAsync(F op, function<void(R)> done);
 
     int nextAccountNumber();
-    bool loadPlainData(const string &plainPath);
-    bool savePlainData(const string &plainPath);
+    BankAccount *editAccount(int accountNumber); // caller holds mtx
+    bool appendLog(const Transaction &tr); // caller holds mtx
+    void publishChange(ChangeEvent::Kind kind, const BankAccount &acc, size_t position); // caller holds mtx
+    void replicate(const string &record); // caller holds mtx
+    bool writeLog(const Transaction &tr); // appendLog without replication
+    bool openJournal(); // caller holds logMtx
+    bool loadPlainData(string_view text);
+    void savePlainData(const AccountsView &view, SecureString &text);
     bool loadPlainLog(const string &plainPath);
     bool savePlainLog(const string &plainPath);
 };
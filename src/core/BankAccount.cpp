@@ -12,8 +12,11 @@ string getCurrentIsoTimestamp() {
     auto now = system_clock::now();
     std::time_t t = system_clock::to_time_t(now);
     std::tm tm{};
+    // UTC, as the trailing 'Z' says; archive queries compare these as strings.
 #if defined(_WIN32) || defined(_WIN64)
-    localtime_s(&tm, &t);
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
 #endif
     std::ostringstream oss;
     oss << put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
@@ -21,52 +24,31 @@ string getCurrentIsoTimestamp() {
 }
 
 
-BankAccount::BankAccount(int accNo, const string &holder, double initBalance){
+BankAccount::BankAccount(int accNo, string_view holder, double initBalance){
         accountNumber=accNo;
         holderName=holder;
         balance=initBalance;
-    // Record initial deposit if >0
-    if (initBalance > 0.0) {
-        string now_time = getCurrentIsoTimestamp();
-        transactions.emplace_back(
-            Transaction{
-                Transaction().timestamp = now_time, "Deposit", initBalance, -1
-        });
-    }
 }
 
 int BankAccount::getAccountNumber() const { return accountNumber; }
-const string& BankAccount::getHolderName() const { return holderName; }
+const SecureString& BankAccount::getHolderName() const { return holderName; }
 double BankAccount::getBalance() const { return balance; }
-const vector<Transaction>& BankAccount::getTransactions() const { return transactions; }
 
 bool BankAccount::deposit(double amount) {
     if (amount <= 0) return false;
-    string now_time = getCurrentIsoTimestamp();
     balance += amount;
-    transactions.emplace_back(Transaction{Transaction().timestamp=now_time, "Deposit", amount, -1 });
     return true;
 }
 
 bool BankAccount::withdraw(double amount) {
     if (amount <= 0 || amount > balance) return false;
-    string now_time = getCurrentIsoTimestamp();
     balance -= amount;
-    transactions.emplace_back(Transaction{Transaction().timestamp=now_time, "Withdraw", amount, -1 });
     return true;
 }
 
-void BankAccount::addTransaction(const Transaction &tr) {
-    transactions.push_back(tr);
-    // Update balance if relevant
-    if (tr.type == "Deposit") balance += tr.amount;
-    else if (tr.type == "Withdraw") balance -= tr.amount;
-    // Transfers handled in Bank
-}
-
 string BankAccount::serialize() const {
     ostringstream oss;
-    oss << accountNumber << "|" << holderName << "|" << balance;
+    oss << accountNumber << "|" << holderName << "|" << formatAmount(balance);
     return oss.str();
 }
 
@@ -80,6 +62,5 @@ BankAccount BankAccount::deserialize(const string &line) {
     acc.accountNumber = stoi(acc_s);
     acc.holderName = holder;
     acc.balance = stod(bal_s);
-    // transactions loaded separately
     return acc;
 }
@@ -1,29 +1,33 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include "Transaction.h"
+#include "../crypto/SecureArena.h"
 using namespace std;
 
+string getCurrentIsoTimestamp(); // UTC, "YYYY-MM-DDTHH:MM:SSZ"
+
 class BankAccount {
 public:
     BankAccount() = default;
-    BankAccount(int accNo, const string &holder, double initBalance = 0.0);
+    BankAccount(int accNo, string_view holder, double initBalance = 0.0);
 
     int getAccountNumber() const;
-    const string& getHolderName() const;
+    const SecureString& getHolderName() const;
     double getBalance() const;
-    const vector<Transaction>& getTransactions() const;
 
+    // The history of an account is its journal's; the account itself only holds the balance,
+    // so the copy every change makes of it stays the same size however long the bank runs.
     bool deposit(double amount);
     bool withdraw(double amount);
-    void addTransaction(const Transaction &tr);
+    void setBalance(double value) { balance = value; } // replication: the primary's balance
 
     string serialize() const;
     static BankAccount deserialize(const string &line);
 
 private:
     int accountNumber=0;
-    string holderName;
+    SecureString holderName; // wiped when freed
     double balance=0.0;
-    vector<Transaction> transactions;
 };
@@ -0,0 +1,78 @@
+#include "ChangeFeed.h"
+#include <algorithm>
+using namespace std;
+
+static size_t roundUpPow2(size_t n) {
+    size_t p = 2;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+ChangeSubscription::ChangeSubscription(size_t capacity, function<void()> notify)
+    : ring(roundUpPow2(capacity)), mask(ring.size() - 1), notify(move(notify)) {}
+
+void ChangeSubscription::push(const ChangeEvent &ev) {
+    size_t t = tail.load(memory_order_relaxed);
+    if (t - head.load(memory_order_acquire) == ring.size()) {
+        lost.store(true, memory_order_release);
+    } else {
+        ring[t & mask] = ev;
+        tail.store(t + 1, memory_order_release);
+    }
+    if (notify && !signalled.exchange(true, memory_order_acq_rel)) notify();
+}
+
+bool ChangeSubscription::poll(ChangeEvent &out) {
+    size_t h = head.load(memory_order_relaxed);
+    if (h == tail.load(memory_order_acquire)) return false;
+    out = move(ring[h & mask]);
+    head.store(h + 1, memory_order_release);
+    return true;
+}
+
+size_t ChangeSubscription::drain(const function<void(const ChangeEvent&)> &apply) {
+    // Clear first: anything pushed after this point raises a fresh notification.
+    signalled.store(false, memory_order_release);
+    size_t n = 0;
+    ChangeEvent ev;
+    while (poll(ev)) {
+        apply(ev);
+        ++n;
+    }
+    return n;
+}
+
+bool ChangeSubscription::resyncNeeded() {
+    return lost.exchange(false, memory_order_acq_rel);
+}
+
+ChangeFeed::ChangeFeed() : subscribers(make_shared<SubscriberList>()) {}
+
+shared_ptr<ChangeSubscription> ChangeFeed::subscribe(size_t capacity, function<void()> notify) {
+    auto sub = make_shared<ChangeSubscription>(capacity, move(notify));
+    lock_guard<mutex> lk(subscribeMtx);
+    auto current = atomic_load(&subscribers);
+    auto next = make_shared<SubscriberList>(*current);
+    next->push_back(sub);
+    atomic_store(&subscribers, shared_ptr<const SubscriberList>(next));
+    return sub;
+}
+
+void ChangeFeed::unsubscribe(const shared_ptr<ChangeSubscription> &sub) {
+    lock_guard<mutex> lk(subscribeMtx);
+    auto current = atomic_load(&subscribers);
+    auto next = make_shared<SubscriberList>(*current);
+    next->erase(remove(next->begin(), next->end(), sub), next->end());
+    atomic_store(&subscribers, shared_ptr<const SubscriberList>(next));
+}
+
+uint64_t ChangeFeed::publish(ChangeEvent ev) {
+    ev.sequence = sequence.fetch_add(1, memory_order_relaxed) + 1;
+    auto subs = atomic_load(&subscribers);
+    for (auto &s : *subs) s->push(ev);
+    return ev.sequence;
+}
+
+uint64_t ChangeFeed::lastSequence() const {
+    return sequence.load(memory_order_relaxed);
+}
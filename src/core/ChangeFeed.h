@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct ChangeEvent {
+    enum Kind : uint8_t {
+        AccountCreated,
+        AccountDeleted,
+        BalanceChanged,
+        Reset, // whole account table replaced (load); consumers resync from scratch
+    };
+    uint64_t sequence = 0;
+    Kind kind = BalanceChanged;
+    int accountNumber = 0;
+    double balance = 0.0;
+    string holderName; // AccountCreated only
+    // Slot in Bank's account table at the time of the change. Deletes are swap-with-last,
+    // so an AccountDeleted at 'position' also means the last account moved into it.
+    size_t position = 0;
+};
+
+// Single-producer/single-consumer ring buffer of change events for one subscriber.
+// The producer is the Bank (always publishing under its own lock); the consumer is whoever
+// subscribed. Neither side takes a lock to move events.
+class ChangeSubscription {
+public:
+    explicit ChangeSubscription(size_t capacity, function<void()> notify = nullptr);
+
+    bool poll(ChangeEvent &out);
+    // Drains everything queued so far; returns the number of events applied.
+    size_t drain(const function<void(const ChangeEvent&)> &apply);
+    // True once after the queue overflowed and events were dropped: the consumer's view
+    // is stale and must be rebuilt from the source instead of patched.
+    bool resyncNeeded();
+
+private:
+    friend class ChangeFeed;
+    void push(const ChangeEvent &ev);
+
+    vector<ChangeEvent> ring;
+    size_t mask;
+    atomic<size_t> head{0}; // next slot to read (consumer-owned)
+    atomic<size_t> tail{0}; // next slot to write (producer-owned)
+    atomic<bool> lost{false};
+    atomic<bool> signalled{false};
+    function<void()> notify; // called by the producer when the queue goes from idle to pending
+};
+
+class ChangeFeed {
+public:
+    ChangeFeed();
+
+    shared_ptr<ChangeSubscription> subscribe(size_t capacity = 4096, function<void()> notify = nullptr);
+    void unsubscribe(const shared_ptr<ChangeSubscription> &sub);
+
+    // Stamps the next sequence number and fans out. Callers must not publish concurrently.
+    uint64_t publish(ChangeEvent ev);
+    uint64_t lastSequence() const;
+
+private:
+    using SubscriberList = vector<shared_ptr<ChangeSubscription>>;
+    // Copy-on-write so publish() reads the list without locking; (un)subscribe is rare.
+    shared_ptr<const SubscriberList> subscribers;
+    mutex subscribeMtx; // serializes list updates only
+    atomic<uint64_t> sequence{0};
+};
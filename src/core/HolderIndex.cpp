@@ -0,0 +1,75 @@
+#include "HolderIndex.h"
+#include <climits>
+#include <queue>
+using namespace std;
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+SecureString HolderIndex::normalize(string_view name) {
+    SecureString out;
+    out.reserve(name.size());
+    bool gap = false;
+    for (char c : name) {
+        if (isSpace(c)) {
+            gap = !out.empty();
+            continue;
+        }
+        if (gap) out.push_back(' ');
+        gap = false;
+        out.push_back(c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c);
+    }
+    return out;
+}
+
+size_t HolderIndex::firstWordWith(const SecureString &normalized, const SecureString &prefix) {
+    for (size_t at = 0; at < normalized.size(); ++at) {
+        if (at > 0 && normalized[at - 1] != ' ') continue;
+        if (normalized.compare(at, prefix.size(), prefix) == 0) return at;
+    }
+    return prefix.empty() ? 0 : SecureString::npos;
+}
+
+void HolderIndex::keysOf(string_view holder, int accountNumber, Run &out) {
+    SecureString name = normalize(holder);
+    out.emplace_back(name, accountNumber);
+    for (size_t i = 0; i < name.size(); ++i)
+        if (name[i] == ' ') out.emplace_back(name.substr(i + 1), accountNumber);
+}
+
+void HolderIndex::add(string_view holder, int accountNumber) {
+    Run run;
+    keysOf(holder, accountNumber, run);
+    for (Key &key : run) keys.insert(move(key));
+}
+
+void HolderIndex::remove(string_view holder, int accountNumber) {
+    Run run;
+    keysOf(holder, accountNumber, run);
+    for (const Key &key : run) keys.erase(key);
+}
+
+void HolderIndex::fill(vector<Run> &runs) {
+    keys.clear();
+    // k-way merge of the sorted runs, appended in order so each insert is amortized O(1).
+    using Head = pair<size_t, size_t>; // (run, index in run)
+    auto later = [&runs](const Head &a, const Head &b) { return runs[b.first][b.second] < runs[a.first][a.second]; };
+    priority_queue<Head, vector<Head>, decltype(later)> heads(later);
+    for (size_t r = 0; r < runs.size(); ++r)
+        if (!runs[r].empty()) heads.push({r, 0});
+    while (!heads.empty()) {
+        Head h = heads.top();
+        heads.pop();
+        keys.emplace_hint(keys.end(), move(runs[h.first][h.second]));
+        if (++h.second < runs[h.first].size()) heads.push(h);
+        else Run().swap(runs[h.first]);
+    }
+}
+
+void HolderIndex::scan(const SecureString &prefix, const Key *after, const function<bool(const Key &key)> &fn) const {
+    Key first(prefix, INT_MIN);
+    auto it = after && first < *after ? keys.upper_bound(*after) : keys.lower_bound(first);
+    for (; it != keys.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+        if (!fn(*it)) return;
+}
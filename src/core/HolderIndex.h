@@ -0,0 +1,71 @@
+#pragma once
+#include "../concurrency/ThreadPool.h"
+#include "../crypto/SecureArena.h"
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Holder-name index for Bank. Names are normalized (ASCII lower case, runs of whitespace
+// folded to one space, trimmed), and every account is filed under its normalized name and
+// under each later word-suffix of it, so "Anna van Dijk" is found from "anna", "van" and
+// "dijk". Keys sort by (text, account number), which is also the order searches page in.
+// The keys hold names, so they live in the secure arena like the accounts do.
+class HolderIndex {
+public:
+    using Key = pair<SecureString, int>; // (normalized name from some word on, account number)
+
+    static SecureString normalize(string_view name);
+    // Offset of the first word of 'normalized' that starts with 'prefix'; npos if none does.
+    static size_t firstWordWith(const SecureString &normalized, const SecureString &prefix);
+
+    void add(string_view holder, int accountNumber);
+    void remove(string_view holder, int accountNumber);
+    void clear() { keys.clear(); }
+    size_t size() const { return keys.size(); }
+
+    // Replaces the index with one over 'accounts' (anything with size() and operator[] giving
+    // BankAccount). Names are normalized and sorted on 'threads' workers (0 = one per core);
+    // only the final, already ordered, fill is serial.
+    template <typename Accounts>
+    void rebuild(const Accounts &accounts, size_t threads = 0);
+
+    // Calls 'fn' on keys starting with 'prefix' in order, from just after 'after' (from the
+    // first if null), until it returns false.
+    void scan(const SecureString &prefix, const Key *after, const function<bool(const Key &key)> &fn) const;
+
+private:
+    set<Key, less<Key>, SecureAllocator<Key>> keys;
+
+    using Run = vector<Key, SecureAllocator<Key>>;
+    static void keysOf(string_view holder, int accountNumber, Run &out);
+    void fill(vector<Run> &runs); // sorted runs, merged into 'keys'
+};
+
+template <typename Accounts>
+void HolderIndex::rebuild(const Accounts &accounts, size_t threads) {
+    static constexpr size_t MIN_RUN = 16384; // smaller tables are not worth a thread
+    size_t n = accounts.size();
+    size_t workers = threads ? threads : max<size_t>(1, thread::hardware_concurrency());
+    size_t runCount = max<size_t>(1, min(workers, n / MIN_RUN));
+    vector<Run> runs(runCount);
+    auto build = [&](size_t r) {
+        Run &run = runs[r];
+        for (size_t i = n * r / runCount, end = n * (r + 1) / runCount; i < end; ++i)
+            keysOf(accounts[i].getHolderName(), accounts[i].getAccountNumber(), run);
+        sort(run.begin(), run.end());
+    };
+    if (runCount == 1) {
+        build(0);
+    } else {
+        ThreadPool pool(runCount);
+        vector<future<void>> done;
+        for (size_t r = 0; r < runCount; ++r) done.push_back(pool.submit([&build, r] { build(r); }));
+        for (auto &d : done) d.get();
+    }
+    fill(runs);
+}
@@ -0,0 +1,484 @@
+#include "JournalChain.h"
+#include "../concurrency/ThreadPool.h"
+#include "../crypto/CryptoUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <openssl/crypto.h>
+using namespace std;
+
+static const char CHAIN_MAGIC[8] = {'S', 'B', 'K', 'C', 'H', 'N', '0', '1'};
+static constexpr string_view PURPOSE = "SBK journal chain";
+static constexpr size_t POSITION_SIZE = 80;
+static constexpr size_t HEADER_SIZE = sizeof(CHAIN_MAGIC) + 16;
+static constexpr size_t WINDOW = 4 << 20; // plaintext read at a time when verifying
+
+static string chainPath(const string &journalPath) { return journalPath + ".chain"; }
+static string headPath(const string &journalPath) { return journalPath + ".chainhead"; }
+
+static void putU64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+static void encode(const JournalChain::Position &p, unsigned char *out) {
+    putU64(out, p.records);
+    putU64(out + 8, p.offset);
+    memcpy(out + 16, p.hash, 32);
+    memcpy(out + 48, p.mac, 32);
+}
+
+static void decode(const unsigned char *in, JournalChain::Position &p) {
+    p.records = getU64(in);
+    p.offset = getU64(in + 8);
+    memcpy(p.hash, in + 16, 32);
+    memcpy(p.mac, in + 48, 32);
+}
+
+// What the MAC covers: the magic, so a position cannot be passed off as anything else.
+static void macInput(const JournalChain::Position &p, unsigned char *msg) {
+    memcpy(msg, CHAIN_MAGIC, sizeof(CHAIN_MAGIC));
+    putU64(msg + 8, p.records);
+    putU64(msg + 16, p.offset);
+    memcpy(msg + 24, p.hash, 32);
+}
+
+JournalChain::JournalChain(const string &log, string_view pwd) : logPath(log), password(pwd) {}
+
+JournalChain::~JournalChain() {
+    OPENSSL_cleanse(key, sizeof(key));
+}
+
+void JournalChain::seal(Position &p) const {
+    unsigned char msg[56];
+    macInput(p, msg);
+    CryptoUtils::hmacSha256(key, msg, sizeof(msg), p.mac);
+}
+
+bool JournalChain::sealed(const Position &p) const {
+    unsigned char msg[56], mac[32];
+    macInput(p, msg);
+    return CryptoUtils::hmacSha256(key, msg, sizeof(msg), mac) && CRYPTO_memcmp(mac, p.mac, sizeof(mac)) == 0;
+}
+
+bool JournalChain::writeChain(const Position &anchor, const vector<Position> &checkpoints) {
+    string path = chainPath(logPath), tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        out.write(CHAIN_MAGIC, sizeof(CHAIN_MAGIC));
+        out.write(reinterpret_cast<const char*>(salt), sizeof(salt));
+        unsigned char buf[POSITION_SIZE];
+        encode(anchor, buf);
+        out.write(reinterpret_cast<const char*>(buf), sizeof(buf));
+        for (const Position &p : checkpoints) {
+            encode(p, buf);
+            out.write(reinterpret_cast<const char*>(buf), sizeof(buf));
+        }
+        if (!out) return false;
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+bool JournalChain::writeHead() {
+    string path = headPath(logPath), tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        unsigned char buf[POSITION_SIZE];
+        encode(head, buf);
+        out.write(reinterpret_cast<const char*>(buf), sizeof(buf));
+        if (!out) return false;
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+// Reads and authenticates the chain beside 'journalPath'. 'last' is its head.
+bool JournalChain::readChain(const string &journalPath, Position &anchor, vector<Position> &checkpoints,
+                             Position &last, string &problem) const {
+    checkpoints.clear();
+    ifstream in(chainPath(journalPath), ios::binary);
+    unsigned char header[HEADER_SIZE];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        memcmp(header, CHAIN_MAGIC, sizeof(CHAIN_MAGIC)) != 0) {
+        problem = "the journal has no readable chain";
+        return false;
+    }
+    if (memcmp(header + sizeof(CHAIN_MAGIC), salt, sizeof(salt)) != 0) {
+        problem = "the chain was made under another key";
+        return false;
+    }
+    unsigned char buf[POSITION_SIZE];
+    Position p, prev;
+    bool first = true;
+    while (in.read(reinterpret_cast<char*>(buf), sizeof(buf))) {
+        decode(buf, p);
+        if (!sealed(p)) {
+            problem = "the checkpoint at record " + to_string(p.records) + " does not authenticate";
+            return false;
+        }
+        if (!first && (p.records <= prev.records || p.offset <= prev.offset)) {
+            problem = "checkpoints out of order at record " + to_string(p.records);
+            return false;
+        }
+        if (first) anchor = p;
+        else checkpoints.push_back(p);
+        prev = p;
+        first = false;
+    }
+    if (first || in.gcount() != 0) {
+        problem = first ? "the chain has no anchor" : "the chain file is cut short";
+        return false;
+    }
+    ifstream headIn(headPath(journalPath), ios::binary);
+    if (!headIn.read(reinterpret_cast<char*>(buf), sizeof(buf))) {
+        problem = "the chain has no head";
+        return false;
+    }
+    decode(buf, last);
+    if (!sealed(last)) {
+        problem = "the chain head does not authenticate";
+        return false;
+    }
+    if (last.records < prev.records || last.offset < prev.offset) {
+        problem = "the chain head is behind its last checkpoint";
+        return false;
+    }
+    return true;
+}
+
+bool JournalChain::load() {
+    ifstream in(chainPath(logPath), ios::binary);
+    unsigned char header[HEADER_SIZE];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        memcmp(header, CHAIN_MAGIC, sizeof(CHAIN_MAGIC)) != 0)
+        return false;
+    memcpy(salt, header + sizeof(CHAIN_MAGIC), sizeof(salt));
+    if (!CryptoUtils::macKey(password, salt, nullptr, PURPOSE, key)) return false;
+    Position anchor;
+    vector<Position> checkpoints;
+    string problem;
+    if (!readChain(logPath, anchor, checkpoints, head, problem)) return false;
+    checkpointed = checkpoints.empty() ? anchor.records : checkpoints.back().records;
+    loaded = true;
+    return true;
+}
+
+bool JournalChain::open() {
+    if (isOpen) return true;
+    if (!filesystem::exists(chainPath(logPath))) return adopt();
+    if (!load()) return false;
+    // A crash between appending to the journal and to the chain leaves whole records past the
+    // head. They are sealed under the journal's key, so the chain is carried over them. A
+    // journal shorter than the head has lost records: nothing is appended to it, and verify()
+    // reports it.
+    uint64_t plainBytes = 0;
+    if (filesystem::exists(logPath) && !CryptoUtils::plainSize(logPath, plainBytes)) return false;
+    if (plainBytes < head.offset) return false;
+    if (plainBytes > head.offset && !extend(plainBytes)) return false;
+    isOpen = true;
+    return true;
+}
+
+// Chains the records in [head.offset, plainBytes) of the journal. For a CBC journal
+// 'plainBytes' is only an upper bound, and there may be nothing there at all.
+bool JournalChain::extend(uint64_t plainBytes) {
+    string text;
+    if (!CryptoUtils::readRange(logPath, password, head.offset, size_t(plainBytes - head.offset), text)) return false;
+    if (text.empty()) return true;
+    if (text.back() != '\n') return false; // a record cut short: left to verify()
+    for (string_view rest(text); !rest.empty();) {
+        size_t nl = rest.find('\n');
+        if (!step(rest.substr(0, nl))) return false;
+        rest.remove_prefix(nl + 1);
+    }
+    return writeHead();
+}
+
+// Starts a chain over the journal as it is, trusting its current contents.
+bool JournalChain::adopt() {
+    if (!CryptoUtils::macKey(password, nullptr, salt, PURPOSE, key)) return false;
+    Position anchor;
+    seal(anchor);
+    head = anchor;
+    vector<Position> checkpoints;
+    if (filesystem::exists(logPath)) {
+        string carry;
+        bool ok = CryptoUtils::decryptStream(logPath, password, [&](const unsigned char *data, size_t len) {
+            const char *p = reinterpret_cast<const char*>(data), *end = p + len;
+            while (p < end) {
+                const char *nl = static_cast<const char*>(memchr(p, '\n', end - p));
+                if (!nl) {
+                    carry.append(p, end);
+                    break;
+                }
+                carry.append(p, nl);
+                if (!CryptoUtils::chainStep(head.hash, carry, head.hash)) return false;
+                ++head.records;
+                head.offset += carry.size() + 1;
+                if (head.records % CHECKPOINT_EVERY == 0) {
+                    checkpoints.push_back(head);
+                    seal(checkpoints.back());
+                }
+                carry.clear();
+                p = nl + 1;
+            }
+            return true;
+        });
+        if (!ok) return false;
+    }
+    seal(head);
+    checkpointed = checkpoints.empty() ? 0 : checkpoints.back().records;
+    verifiedRecords = 0;
+    isOpen = loaded = writeChain(anchor, checkpoints) && writeHead();
+    return isOpen;
+}
+
+bool JournalChain::append(string_view line) {
+    return isOpen && step(line) && writeHead();
+}
+
+// Moves the head on by one record, adding a checkpoint when one is due.
+bool JournalChain::step(string_view line) {
+    if (!CryptoUtils::chainStep(head.hash, line, head.hash)) return false;
+    ++head.records;
+    head.offset += line.size() + 1;
+    seal(head);
+    if (head.records - checkpointed >= CHECKPOINT_EVERY) {
+        unsigned char buf[POSITION_SIZE];
+        encode(head, buf);
+        ofstream out(chainPath(logPath), ios::binary | ios::app);
+        out.write(reinterpret_cast<const char*>(buf), sizeof(buf));
+        out.flush();
+        if (!out) return false;
+        checkpointed = head.records;
+    }
+    return true;
+}
+
+bool JournalChain::trim(string_view trimmed) {
+    if (!isOpen) return false;
+    Position anchor, last;
+    vector<Position> checkpoints;
+    string problem;
+    uint64_t plainBytes = trimmed.size();
+    if (!readChain(logPath, anchor, checkpoints, last, problem) || plainBytes > head.offset) return false;
+    // Walk from the last position at or before the cut to the cut itself.
+    Position cut = anchor;
+    for (const Position &p : checkpoints)
+        if (p.offset <= plainBytes) cut = p;
+    if (cut.offset > plainBytes) return false;
+    for (string_view rest = trimmed.substr(size_t(cut.offset)); !rest.empty();) {
+        size_t nl = rest.find('\n');
+        if (nl == string_view::npos) return false; // not at a record boundary
+        if (!CryptoUtils::chainStep(cut.hash, rest.substr(0, nl), cut.hash)) return false;
+        ++cut.records;
+        rest.remove_prefix(nl + 1);
+    }
+    cut.offset = 0;
+    seal(cut);
+    vector<Position> kept;
+    for (Position p : checkpoints) {
+        if (p.offset <= plainBytes) continue;
+        p.offset -= plainBytes;
+        seal(p);
+        kept.push_back(p);
+    }
+    head.offset -= plainBytes;
+    seal(head);
+    return writeChain(cut, kept) && writeHead();
+}
+
+void JournalChain::reset() {
+    isOpen = loaded = false;
+    verifiedRecords = 0;
+    error_code ec;
+    filesystem::remove(chainPath(logPath), ec);
+    filesystem::remove(headPath(logPath), ec);
+}
+
+bool JournalChain::snapshot(const string &copyPath) const {
+    error_code ec;
+    auto overwrite = filesystem::copy_options::overwrite_existing;
+    if (filesystem::exists(logPath)) filesystem::copy_file(logPath, copyPath, overwrite, ec);
+    else filesystem::remove(copyPath, ec);
+    if (!ec) filesystem::copy_file(chainPath(logPath), chainPath(copyPath), overwrite, ec);
+    if (!ec) filesystem::copy_file(headPath(logPath), headPath(copyPath), overwrite, ec);
+    return !ec;
+}
+
+// Replays journal text from one chain position, checking each position it passes until the
+// last one it was given.
+struct ChainWalker {
+    const vector<JournalChain::Position> &bounds;
+    size_t next, end; // the next position to reach, and the last
+    unsigned char hash[32];
+    uint64_t records, offset;
+    string carry;
+    size_t failedAt = 0; // position whose stretch did not match; 0 while all is well
+    string problem;
+
+    ChainWalker(const vector<JournalChain::Position> &b, size_t from, size_t to)
+        : bounds(b), next(from + 1), end(to), records(b[from].records), offset(b[from].offset) {
+        memcpy(hash, b[from].hash, sizeof(hash));
+    }
+
+    bool fail(size_t at, const char *why) {
+        failedAt = at;
+        problem = why;
+        return false;
+    }
+
+    bool record(string_view line) {
+        if (next > end) return fail(end, "records past the chain head");
+        if (!CryptoUtils::chainStep(hash, line, hash)) return fail(next, "hashing failed");
+        ++records;
+        offset += line.size() + 1;
+        if (records == bounds[next].records) {
+            if (offset != bounds[next].offset || memcmp(hash, bounds[next].hash, sizeof(hash)) != 0)
+                return fail(next, "records were changed, dropped, added or reordered");
+            ++next;
+        }
+        return true;
+    }
+
+    bool feed(const char *p, size_t len) {
+        const char *stop = p + len;
+        while (p < stop) {
+            const char *nl = static_cast<const char*>(memchr(p, '\n', stop - p));
+            if (!nl) {
+                carry.append(p, stop);
+                break;
+            }
+            bool ok;
+            if (carry.empty()) {
+                ok = record(string_view(p, nl - p));
+            } else {
+                carry.append(p, nl);
+                ok = record(carry);
+                carry.clear();
+            }
+            if (!ok) return false;
+            p = nl + 1;
+        }
+        return true;
+    }
+
+    bool finish() {
+        if (failedAt) return false;
+        if (!carry.empty()) return fail(next > end ? end : next, "a record is cut short");
+        if (next <= end) return fail(next, "records are missing");
+        return true;
+    }
+};
+
+bool JournalChain::verify(const string &journalPath, bool incremental, JournalVerifyReport &report, size_t threads) {
+    auto started = chrono::steady_clock::now();
+    report = JournalVerifyReport();
+    auto done = [&](bool ran) {
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return ran;
+    };
+    // A chain that will not open for appends can still be checked against, to say why.
+    if (!isOpen && !open() && !loaded) return done(false);
+
+    Position anchor, last;
+    vector<Position> bounds;
+    auto failed = [&]() {
+        verifiedRecords = 0; // trust nothing verified before until a full run passes again
+        return done(true);
+    };
+    if (!readChain(journalPath, anchor, bounds, last, report.problem)) return failed();
+    uint64_t lastCheckpoint = bounds.empty() ? anchor.records : bounds.back().records;
+    bounds.insert(bounds.begin(), anchor);
+    if (last.records > bounds.back().records) bounds.push_back(last);
+    else if (last.offset != bounds.back().offset || memcmp(last.hash, bounds.back().hash, 32) != 0) {
+        report.problem = "the chain head does not match its last checkpoint";
+        return failed();
+    }
+
+    size_t from = 0;
+    if (incremental) {
+        auto it = find_if(bounds.begin(), bounds.end(), [this](const Position &p) { return p.records == verifiedRecords; });
+        if (it != bounds.end()) from = size_t(it - bounds.begin());
+    }
+    size_t to = bounds.size() - 1;
+    report.segments = to - from;
+    report.firstRecord = bounds[from].records + 1;
+    report.lastRecord = last.records;
+
+    uint64_t plainBytes = 0;
+    bool chunked = CryptoUtils::isChunkedFile(journalPath);
+    if (!filesystem::exists(journalPath)) {
+        if (last.records != 0) {
+            report.problem = "the journal is missing";
+            return failed();
+        }
+    } else if (chunked && CryptoUtils::plainSize(journalPath, plainBytes) && plainBytes != last.offset) {
+        report.problem = plainBytes > last.offset ? "the journal has records the chain does not cover"
+                                                  : "the journal is shorter than the chain";
+        return failed();
+    }
+
+    // Consecutive stretches are grouped, a few groups per worker, each walked by one reader.
+    size_t workers = threads ? threads : max<size_t>(1, thread::hardware_concurrency());
+    size_t groups = max<size_t>(1, min<size_t>(report.segments, workers * 4));
+    vector<unique_ptr<ChainWalker>> walkers;
+    vector<future<bool>> results;
+    if (report.segments > 0 && !chunked) {
+        // Legacy CBC journal: one pass from the start, skipping what was verified before.
+        walkers.push_back(make_unique<ChainWalker>(bounds, from, to));
+        ChainWalker *w = walkers.back().get();
+        uint64_t skip = bounds[from].offset;
+        bool ok = CryptoUtils::decryptStream(journalPath, password, [w, &skip](const unsigned char *data, size_t len) {
+            size_t s = size_t(min<uint64_t>(skip, len));
+            skip -= s;
+            return w->feed(reinterpret_cast<const char*>(data) + s, len - s);
+        });
+        if (!ok && !w->failedAt) return done(false);
+        results.push_back(async(launch::deferred, [w] { return w->finish(); }));
+    } else if (report.segments > 0) {
+        ThreadPool pool(min(workers, groups));
+        for (size_t g = 0; g < groups; ++g) {
+            size_t a = from + report.segments * g / groups, b = from + report.segments * (g + 1) / groups;
+            walkers.push_back(make_unique<ChainWalker>(bounds, a, b));
+            ChainWalker *w = walkers.back().get();
+            results.push_back(pool.submit([this, w, &journalPath] {
+                CryptoUtils::ChunkedReader reader;
+                if (!reader.open(journalPath, password, 1)) return w->fail(w->next, "the journal cannot be read");
+                string data;
+                for (uint64_t at = w->bounds[w->next - 1].offset, stop = w->bounds[w->end].offset; at < stop;) {
+                    if (!reader.read(at, size_t(min<uint64_t>(WINDOW, stop - at)), data) || data.empty())
+                        return w->fail(w->next, "the journal cannot be read");
+                    at += data.size();
+                    if (!w->feed(data.data(), data.size())) return false;
+                }
+                return w->finish();
+            }));
+        }
+        for (auto &r : results) r.wait();
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].get()) continue;
+        ChainWalker &w = *walkers[i];
+        report.problem = w.problem;
+        report.firstRecord = bounds[w.failedAt - 1].records + 1;
+        report.lastRecord = bounds[w.failedAt].records;
+        report.recordsChecked = bounds[w.failedAt - 1].records - bounds[from].records;
+        return failed();
+    }
+    report.intact = true;
+    report.recordsChecked = last.records - bounds[from].records;
+    verifiedRecords = lastCheckpoint;
+    return done(true);
+}
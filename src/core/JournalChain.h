@@ -0,0 +1,92 @@
+#pragma once
+#include "../crypto/SecureArena.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+struct JournalVerifyReport {
+    bool intact = false;
+    uint64_t recordsChecked = 0;
+    uint64_t segments = 0;    // stretches between checkpoints
+    uint64_t firstRecord = 0; // where it failed: record numbers since the chain began
+    uint64_t lastRecord = 0;
+    string problem;           // empty if intact
+    double seconds = 0;
+};
+
+// Hash chain over the transaction journal, so records cannot be dropped, altered, inserted or
+// reordered without it showing. Record i (a journal line, without its newline) moves the
+// chain on as h(i) = SHA-256(h(i-1) || line). A chain position is (records, plaintext offset,
+// hash), stored with an HMAC under a key from the master password, so nobody without the
+// password can write a position that matches an edited journal:
+//
+//   <log>.chain      "SBKCHN01" | salt 16 | anchor | a checkpoint every CHECKPOINT_EVERY records
+//   <log>.chainhead  the position after the last record, replaced after every append
+//   position         records u64 LE | offset u64 LE | hash 32 | mac 32
+//
+// The anchor is where the chain starts: the empty journal, or the first record kept after
+// archiving trimmed the ones before it. Stretches between checkpoints are verified in
+// parallel, and an incremental verify starts from the last checkpoint an earlier one reached.
+// A journal and chain rolled back together to an earlier state cannot be told from the files
+// alone; a replication standby's copy is the check for that.
+class JournalChain {
+public:
+    static constexpr uint64_t CHECKPOINT_EVERY = 4096;
+
+    JournalChain(const string &logPath, string_view password);
+    ~JournalChain(); // wipes the key
+
+    JournalChain(const JournalChain&) = delete;
+    JournalChain& operator=(const JournalChain&) = delete;
+
+    // Loads the chain, checking its head. A journal without one (written before chains, or
+    // just restored from a replication image) gets a chain over what it holds now; complete
+    // records past the head (left by a crash before the chain caught up) are chained. Fails
+    // for a journal shorter than the chain.
+    bool open();
+    bool loadedOnly() const { return loaded && !isOpen; } // open() read the chain but refused the journal
+    // Extends the chain by a record just added to the journal.
+    bool append(string_view line);
+    // The journal lost 'trimmed', the plaintext of its first records, to archiving.
+    bool trim(string_view trimmed);
+    // Forgets the chain and deletes its files; the next open() starts a new one.
+    void reset();
+    // Copies the journal and its chain side by side, for verifying while appends go on.
+    bool snapshot(const string &copyPath) const;
+
+    // Checks 'journalPath' (the journal, or a snapshot) against the chain stored beside it,
+    // on 'threads' workers (0 = one per core).
+    bool verify(const string &journalPath, bool incremental, JournalVerifyReport &report, size_t threads = 0);
+
+    struct Position {
+        uint64_t records = 0;
+        uint64_t offset = 0;
+        unsigned char hash[32] = {};
+        unsigned char mac[32] = {};
+    };
+
+private:
+    string logPath;
+    SecureString password;
+    unsigned char salt[16];
+    unsigned char key[32];
+    Position head;
+    uint64_t checkpointed = 0;          // records at the last checkpoint (or the anchor)
+    atomic<uint64_t> verifiedRecords{0}; // last checkpoint a verify() got to
+    bool loaded = false; // key and head read
+    bool isOpen = false; // ...and the journal matches them, so appends can go on
+
+    void seal(Position &p) const;
+    bool sealed(const Position &p) const;
+    bool writeChain(const Position &anchor, const vector<Position> &checkpoints);
+    bool writeHead();
+    bool readChain(const string &journalPath, Position &anchor, vector<Position> &checkpoints, Position &last,
+                   string &problem) const;
+    bool adopt();
+    bool load();
+    bool extend(uint64_t plainBytes);
+    bool step(string_view line);
+};
@@ -0,0 +1,160 @@
+#include "ShardedBank.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+using namespace std;
+
+static string shardPath(const string &path, size_t i) { return path + "." + to_string(i); }
+static string manifestPath(const string &dataFile) { return dataFile + ".shards"; }
+
+ShardedBank::ShardedBank(const string &dataFile, const string &logFile, string_view masterPassword, size_t count)
+    : dataFilePath(dataFile), logFilePath(logFile), masterPwd(masterPassword) {
+    count = max<size_t>(1, count);
+    for (size_t i = 0; i < count; ++i) {
+        shards.push_back(make_unique<Bank>(shardPath(dataFile, i), shardPath(logFile, i), masterPassword));
+        shards.back()->setAccountNumbering(int(count), int(i));
+    }
+    pool = make_unique<ThreadPool>(min<size_t>(count, max(1u, thread::hardware_concurrency())));
+}
+
+size_t ShardedBank::shardOf(int accountNumber) const {
+    long long n = (long long)shards.size();
+    return size_t(((accountNumber % n) + n) % n);
+}
+
+bool ShardedBank::forEachShard(const function<bool(Bank &bank, size_t i)> &fn) {
+    vector<future<bool>> results;
+    for (size_t i = 0; i < shards.size(); ++i)
+        results.push_back(pool->submit([&fn, this, i] { return fn(*shards[i], i); }));
+    bool ok = true;
+    for (auto &r : results) ok = r.get() && ok;
+    return ok;
+}
+
+size_t ShardedBank::storedShardCount() const {
+    ifstream in(manifestPath(dataFilePath));
+    size_t count = 0;
+    return in >> count ? count : 0;
+}
+
+bool ShardedBank::load() {
+    size_t stored = storedShardCount();
+    if (stored == 0 && filesystem::exists(dataFilePath)) return split();
+    if (stored != 0 && stored != shards.size()) return false; // laid out for another count
+    return forEachShard([](Bank &bank, size_t) { return bank.load(); });
+}
+
+size_t ShardedBank::threadsPerShard() const {
+    return max<size_t>(1, thread::hardware_concurrency() / shards.size());
+}
+
+bool ShardedBank::split() {
+    Bank whole(dataFilePath, logFilePath, masterPwd);
+    if (!whole.load()) return false;
+    auto view = whole.accountsSnapshot();
+    vector<vector<BankAccount>> parts(shards.size());
+    for (size_t i = 0; i < view->size(); ++i)
+        parts[shardOf((*view)[i].getAccountNumber())].push_back((*view)[i]);
+    // The old journal stays where it is as history. Each partition's journal starts with the
+    // balances it takes over, so replaying it gives back the accounts it is saved with.
+    string opened = getCurrentIsoTimestamp();
+    return forEachShard([&](Bank &bank, size_t i) {
+        SecureString text;
+        for (const BankAccount &acc : parts[i])
+            if (acc.getBalance() != 0)
+                text.append(Transaction(opened, "Deposit", acc.getBalance(), acc.getAccountNumber()).serialize()).append(1, '\n');
+        string journal = shardPath(logFilePath, i) + ".opening";
+        bool ok = Bank::writeJournal(journal, text, masterPwd) && bank.restoreState(parts[i], journal);
+        error_code ec;
+        filesystem::remove(journal, ec);
+        return ok;
+    }) && save();
+}
+
+bool ShardedBank::save() {
+    vector<shared_ptr<const Bank::AccountsView>> cut(shards.size());
+    {
+        unique_lock<shared_mutex> lk(gate);
+        for (size_t i = 0; i < shards.size(); ++i) cut[i] = shards[i]->accountsSnapshot();
+    }
+    if (!forEachShard([&cut](Bank &bank, size_t i) { return bank.save(*cut[i]); })) return false;
+    string tmp = manifestPath(dataFilePath) + ".tmp";
+    {
+        ofstream out(tmp, ios::trunc);
+        out << shards.size() << "\n";
+        if (!out) return false;
+    }
+    error_code ec;
+    filesystem::rename(tmp, manifestPath(dataFilePath), ec);
+    return !ec;
+}
+
+bool ShardedBank::verifyJournals(bool incremental, vector<JournalVerifyReport> &reports) {
+    reports.assign(shards.size(), JournalVerifyReport());
+    size_t threads = threadsPerShard();
+    return forEachShard([&](Bank &bank, size_t i) { return bank.verifyJournal(incremental, reports[i], threads); });
+}
+
+int ShardedBank::createAccount(const string &holderName, double initDeposit) {
+    return shards[nextShard++ % shards.size()]->createAccount(holderName, initDeposit);
+}
+
+bool ShardedBank::findAccount(int accountNumber, BankAccount &out) {
+    return shards[shardOf(accountNumber)]->findAccount(accountNumber, out);
+}
+
+bool ShardedBank::deleteAccount(int accountNumber) {
+    unique_lock<shared_mutex> lk(gate);
+    return shards[shardOf(accountNumber)]->deleteAccount(accountNumber);
+}
+
+bool ShardedBank::deposit(int accountNumber, double amount) {
+    return shards[shardOf(accountNumber)]->deposit(accountNumber, amount);
+}
+
+bool ShardedBank::withdraw(int accountNumber, double amount) {
+    return shards[shardOf(accountNumber)]->withdraw(accountNumber, amount);
+}
+
+bool ShardedBank::transfer(int fromAccount, int toAccount, double amount) {
+    if (fromAccount == toAccount || amount <= 0) return false;
+    shared_lock<shared_mutex> lk(gate);
+    BankAccount target;
+    if (!findAccount(toAccount, target)) return false;
+    // The target cannot be deleted while the gate is held, so once the money is out the
+    // deposit goes through.
+    if (!withdraw(fromAccount, amount)) return false;
+    if (deposit(toAccount, amount)) return true;
+    deposit(fromAccount, amount); // the journal could not take it: put the money back
+    return false;
+}
+
+bool ShardedBank::searchHolders(const HolderQuery &query, HolderPage &page) {
+    page = HolderPage();
+    vector<Bank::HolderPage> parts(shards.size());
+    if (!forEachShard([&](Bank &bank, size_t i) { return bank.searchHolders(query, parts[i]); })) return false;
+    // Every partition's page holds its first matches after 'query.after', so the first
+    // 'query.limit' of them all are the page. Keys are rebuilt the way the index files them.
+    SecureString text = HolderIndex::normalize(query.text);
+    vector<pair<HolderIndex::Key, const BankAccount*>> found;
+    for (const Bank::HolderPage &part : parts) {
+        for (size_t pos : part.positions) {
+            const BankAccount &acc = (*part.view)[pos];
+            SecureString name = HolderIndex::normalize(acc.getHolderName());
+            size_t from = query.mode == HolderQuery::Prefix ? HolderIndex::firstWordWith(name, text) : 0;
+            found.push_back({{name.substr(from), acc.getAccountNumber()}, &acc});
+        }
+        page.more = page.more || part.more;
+    }
+    sort(found.begin(), found.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    if (found.size() > query.limit) {
+        found.resize(query.limit);
+        page.more = true;
+    }
+    for (const auto &f : found) {
+        page.accounts.push_back(*f.second);
+        page.next = f.first;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "Bank.h"
+#include "../concurrency/ThreadPool.h"
+#include "../crypto/SecureArena.h"
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Accounts split over N partitions by account number (number mod N), each a Bank with its own
+// accounts file, journal and locks, so operations on different partitions never wait for each
+// other and load/save run on all of them at once. Partition i lives in <dataFile>.<i> and
+// <logFile>.<i>; <dataFile>.shards records N. Each partition hands out only account numbers
+// that map back to it, and new accounts go to the partitions in turn.
+//
+// Balances reach disk only through save(), so a consistent save is what recovery depends on.
+// A transfer holds the gate shared from its withdrawal to its deposit, and save() takes it
+// exclusively just long enough to take every partition's snapshot. A save therefore never
+// holds half a transfer; the writing itself happens afterwards, in parallel, while everything
+// carries on. Deletions also take the gate exclusively, so a transfer's target cannot vanish
+// between its two halves.
+class ShardedBank {
+public:
+    ShardedBank(const string &dataFile, const string &logFile, string_view masterPassword, size_t shards);
+
+    // Loads every partition in parallel. A single-file bank at 'dataFile' (one that predates
+    // sharding) is split over the partitions and saved that way; its own files are left alone.
+    // Each partition's journal then opens with a deposit of every balance it took over, so
+    // it reconciles against its accounts file; the old journal keeps the history before that.
+    // Fails if the files were laid out for another number of partitions.
+    bool load();
+    bool save();
+
+    int createAccount(const string &holderName, double initDeposit); // account number, -1 on failure
+    bool findAccount(int accountNumber, BankAccount &out);
+    bool deleteAccount(int accountNumber);
+    bool deposit(int accountNumber, double amount);
+    bool withdraw(int accountNumber, double amount);
+    // Each side is journaled by its own partition, as a withdrawal and a deposit. Should the
+    // deposit fail, the amount is deposited back to the source (journaled as such) and the
+    // transfer fails.
+    bool transfer(int fromAccount, int toAccount, double amount);
+
+    // Bank::searchHolders on every partition at once, merged into one page in (normalized
+    // name, account number) order. The accounts are copies: the partitions share no table.
+    struct HolderPage {
+        vector<BankAccount> accounts;
+        HolderIndex::Key next; // pass as 'after' for the next page
+        bool more = false;
+    };
+    bool searchHolders(const HolderQuery &query, HolderPage &page);
+
+    // Bank::verifyJournal on every partition at once; reports[i] is partition i's. An
+    // incremental run moves each partition's verified checkpoint on. False if any partition's
+    // journal could not be checked.
+    bool verifyJournals(bool incremental, vector<JournalVerifyReport> &reports);
+
+    size_t shardCount() const { return shards.size(); }
+    size_t shardOf(int accountNumber) const;
+    // For per-partition work: snapshots, change feeds, archiving.
+    Bank &shard(size_t i) { return *shards[i]; }
+
+private:
+    string dataFilePath;
+    string logFilePath;
+    SecureString masterPwd;
+    vector<unique_ptr<Bank>> shards;
+    unique_ptr<ThreadPool> pool; // load/save/verify fan-out
+    shared_mutex gate;           // shared: a transfer in flight; exclusive: save's cut, deletes
+    atomic<size_t> nextShard{0}; // where the next account goes
+
+    bool forEachShard(const function<bool(Bank &bank, size_t i)> &fn);
+    size_t threadsPerShard() const; // cores left to each partition while all of them work
+    bool split(); // from the single-file layout
+    size_t storedShardCount() const; // 0 if not recorded
+};
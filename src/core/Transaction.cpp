@@ -1,11 +1,18 @@
 #include "Transaction.h"
 #include <sstream>
 #include <iomanip>
+#include <charconv>
 using namespace std;
 
+string formatAmount(double value) {
+    char buf[32];
+    auto res = to_chars(buf, buf + sizeof(buf), value);
+    return string(buf, res.ptr);
+}
+
 string Transaction::serialize() const {
     ostringstream oss;
-    oss << timestamp << "|" << type << "|" << amount << "|" << relatedAccount;
+    oss << timestamp << "|" << type << "|" << formatAmount(amount) << "|" << relatedAccount;
     return oss.str();
 }
 
@@ -3,9 +3,13 @@
 #include <chrono>
 using namespace std;
 
+// Shortest text that reads back as exactly 'value' (the default stream precision of six
+// digits turned 1234567.89 into 1.23457e+06).
+string formatAmount(double value);
+
 struct Transaction {
     string timestamp;
-    string type; // "Deposit", "Withdraw", "Transfer"
+    string type; // "Deposit", "Withdraw", "Close" (amount = balance at deletion), "Transfer"
     double amount;
     int relatedAccount;
 
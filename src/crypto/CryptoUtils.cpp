@@ -1,9 +1,19 @@
-
 #include "CryptoUtils.h"
+#include "MappedFile.h"
+#include "SecureArena.h"
+#include "../concurrency/ThreadPool.h"
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/err.h>
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <mutex>
 #include <vector>
 #include <cstring>
 
@@ -16,14 +26,34 @@ static constexpr int IV_SIZE = 16;
 static constexpr int KEY_SIZE = 32; // AES-256
 static constexpr int PBKDF2_ITERS = 100000;
 
+// Chunked GCM container, see CryptoUtils.h.
+static const unsigned char CHUNKED_MAGIC[8] = {'S', 'B', 'K', 'G', 'C', 'M', '0', '1'};
+static constexpr uint8_t CHUNKED_V1 = 1; // PBKDF2 straight from the file's salt
+static constexpr uint8_t CHUNKED_V2 = 2; // adds a shared PBKDF2 salt, see fileKey()
+static constexpr int NONCE_PREFIX_SIZE = 4;
+static constexpr int NONCE_SIZE = 12;
+static constexpr int TAG_SIZE = 16;
+static constexpr size_t SALT_OFFSET = 16;
+static constexpr size_t V1_HEADER_SIZE = SALT_OFFSET + SALT_SIZE + NONCE_PREFIX_SIZE;
+static constexpr size_t V2_HEADER_SIZE = SALT_OFFSET + 2 * SALT_SIZE + NONCE_PREFIX_SIZE;
+static constexpr size_t MAX_HEADER_SIZE = V2_HEADER_SIZE;
+static constexpr uint32_t MAX_CHUNK_SIZE = 64u << 20;
+static constexpr size_t CHUNKS_PER_THREAD = 4; // per batch, so every thread has work queued
+
+// Sealed record log, see CryptoUtils.h.
+static const unsigned char LOG_MAGIC[8] = {'S', 'B', 'K', 'L', 'O', 'G', '0', '1'};
+static constexpr uint8_t LOG_VERSION = 1;
+static constexpr size_t LOG_HEADER_SIZE = SALT_OFFSET + 2 * SALT_SIZE + NONCE_PREFIX_SIZE;
+static constexpr uint32_t MAX_RECORD_SIZE = 16u << 20;
+
 static void handleErrors() {
     ERR_print_errors_fp(stderr);
 }
 
 // Derive key from password+salt via PBKDF2-HMAC-SHA256
-static bool deriveKey(const string &password, const unsigned char *salt, unsigned char *key_out) {
+static bool deriveKey(string_view password, const unsigned char *salt, unsigned char *key_out) {
     // OpenSSL PKCS5_PBKDF2_HMAC
-    if (!PKCS5_PBKDF2_HMAC(password.c_str(), password.size(),
+    if (!PKCS5_PBKDF2_HMAC(password.data(), password.size(),
                             salt, SALT_SIZE,
                             PBKDF2_ITERS,
                             EVP_sha256(),
@@ -33,56 +63,490 @@ static bool deriveKey(const string &password, const unsigned char *salt, unsigne
     return true;
 }
 
-bool encryptFile(const string &inPath, const string &outPath, const string &password) {
-    ifstream in(inPath, ios::binary);
-    if (!in) return false;
-    ofstream out(outPath, ios::binary);
-    if (!out) return false;
-
-    ERR_clear_error();
+// PBKDF2 results for v2 files, by salt and password. Every file written by one run shares
+// the run's salt, so opening all of them costs a single derivation; callers asking for a key
+// that is still being derived wait for it instead of starting another.
+struct MasterKey {
     unsigned char salt[SALT_SIZE];
-    if (!RAND_bytes(salt, SALT_SIZE)) { handleErrors(); return false; }
+    unsigned char passwordDigest[32];
     unsigned char key[KEY_SIZE];
-    if (!deriveKey(password, salt, key)) { return false; }
+    shared_future<bool> ready;
 
-    unsigned char iv[IV_SIZE];
-    if (!RAND_bytes(iv, IV_SIZE)) { handleErrors(); return false; }
+    ~MasterKey() { OPENSSL_cleanse(key, sizeof(key)); }
+};
 
-    // Write salt and iv to output
-    out.write(reinterpret_cast<char*>(salt), SALT_SIZE);
-    out.write(reinterpret_cast<char*>(iv), IV_SIZE);
+static constexpr size_t MAX_MASTER_KEYS = 8; // a wrong password also leaves an entry
+static mutex masterMtx;
+static vector<shared_ptr<MasterKey>> masterKeys; // newest last
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) { handleErrors(); return false; }
-    if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv)) {
-        handleErrors(); EVP_CIPHER_CTX_free(ctx); return false;
+// The master key for 'password' and 'salt'; a null salt picks the newest key for the password
+// (or a fresh salt) and reports the salt in 'saltOut'.
+static bool masterKey(string_view password, const unsigned char *salt, unsigned char *saltOut, unsigned char *keyOut) {
+    unsigned char digest[32];
+    if (EVP_Digest(password.data(), password.size(), digest, NULL, EVP_sha256(), NULL) != 1) return false;
+    shared_ptr<MasterKey> entry;
+    promise<bool> derived;
+    {
+        lock_guard<mutex> lk(masterMtx);
+        for (auto it = masterKeys.rbegin(); it != masterKeys.rend() && !entry; ++it) {
+            if (CRYPTO_memcmp((*it)->passwordDigest, digest, sizeof(digest)) == 0 &&
+                (!salt || memcmp((*it)->salt, salt, SALT_SIZE) == 0))
+                entry = *it;
+        }
+        if (!entry) {
+            entry = allocate_shared<MasterKey>(SecureAllocator<MasterKey>()); // key stays in the arena
+            if (salt) memcpy(entry->salt, salt, SALT_SIZE);
+            else if (!RAND_bytes(entry->salt, SALT_SIZE)) return false;
+            memcpy(entry->passwordDigest, digest, sizeof(digest));
+            entry->ready = derived.get_future().share();
+            // Evict the oldest finished entry; waiters on it keep their own reference.
+            if (masterKeys.size() >= MAX_MASTER_KEYS) {
+                auto done = find_if(masterKeys.begin(), masterKeys.end(), [](const shared_ptr<MasterKey> &k) {
+                    return k->ready.wait_for(chrono::seconds(0)) == future_status::ready;
+                });
+                if (done != masterKeys.end()) masterKeys.erase(done);
+            }
+            masterKeys.push_back(entry);
+            salt = nullptr; // marks this call as the one deriving
+        } else {
+            salt = entry->salt;
+        }
     }
+    if (!salt) {
+        bool ok = deriveKey(password, entry->salt, entry->key);
+        if (!ok) {
+            lock_guard<mutex> lk(masterMtx);
+            masterKeys.erase(find(masterKeys.begin(), masterKeys.end(), entry));
+        }
+        derived.set_value(ok);
+    }
+    if (!entry->ready.get()) return false;
+    if (saltOut) memcpy(saltOut, entry->salt, SALT_SIZE);
+    memcpy(keyOut, entry->key, KEY_SIZE);
+    return true;
+}
 
-    const size_t BUF_SIZE = 4096;
-    vector<unsigned char> inbuf(BUF_SIZE), outbuf(BUF_SIZE + EVP_CIPHER_block_size(EVP_aes_256_cbc()));
-    int outlen;
+// v2 file key: HMAC-SHA256 of the file's own salt under the shared master key, so each file
+// still gets a fresh key (and nonces never repeat under one key) without another PBKDF2.
+static bool subKey(const unsigned char *master, const unsigned char *fileSalt, unsigned char *key) {
+    static const char LABEL[] = "SBKGCM file key";
+    unsigned char msg[sizeof(LABEL) - 1 + SALT_SIZE];
+    memcpy(msg, LABEL, sizeof(LABEL) - 1);
+    memcpy(msg + sizeof(LABEL) - 1, fileSalt, SALT_SIZE);
+    unsigned int len = 0;
+    return HMAC(EVP_sha256(), master, KEY_SIZE, msg, sizeof(msg), key, &len) && len == KEY_SIZE;
+}
 
-    while (in) {
-        in.read(reinterpret_cast<char*>(inbuf.data()), BUF_SIZE);
-        streamsize len = in.gcount();
-        if (len > 0) {
-            if (1 != EVP_EncryptUpdate(ctx, outbuf.data(), &outlen, inbuf.data(), len)) {
-                handleErrors(); EVP_CIPHER_CTX_free(ctx); return false;
-            }
-            out.write(reinterpret_cast<char*>(outbuf.data()), outlen);
+bool macKey(string_view password, const unsigned char *salt, unsigned char *saltOut, string_view purpose,
+            unsigned char *key) {
+    unsigned char master[KEY_SIZE];
+    if (!masterKey(password, salt, saltOut, master)) return false;
+    unsigned int len = 0;
+    bool ok = HMAC(EVP_sha256(), master, KEY_SIZE, reinterpret_cast<const unsigned char*>(purpose.data()),
+                   purpose.size(), key, &len) && len == KEY_SIZE;
+    OPENSSL_cleanse(master, sizeof(master));
+    return ok;
+}
+
+bool hmacSha256(const unsigned char *key, const void *data, size_t len, unsigned char *mac) {
+    unsigned int macLen = 0;
+    return HMAC(EVP_sha256(), key, KEY_SIZE, static_cast<const unsigned char*>(data), len, mac, &macLen) &&
+           macLen == 32;
+}
+
+struct ThreadDigest {
+    EVP_MD_CTX *ctx = nullptr;
+    ~ThreadDigest() {
+        if (ctx) EVP_MD_CTX_free(ctx);
+    }
+};
+
+static thread_local ThreadDigest threadDigest;
+
+bool chainStep(const unsigned char *prev, string_view data, unsigned char *out) {
+    EVP_MD_CTX *&ctx = threadDigest.ctx;
+    if (!ctx && !(ctx = EVP_MD_CTX_new())) return false;
+    unsigned char digest[32];
+    unsigned int len = 0;
+    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1 && EVP_DigestUpdate(ctx, prev, 32) == 1 &&
+              EVP_DigestUpdate(ctx, data.data(), data.size()) == 1 && EVP_DigestFinal_ex(ctx, digest, &len) == 1;
+    if (ok) memcpy(out, digest, 32);
+    return ok;
+}
+
+static size_t poolSize(size_t threads) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+// Where the chunks of a container file are, worked out from its size. In a sealed log the
+// chunks are its records, found by walking their length prefixes: 'records' holds the file
+// offset of each record, then that of the end of the last.
+struct ChunkLayout {
+    size_t headerSize = 0;
+    uint32_t chunkSize = 0;
+    uint64_t chunks = 0;
+    uint64_t plainBytes = 0;
+    vector<uint64_t> records; // sealed logs only
+
+    uint64_t cipherOffset(uint64_t i) const {
+        return records.empty() ? headerSize + i * (uint64_t(chunkSize) + TAG_SIZE) : records[i] + 4;
+    }
+    uint64_t plainOffset(uint64_t i) const {
+        return records.empty() ? i * chunkSize : records[i] - headerSize - i * (4 + TAG_SIZE);
+    }
+    uint64_t fileSize() const { return headerSize + plainBytes + chunks * TAG_SIZE; }
+    size_t plainLen(uint64_t i) const {
+        if (!records.empty()) return size_t(records[i + 1] - records[i] - 4 - TAG_SIZE);
+        return i + 1 < chunks ? chunkSize : size_t(plainBytes - (chunks - 1) * uint64_t(chunkSize));
+    }
+    bool isLast(uint64_t i) const { return records.empty() && i + 1 == chunks; } // log records never are
+    // The chunk that holds plaintext byte 'offset' (< plainBytes).
+    uint64_t chunkAt(uint64_t offset) const {
+        if (records.empty()) return offset / chunkSize;
+        uint64_t lo = 0, hi = chunks - 1; // the last record starting at or before 'offset'
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo + 1) / 2;
+            if (plainOffset(mid) <= offset) lo = mid;
+            else hi = mid - 1;
         }
+        return lo;
     }
-    if (1 != EVP_EncryptFinal_ex(ctx, outbuf.data(), &outlen)) {
-        handleErrors(); EVP_CIPHER_CTX_free(ctx); return false;
+};
+
+// 'header' holds the first min(fileSize, MAX_HEADER_SIZE) bytes of the file.
+static bool parseHeader(const unsigned char *header, uint64_t fileSize, ChunkLayout &layout) {
+    if (fileSize < V1_HEADER_SIZE || memcmp(header, CHUNKED_MAGIC, sizeof(CHUNKED_MAGIC)) != 0) return false;
+    size_t headerSize = header[8] == CHUNKED_V1 ? V1_HEADER_SIZE : header[8] == CHUNKED_V2 ? V2_HEADER_SIZE : 0;
+    uint32_t chunkSize = 0;
+    for (int i = 3; i >= 0; --i) chunkSize = (chunkSize << 8) | header[12 + i];
+    if (headerSize == 0 || chunkSize == 0 || chunkSize > MAX_CHUNK_SIZE || fileSize < headerSize + TAG_SIZE)
+        return false;
+    uint64_t body = fileSize - headerSize, full = uint64_t(chunkSize) + TAG_SIZE;
+    uint64_t rem = body % full;
+    if (rem != 0 && rem < TAG_SIZE) return false;
+    layout.headerSize = headerSize;
+    layout.chunkSize = chunkSize;
+    layout.chunks = body / full + (rem != 0);
+    layout.plainBytes = body - layout.chunks * TAG_SIZE;
+    return true;
+}
+
+static bool isLogHeader(const unsigned char *header, uint64_t fileSize) {
+    return fileSize >= LOG_HEADER_SIZE && memcmp(header, LOG_MAGIC, sizeof(LOG_MAGIC)) == 0 && header[8] == LOG_VERSION;
+}
+
+// Indexes a sealed log's records; 'prefix(pos, len4)' reads the length prefix at file offset
+// 'pos'. A record cut short at the end, an append still being written or one a crash tore,
+// is left out, as SealedLog::open drops it.
+template <typename Prefix>
+static bool indexLog(uint64_t fileSize, Prefix prefix, ChunkLayout &layout) {
+    layout.headerSize = LOG_HEADER_SIZE;
+    layout.records.clear();
+    uint64_t pos = LOG_HEADER_SIZE;
+    unsigned char len4[4];
+    while (fileSize - pos >= 4) {
+        if (!prefix(pos, len4)) return false;
+        uint32_t len = 0;
+        for (int i = 3; i >= 0; --i) len = (len << 8) | len4[i];
+        if (len > MAX_RECORD_SIZE) return false;
+        if (fileSize - pos - 4 < uint64_t(len) + TAG_SIZE) break;
+        layout.records.push_back(pos);
+        pos += 4 + uint64_t(len) + TAG_SIZE;
     }
-    out.write(reinterpret_cast<char*>(outbuf.data()), outlen);
-    EVP_CIPHER_CTX_free(ctx);
+    layout.records.push_back(pos);
+    layout.chunks = layout.records.size() - 1;
+    layout.plainBytes = layout.plainOffset(layout.chunks);
     return true;
 }
 
-bool decryptFile(const string &inPath, const string &outPath, const string &password) {
-    ifstream in(inPath, ios::binary);
-    if (!in) return false;
+// The key a container's (or a sealed log's) chunks are sealed under.
+static bool fileKey(string_view password, const unsigned char *header, const ChunkLayout &layout,
+                    unsigned char *key) {
+    if (layout.headerSize == V1_HEADER_SIZE) return deriveKey(password, header + SALT_OFFSET, key);
+    unsigned char master[KEY_SIZE];
+    bool ok = masterKey(password, header + SALT_OFFSET, nullptr, master) &&
+              subKey(master, header + SALT_OFFSET + SALT_SIZE, key);
+    OPENSSL_cleanse(master, sizeof(master));
+    return ok;
+}
+
+// Each thread keeps one GCM context: the AES key schedule is only expanded again when the key
+// or direction changes, and every further chunk just loads its nonce. Pool threads wipe theirs
+// when the pool is torn down; a caller that ran chunks inline calls wipeThreadCipher().
+struct ThreadCipher {
+    EVP_CIPHER_CTX *ctx = nullptr;
+    unsigned char key[KEY_SIZE];
+    int enc = -1; // -1: no key loaded
+
+    void wipe() {
+        if (ctx) EVP_CIPHER_CTX_reset(ctx);
+        OPENSSL_cleanse(key, sizeof(key));
+        enc = -1;
+    }
+    ~ThreadCipher() {
+        wipe();
+        if (ctx) EVP_CIPHER_CTX_free(ctx);
+    }
+};
+
+static thread_local ThreadCipher threadCipher;
+
+static void wipeThreadCipher() {
+    threadCipher.wipe();
+}
+
+// The calling thread's context, ready for a chunk under 'nonce'.
+static EVP_CIPHER_CTX *cipherFor(bool seal, const unsigned char *key, const unsigned char *nonce) {
+    ThreadCipher &tc = threadCipher;
+    if (!tc.ctx && !(tc.ctx = EVP_CIPHER_CTX_new())) return nullptr;
+    int enc = seal ? 1 : 0;
+    if (tc.enc == enc && memcmp(tc.key, key, KEY_SIZE) == 0) {
+        if (EVP_CipherInit_ex(tc.ctx, NULL, NULL, NULL, nonce, enc) == 1) return tc.ctx;
+    } else if (EVP_CipherInit_ex(tc.ctx, EVP_aes_256_gcm(), NULL, NULL, NULL, enc) == 1 &&
+               EVP_CIPHER_CTX_ctrl(tc.ctx, EVP_CTRL_GCM_SET_IVLEN, NONCE_SIZE, NULL) == 1 &&
+               EVP_CipherInit_ex(tc.ctx, NULL, NULL, key, nonce, enc) == 1) {
+        memcpy(tc.key, key, KEY_SIZE);
+        tc.enc = enc;
+        return tc.ctx;
+    }
+    tc.wipe();
+    return nullptr;
+}
+
+// Encrypts (seal) or decrypts and verifies (open) one chunk. Sealed chunks carry their tag
+// after the ciphertext.
+static bool cryptChunk(bool seal, const unsigned char *key, const unsigned char *header, size_t headerSize,
+                       uint64_t index, bool last, const unsigned char *in, size_t len, unsigned char *out) {
+    unsigned char nonce[NONCE_SIZE];
+    memcpy(nonce, header + headerSize - NONCE_PREFIX_SIZE, NONCE_PREFIX_SIZE);
+    for (int i = 0; i < 8; ++i) nonce[NONCE_PREFIX_SIZE + i] = static_cast<unsigned char>(index >> (56 - 8 * i));
+    unsigned char aad[MAX_HEADER_SIZE + 9];
+    memcpy(aad, header, headerSize);
+    for (int i = 0; i < 8; ++i) aad[headerSize + i] = static_cast<unsigned char>(index >> (8 * i));
+    aad[headerSize + 8] = last ? 1 : 0;
+
+    EVP_CIPHER_CTX *ctx = cipherFor(seal, key, nonce);
+    if (!ctx) return false;
+    unsigned char tail[16]; // GCM finishes without output, but wants somewhere to put it
+    int outlen = 0, finallen = 0;
+    bool ok = EVP_CipherUpdate(ctx, NULL, &outlen, aad, int(headerSize + 9)) == 1 &&
+              (len == 0 || EVP_CipherUpdate(ctx, out, &outlen, in, int(len)) == 1);
+    if (ok && seal) {
+        ok = EVP_CipherFinal_ex(ctx, tail, &finallen) == 1 &&
+             EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, out + len) == 1;
+    } else if (ok) {
+        ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, const_cast<unsigned char*>(in + len)) == 1 &&
+             EVP_CipherFinal_ex(ctx, tail, &finallen) == 1; // fails if the tag does not match
+    }
+    if (!ok) threadCipher.wipe(); // start the next chunk from a clean context
+    return ok;
+}
+
+// Layout of a new (v2) container.
+static ChunkLayout layoutFor(uint64_t plainBytes, uint32_t chunkSize) {
+    ChunkLayout layout;
+    layout.headerSize = V2_HEADER_SIZE;
+    layout.chunkSize = chunkSize;
+    layout.chunks = max<uint64_t>(1, (plainBytes + chunkSize - 1) / chunkSize);
+    layout.plainBytes = plainBytes;
+    return layout;
+}
+
+// Seals a mapped plaintext into a mapped container body, or opens one back, in place: each
+// chunk goes straight from one mapping to the other. The chunks are split into contiguous
+// runs, a few per thread.
+static bool cryptMapped(bool seal, const unsigned char *src, unsigned char *dst, const ChunkLayout &layout,
+                        const unsigned char *key, const unsigned char *header, size_t threads) {
+    auto run = [=, &layout](uint64_t from, uint64_t to) {
+        for (uint64_t i = from; i < to; ++i) {
+            uint64_t plainOff = i * layout.chunkSize, cipherOff = layout.cipherOffset(i);
+            const unsigned char *in = src + (seal ? plainOff : cipherOff);
+            unsigned char *out = dst + (seal ? cipherOff : plainOff);
+            if (!cryptChunk(seal, key, header, layout.headerSize, i, i + 1 == layout.chunks, in, layout.plainLen(i), out))
+                return false;
+        }
+        return true;
+    };
+    size_t workers = size_t(min<uint64_t>(poolSize(threads), layout.chunks));
+    if (workers <= 1) {
+        bool ok = run(0, layout.chunks);
+        wipeThreadCipher();
+        return ok;
+    }
+    ThreadPool pool(workers);
+    uint64_t runs = min<uint64_t>(layout.chunks, workers * CHUNKS_PER_THREAD);
+    vector<future<bool>> jobs;
+    for (uint64_t r = 0; r < runs; ++r)
+        jobs.push_back(pool.submit([&run, &layout, r, runs] {
+            return run(layout.chunks * r / runs, layout.chunks * (r + 1) / runs);
+        }));
+    bool ok = true;
+    for (auto &job : jobs) ok = job.get() && ok;
+    return ok;
+}
+
+// An output that failed part way may hold unauthenticated plaintext; leave nothing behind.
+static void discardOutput(const string &path) {
+    error_code ec;
+    filesystem::resize_file(path, 0, ec);
+}
+
+// A run of consecutive chunks, read in one go and processed in parallel. 'in' only holds
+// data when it could not be used straight from a mapping.
+struct Batch {
+    vector<unsigned char> in, out;
+    vector<future<bool>> jobs;
+    uint64_t first = 0; // index of the first chunk
+    size_t chunks = 0;
+    bool last = false;  // holds the file's last chunk
+};
+
+static bool finishJobs(Batch &b) {
+    bool ok = true;
+    for (auto &job : b.jobs) ok = job.get() && ok;
+    b.jobs.clear();
+    return ok;
+}
+
+// Keeps one batch on the pool while the caller reads the next and hands on the previous.
+// 'fill' reads a batch and queues its jobs; 'drain' consumes a finished one, in file order.
+template <typename Fill, typename Drain>
+static bool pipeline(Fill fill, Drain drain) {
+    Batch batches[2];
+    Batch *busy = &batches[0], *spare = &batches[1];
+    if (!fill(*busy)) { finishJobs(*busy); return false; }
+    while (true) {
+        bool more = !busy->last;
+        bool filled = more && fill(*spare);
+        bool ok = finishJobs(*busy) && drain(*busy);
+        if (!ok || (more && !filled)) { finishJobs(*spare); return false; }
+        if (!more) return true;
+        swap(busy, spare);
+    }
+}
+
+// Fallback for files that cannot be mapped: read, seal and write in batches.
+static bool sealStream(ifstream &in, ofstream &out, uint64_t inSize, const unsigned char *key,
+                       const unsigned char *header, size_t threads) {
+    // No more threads than chunks: small files (most saves) should not pay for idle workers.
+    const size_t chunk = DEFAULT_CHUNK_SIZE;
+    ThreadPool pool(size_t(min<uint64_t>(poolSize(threads), max<uint64_t>(1, (inSize + chunk - 1) / chunk))));
+    const size_t perBatch = pool.size() * CHUNKS_PER_THREAD;
+    uint64_t nextChunk = 0;
+    auto fill = [&](Batch &b) {
+        b.in.resize(perBatch * chunk);
+        in.read(reinterpret_cast<char*>(b.in.data()), b.in.size());
+        size_t got = size_t(in.gcount());
+        if (in.bad()) return false;
+        b.in.resize(got);
+        b.last = got < perBatch * chunk || in.peek() == char_traits<char>::eof();
+        b.first = nextChunk;
+        b.chunks = (got + chunk - 1) / chunk;
+        if (b.chunks == 0) b.chunks = 1; // only for an empty file: one empty last chunk
+        nextChunk += b.chunks;
+        b.out.resize(got + b.chunks * TAG_SIZE);
+        for (size_t j = 0; j < b.chunks; ++j) {
+            size_t len = min(chunk, got - j * chunk);
+            const unsigned char *src = b.in.data() + j * chunk;
+            unsigned char *dst = b.out.data() + j * (chunk + TAG_SIZE);
+            bool last = b.last && j + 1 == b.chunks;
+            b.jobs.push_back(pool.submit([key, header, &b, j, src, dst, len, last] {
+                return cryptChunk(true, key, header, V2_HEADER_SIZE, b.first + j, last, src, len, dst);
+            }));
+        }
+        return true;
+    };
+    auto drain = [&](Batch &b) {
+        out.write(reinterpret_cast<const char*>(b.out.data()), b.out.size());
+        return bool(out);
+    };
+    out.write(reinterpret_cast<const char*>(header), V2_HEADER_SIZE);
+    bool ok = pipeline(fill, drain);
+    out.close();
+    return ok && bool(out);
+}
+
+// Header of a new v2 container, with a fresh file salt and nonce prefix, and its key.
+static bool newContainer(string_view password, unsigned char *header, unsigned char *key) {
+    ERR_clear_error();
+    memset(header, 0, V2_HEADER_SIZE);
+    memcpy(header, CHUNKED_MAGIC, sizeof(CHUNKED_MAGIC));
+    header[8] = CHUNKED_V2;
+    for (int i = 0; i < 4; ++i) header[12 + i] = static_cast<unsigned char>(DEFAULT_CHUNK_SIZE >> (8 * i));
+    unsigned char *fileSalt = header + SALT_OFFSET + SALT_SIZE;
+    if (!RAND_bytes(fileSalt, SALT_SIZE) || !RAND_bytes(fileSalt + SALT_SIZE, NONCE_PREFIX_SIZE)) {
+        handleErrors();
+        return false;
+    }
+    unsigned char master[KEY_SIZE];
+    bool keyed = masterKey(password, nullptr, header + SALT_OFFSET, master) && subKey(master, fileSalt, key);
+    OPENSSL_cleanse(master, sizeof(master));
+    return keyed;
+}
+
+bool encryptFile(const string &inPath, const string &outPath, string_view password, size_t threads) {
+    MappedFile src;
+    bool mapped = src.openRead(inPath);
+    if (!mapped && !ifstream(inPath, ios::binary)) return false;
+
+    unsigned char header[V2_HEADER_SIZE], key[KEY_SIZE];
+    if (!newContainer(password, header, key)) return false;
+
+    // The output size is known up front, so the sealed chunks go straight into a mapping of it.
+    bool ok = false, done = false;
+    if (mapped) {
+        ChunkLayout layout = layoutFor(src.size(), DEFAULT_CHUNK_SIZE);
+        MappedFile dst;
+        if (dst.create(outPath, layout.fileSize())) {
+            memcpy(dst.writableData(), header, V2_HEADER_SIZE);
+            ok = cryptMapped(true, src.data(), dst.writableData(), layout, key, header, threads);
+            ok = dst.close() && ok;
+            done = true;
+        }
+        src.close();
+    }
+    if (!done) {
+        ifstream in(inPath, ios::binary);
+        ofstream out(outPath, ios::binary);
+        error_code ec;
+        uint64_t inSize = filesystem::file_size(inPath, ec);
+        ok = in && out && sealStream(in, out, ec ? 0 : inSize, key, header, threads);
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+    if (!ok) discardOutput(outPath);
+    return ok;
+}
+
+bool encryptBuffer(const void *data, size_t len, const string &outPath, string_view password, size_t threads) {
+    unsigned char header[V2_HEADER_SIZE], key[KEY_SIZE];
+    if (!newContainer(password, header, key)) return false;
+    static const unsigned char none = 0;
+    const unsigned char *src = len ? static_cast<const unsigned char*>(data) : &none;
+    ChunkLayout layout = layoutFor(len, DEFAULT_CHUNK_SIZE);
+    bool ok;
+    MappedFile dst;
+    if (dst.create(outPath, layout.fileSize())) {
+        memcpy(dst.writableData(), header, V2_HEADER_SIZE);
+        ok = cryptMapped(true, src, dst.writableData(), layout, key, header, threads);
+        ok = dst.close() && ok;
+    } else {
+        // No mapping: the container is sealed in memory and written in one go.
+        vector<unsigned char> sealed(layout.fileSize());
+        memcpy(sealed.data(), header, V2_HEADER_SIZE);
+        ok = cryptMapped(true, src, sealed.data(), layout, key, header, threads);
+        ofstream out(outPath, ios::binary | ios::trunc);
+        ok = ok && out.write(reinterpret_cast<const char*>(sealed.data()), streamsize(sealed.size()));
+        out.close();
+        ok = ok && bool(out);
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+    if (!ok) discardOutput(outPath);
+    return ok;
+}
+
+// The original format: salt | iv | AES-256-CBC ciphertext, decrypted serially.
+static bool decryptStreamCbc(ifstream &in, string_view password, const PlainSink &sink) {
     // Read salt and iv
     unsigned char salt[SALT_SIZE], iv[IV_SIZE];
     in.read(reinterpret_cast<char*>(salt), SALT_SIZE);
@@ -93,9 +557,6 @@ bool decryptFile(const string &inPath, const string &outPath, const string &pass
     unsigned char key[KEY_SIZE];
     if (!deriveKey(password, salt, key)) return false;
 
-    ofstream out(outPath, ios::binary);
-    if (!out) return false;
-
     ERR_clear_error();
     EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
     if (!ctx) { handleErrors(); return false; }
@@ -103,7 +564,7 @@ bool decryptFile(const string &inPath, const string &outPath, const string &pass
         handleErrors(); EVP_CIPHER_CTX_free(ctx); return false;
     }
 
-    const size_t BUF_SIZE = 4096;
+    const size_t BUF_SIZE = 1 << 20;
     vector<unsigned char> inbuf(BUF_SIZE), outbuf(BUF_SIZE + EVP_CIPHER_block_size(EVP_aes_256_cbc()));
     int outlen;
     while (in) {
@@ -113,15 +574,495 @@ bool decryptFile(const string &inPath, const string &outPath, const string &pass
             if (1 != EVP_DecryptUpdate(ctx, outbuf.data(), &outlen, inbuf.data(), len)) {
                 handleErrors(); EVP_CIPHER_CTX_free(ctx); return false;
             }
-            out.write(reinterpret_cast<char*>(outbuf.data()), outlen);
+            if (outlen > 0 && !sink(outbuf.data(), outlen)) { EVP_CIPHER_CTX_free(ctx); return false; }
         }
     }
     if (1 != EVP_DecryptFinal_ex(ctx, outbuf.data(), &outlen)) {
         handleErrors(); EVP_CIPHER_CTX_free(ctx); return false;
     }
-    out.write(reinterpret_cast<char*>(outbuf.data()), outlen);
     EVP_CIPHER_CTX_free(ctx);
+    return outlen <= 0 || sink(outbuf.data(), outlen);
+}
+
+// Reads and checks the header; false for anything that is neither a chunked file nor a log.
+static bool readHeader(ifstream &in, const string &path, unsigned char *header, ChunkLayout &layout) {
+    error_code ec;
+    uint64_t fileSize = filesystem::file_size(path, ec);
+    if (ec) return false;
+    streamsize want = streamsize(min<uint64_t>(fileSize, MAX_HEADER_SIZE));
+    in.read(reinterpret_cast<char*>(header), want);
+    if (in.gcount() != want) return false;
+    if (isLogHeader(header, fileSize)) {
+        return indexLog(fileSize, [&in](uint64_t pos, unsigned char *len4) {
+            in.seekg(streamoff(pos));
+            return bool(in.read(reinterpret_cast<char*>(len4), 4));
+        }, layout);
+    }
+    return parseHeader(header, fileSize, layout);
+}
+
+// Where chunk ciphertext comes from: the mapped file, or a stream if it could not be mapped.
+struct CipherSource {
+    MappedFile map;
+    ifstream in;
+    bool mapped = false;
+
+    // False for anything that is neither a chunked file nor a sealed log.
+    bool open(const string &path, unsigned char *header, ChunkLayout &layout) {
+        mapped = map.openRead(path);
+        if (mapped) {
+            if (map.size() < V1_HEADER_SIZE) return false;
+            memcpy(header, map.data(), size_t(min<uint64_t>(map.size(), MAX_HEADER_SIZE)));
+            if (isLogHeader(header, map.size())) {
+                const unsigned char *bytes = map.data();
+                return indexLog(map.size(), [bytes](uint64_t pos, unsigned char *len4) {
+                    memcpy(len4, bytes + pos, 4);
+                    return true;
+                }, layout);
+            }
+            return parseHeader(header, map.size(), layout);
+        }
+        in.open(path, ios::binary);
+        return in && readHeader(in, path, header, layout);
+    }
+
+    // Ciphertext of chunks [b.first, b.first + b.chunks); sizes b.out for their plaintext.
+    const unsigned char *chunks(Batch &b, const ChunkLayout &layout) {
+        uint64_t lastChunk = b.first + b.chunks - 1;
+        uint64_t begin = layout.cipherOffset(b.first);
+        uint64_t end = layout.cipherOffset(lastChunk) + layout.plainLen(lastChunk) + TAG_SIZE;
+        b.out.resize(size_t(layout.plainOffset(lastChunk) + layout.plainLen(lastChunk) - layout.plainOffset(b.first)));
+        if (mapped) return map.data() + begin;
+        b.in.resize(size_t(end - begin));
+        in.clear();
+        in.seekg(streamoff(begin));
+        in.read(reinterpret_cast<char*>(b.in.data()), b.in.size());
+        return in.gcount() == streamsize(b.in.size()) ? b.in.data() : nullptr;
+    }
+};
+
+// Queues the opening of the batch's chunks from 'cipher' into b.out, on the pool or (without
+// one) inline, as a single job.
+static void queueOpen(Batch &b, const unsigned char *cipher, ThreadPool *pool, const unsigned char *key,
+                      const unsigned char *header, const ChunkLayout &layout) {
+    uint64_t inBase = layout.cipherOffset(b.first), outBase = layout.plainOffset(b.first);
+    bool ok = true;
+    for (size_t j = 0; j < b.chunks && ok; ++j) {
+        uint64_t index = b.first + j;
+        size_t len = layout.plainLen(index);
+        const unsigned char *src = cipher + (layout.cipherOffset(index) - inBase);
+        unsigned char *dst = b.out.data() + (layout.plainOffset(index) - outBase);
+        bool last = layout.isLast(index);
+        auto job = [key, header, &layout, index, last, src, dst, len] {
+            return cryptChunk(false, key, header, layout.headerSize, index, last, src, len, dst);
+        };
+        if (pool) b.jobs.push_back(pool->submit(job));
+        else ok = job();
+    }
+    if (!pool) {
+        wipeThreadCipher();
+        promise<bool> done;
+        done.set_value(ok);
+        b.jobs.push_back(done.get_future());
+    }
+}
+
+bool decryptStream(const string &inPath, string_view password, const PlainSink &sink) {
+    CipherSource src;
+    unsigned char header[MAX_HEADER_SIZE];
+    ChunkLayout layout;
+    if (!src.open(inPath, header, layout)) {
+        ifstream in(inPath, ios::binary);
+        return in && decryptStreamCbc(in, password, sink);
+    }
+    if (layout.chunks == 0) return true; // a log without records
+    unsigned char key[KEY_SIZE];
+    if (!fileKey(password, header, layout, key)) return false;
+
+    // Log records are too small to be worth a thread each: they are opened inline, in runs of
+    // about a chunk's worth.
+    bool log = !layout.records.empty();
+    unique_ptr<ThreadPool> pool;
+    if (!log) pool = make_unique<ThreadPool>(size_t(min<uint64_t>(poolSize(0), layout.chunks)));
+    const size_t perBatch = log ? 0 : pool->size() * CHUNKS_PER_THREAD;
+    uint64_t nextChunk = 0;
+    auto fill = [&](Batch &b) {
+        b.first = nextChunk;
+        if (log) {
+            uint64_t end = b.first + 1;
+            while (end < layout.chunks && layout.plainOffset(end + 1) - layout.plainOffset(b.first) <= DEFAULT_CHUNK_SIZE)
+                ++end;
+            b.chunks = size_t(end - b.first);
+        } else {
+            b.chunks = size_t(min<uint64_t>(perBatch, layout.chunks - nextChunk));
+        }
+        b.last = b.first + b.chunks == layout.chunks;
+        nextChunk += b.chunks;
+        const unsigned char *cipher = src.chunks(b, layout);
+        if (!cipher) return false;
+        queueOpen(b, cipher, pool.get(), key, header, layout);
+        return true;
+    };
+    auto drain = [&](Batch &b) {
+        if (log) return b.out.empty() || sink(b.out.data(), b.out.size());
+        // Handed on chunk by chunk, only after each has been authenticated.
+        size_t off = 0;
+        for (size_t j = 0; j < b.chunks; ++j) {
+            size_t len = layout.plainLen(b.first + j);
+            if (len > 0 && !sink(b.out.data() + off, len)) return false;
+            off += len;
+        }
+        return true;
+    };
+    bool ok = pipeline(fill, drain);
+    OPENSSL_cleanse(key, sizeof(key));
+    return ok;
+}
+
+bool decryptFile(const string &inPath, const string &outPath, string_view password) {
+    CipherSource src;
+    unsigned char header[MAX_HEADER_SIZE];
+    ChunkLayout layout;
+    if (src.open(inPath, header, layout) && src.mapped && layout.records.empty()) {
+        unsigned char key[KEY_SIZE];
+        if (!fileKey(password, header, layout, key)) return false;
+        // Chunks open straight from the input mapping into an output mapping of the exact size.
+        MappedFile dst;
+        if (dst.create(outPath, layout.plainBytes)) {
+            bool ok = cryptMapped(false, src.map.data(), dst.writableData(), layout, key, header, 0);
+            ok = dst.close() && ok;
+            OPENSSL_cleanse(key, sizeof(key));
+            if (!ok) discardOutput(outPath);
+            return ok;
+        }
+        OPENSSL_cleanse(key, sizeof(key));
+    }
+    src.map.close();
+    if (!ifstream(inPath, ios::binary)) return false;
+    ofstream out(outPath, ios::binary);
+    if (!out) return false;
+    bool ok = decryptStream(inPath, password, [&out](const unsigned char *data, size_t len) {
+        out.write(reinterpret_cast<const char*>(data), len);
+        return bool(out);
+    });
+    out.close();
+    if (!ok || !out) discardOutput(outPath);
+    return ok && bool(out);
+}
+
+bool isChunkedFile(const string &path) {
+    CipherSource src;
+    unsigned char header[MAX_HEADER_SIZE];
+    ChunkLayout layout;
+    return src.open(path, header, layout);
+}
+
+bool isSealedLog(const string &path) {
+    ifstream in(path, ios::binary);
+    unsigned char header[LOG_HEADER_SIZE];
+    error_code ec;
+    uint64_t fileSize = filesystem::file_size(path, ec);
+    return in && !ec && in.read(reinterpret_cast<char*>(header), LOG_HEADER_SIZE) && isLogHeader(header, fileSize);
+}
+
+bool plainSize(const string &path, uint64_t &size) {
+    CipherSource src;
+    unsigned char header[MAX_HEADER_SIZE];
+    ChunkLayout layout;
+    if (src.open(path, header, layout)) {
+        size = layout.plainBytes;
+        return true;
+    }
+    error_code ec;
+    uint64_t fileSize = filesystem::file_size(path, ec);
+    if (ec || fileSize < SALT_SIZE + IV_SIZE) return false;
+    size = fileSize - SALT_SIZE - IV_SIZE;
     return true;
 }
 
+bool readRange(const string &path, string_view password, uint64_t offset, size_t len, string &out) {
+    out.clear();
+    if (isChunkedFile(path)) {
+        ChunkedReader reader;
+        return reader.open(path, password) && reader.read(offset, len, out);
+    }
+    uint64_t pos = 0;
+    bool complete = false;
+    bool ok = decryptStream(path, password, [&](const unsigned char *data, size_t n) {
+        uint64_t begin = max(pos, offset), end = min(pos + n, offset + len);
+        if (begin < end) out.append(reinterpret_cast<const char*>(data) + (begin - pos), size_t(end - begin));
+        pos += n;
+        complete = pos >= offset + len;
+        return !complete; // stop once the range is in
+    });
+    return (ok || complete) && offset <= pos;
+}
+
+ChunkedReader::ChunkedReader() {}
+
+ChunkedReader::~ChunkedReader() {
+    OPENSSL_cleanse(key, sizeof(key));
+}
+
+bool ChunkedReader::open(const string &path, string_view password, size_t threadCount) {
+    source = make_unique<CipherSource>();
+    layout = make_unique<ChunkLayout>();
+    if (!source->open(path, header, *layout) || !fileKey(password, header, *layout, key)) {
+        source.reset();
+        layout.reset();
+        return false;
+    }
+    plainBytes = layout->plainBytes;
+    threads = threadCount;
+    return true;
+}
+
+bool ChunkedReader::read(uint64_t offset, size_t len, string &out) {
+    out.clear();
+    if (!source || offset > plainBytes) return false;
+    len = size_t(min<uint64_t>(len, plainBytes - offset));
+    if (len == 0) return true;
+
+    Batch b;
+    b.first = layout->chunkAt(offset);
+    b.chunks = size_t(layout->chunkAt(offset + len - 1) - b.first + 1);
+    const unsigned char *cipher = source->chunks(b, *layout);
+    if (!cipher) return false;
+    bool parallel = b.chunks > 1 && layout->records.empty(); // log records are opened inline
+    if (parallel && !pool) pool = make_unique<ThreadPool>(poolSize(threads));
+    queueOpen(b, cipher, parallel ? pool.get() : nullptr, key, header, *layout);
+    if (!finishJobs(b)) return false;
+    out.assign(reinterpret_cast<const char*>(b.out.data()) + (offset - layout->plainOffset(b.first)), len);
+    return true;
+}
+
+// Sealed record log. Records are sealed with cryptChunk under the log's own header, never
+// flagged as last.
+SealedLog::SealedLog() {}
+
+SealedLog::~SealedLog() {
+    close();
+}
+
+void SealedLog::close() {
+    if (out.is_open()) out.close();
+    OPENSSL_cleanse(master, sizeof(master));
+    OPENSSL_cleanse(key, sizeof(key));
+    count = 0;
+    isOpen = false;
+}
+
+// Starts an empty log under a fresh file salt and nonce prefix, written aside and renamed
+// over 'path' so a crash leaves either the old log or the new one.
+bool SealedLog::create() {
+    if (out.is_open()) out.close();
+    if (!RAND_bytes(header + SALT_OFFSET + SALT_SIZE, SALT_SIZE + NONCE_PREFIX_SIZE) ||
+        !subKey(master, header + SALT_OFFSET + SALT_SIZE, key))
+        return false;
+    string tmp = path + ".tmp";
+    ofstream f(tmp, ios::binary | ios::trunc);
+    f.write(reinterpret_cast<const char*>(header), LOG_HEADER_SIZE);
+    f.close();
+    if (!f) return false;
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (ec) return false;
+    out.open(path, ios::binary | ios::app);
+    count = 0;
+    return bool(out);
+}
+
+// Re-seals the records 'layout' found in 'bytes' (the log as read) under a fresh file salt
+// and nonce prefix, into 'tmp' for the caller to rename over the log. Used when a record was
+// cut short: its partial ciphertext can still be on disk, so its nonce must never seal
+// anything else.
+bool SealedLog::rewrite(const unsigned char *bytes, const ChunkLayout &layout, const string &tmp) {
+    unsigned char oldHeader[sizeof(header)], oldKey[sizeof(key)];
+    memcpy(oldHeader, header, sizeof(header));
+    memcpy(oldKey, key, sizeof(key));
+    bool ok = RAND_bytes(header + SALT_OFFSET + SALT_SIZE, SALT_SIZE + NONCE_PREFIX_SIZE) &&
+              subKey(master, header + SALT_OFFSET + SALT_SIZE, key);
+    ofstream f(tmp, ios::binary | ios::trunc);
+    f.write(reinterpret_cast<const char*>(header), LOG_HEADER_SIZE);
+    vector<unsigned char> plain, buf;
+    for (uint64_t i = 0; ok && i < layout.chunks; ++i) {
+        size_t len = layout.plainLen(i);
+        plain.resize(len);
+        buf.resize(4 + len + TAG_SIZE);
+        memcpy(buf.data(), bytes + layout.records[i], 4);
+        ok = cryptChunk(false, oldKey, oldHeader, LOG_HEADER_SIZE, i, false, bytes + layout.cipherOffset(i), len,
+                        plain.data()) &&
+             cryptChunk(true, key, header, LOG_HEADER_SIZE, i, false, plain.data(), len, buf.data() + 4);
+        f.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    }
+    wipeThreadCipher();
+    if (!plain.empty()) OPENSSL_cleanse(plain.data(), plain.size());
+    OPENSSL_cleanse(oldKey, sizeof(oldKey));
+    f.close();
+    return ok && bool(f);
+}
+
+bool SealedLog::open(const string &logPath, string_view password, const RecordFn &record) {
+    close();
+    path = logPath;
+    if (!ifstream(path, ios::binary)) {
+        memset(header, 0, sizeof(header));
+        memcpy(header, LOG_MAGIC, sizeof(LOG_MAGIC));
+        header[8] = LOG_VERSION;
+        isOpen = masterKey(password, nullptr, header + SALT_OFFSET, master) && create();
+        if (!isOpen) close();
+        return isOpen;
+    }
+    MappedFile map;
+    string data; // the log, if it cannot be mapped
+    const unsigned char *bytes;
+    uint64_t size;
+    if (map.openRead(path)) {
+        bytes = map.data();
+        size = map.size();
+    } else {
+        ifstream in(path, ios::binary);
+        data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        bytes = reinterpret_cast<const unsigned char*>(data.data());
+        size = data.size();
+    }
+    ChunkLayout layout;
+    if (!isLogHeader(bytes, size) || !indexLog(size, [bytes](uint64_t pos, unsigned char *len4) {
+            memcpy(len4, bytes + pos, 4);
+            return true;
+        }, layout))
+        return false;
+    memcpy(header, bytes, LOG_HEADER_SIZE);
+    if (!masterKey(password, header + SALT_OFFSET, nullptr, master) ||
+        !subKey(master, header + SALT_OFFSET + SALT_SIZE, key)) {
+        close();
+        return false;
+    }
+
+    bool ok = true;
+    if (record) {
+        string plain;
+        for (uint64_t i = 0; ok && i < layout.chunks; ++i) {
+            size_t len = layout.plainLen(i);
+            plain.resize(len);
+            ok = cryptChunk(false, key, header, LOG_HEADER_SIZE, i, false, bytes + layout.cipherOffset(i), len,
+                            reinterpret_cast<unsigned char*>(&plain[0])) && record(plain);
+        }
+        wipeThreadCipher();
+        if (!plain.empty()) OPENSSL_cleanse(&plain[0], plain.size());
+    }
+    count = layout.chunks;
+    bool torn = layout.records.back() < size; // cut short: the tail is dropped
+    string tmp = path + ".tmp";
+    if (ok && torn) ok = rewrite(bytes, layout, tmp);
+    map.close();
+    error_code ec;
+    if (ok && torn) filesystem::rename(tmp, path, ec);
+    else if (torn) filesystem::remove(tmp, ec);
+    ok = ok && !ec;
+    if (ok) out.open(path, ios::binary | ios::app);
+    isOpen = ok && bool(out);
+    if (!isOpen) close();
+    return isOpen;
+}
+
+bool SealedLog::append(string_view record) {
+    return append(vector<string_view>{record});
+}
+
+bool SealedLog::append(const vector<string_view> &records) {
+    if (!isOpen) return false;
+    size_t total = 0;
+    for (string_view r : records) {
+        if (r.size() > MAX_RECORD_SIZE) return false;
+        total += 4 + r.size() + TAG_SIZE;
+    }
+    vector<unsigned char> buf(total);
+    size_t pos = 0;
+    bool ok = true;
+    for (size_t k = 0; ok && k < records.size(); ++k) {
+        string_view r = records[k];
+        for (int i = 0; i < 4; ++i) buf[pos + i] = static_cast<unsigned char>(r.size() >> (8 * i));
+        ok = cryptChunk(true, key, header, LOG_HEADER_SIZE, count + k, false,
+                        reinterpret_cast<const unsigned char*>(r.data()), r.size(), buf.data() + pos + 4);
+        pos += 4 + r.size() + TAG_SIZE;
+    }
+    wipeThreadCipher();
+    if (!ok) return false;
+    out.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    out.flush();
+    if (!out) {
+        close(); // a partial record may be on disk; only a reopen (which re-keys past it) can continue
+        return false;
+    }
+    count += records.size();
+    return true;
+}
+
+bool SealedLog::reset() {
+    if (!isOpen) return false;
+    if (!create()) close();
+    return isOpen;
+}
+
+SealedLogReader::SealedLogReader() {}
+
+SealedLogReader::~SealedLogReader() {
+    close();
+}
+
+void SealedLogReader::close() {
+    if (in.is_open()) in.close();
+    OPENSSL_cleanse(key, sizeof(key));
+    count = 0;
+    offset = 0;
+}
+
+bool SealedLogReader::open(const string &path, string_view password) {
+    close();
+    in.open(path, ios::binary);
+    if (!in.read(reinterpret_cast<char*>(header), LOG_HEADER_SIZE) ||
+        memcmp(header, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || header[8] != LOG_VERSION) {
+        close();
+        return false;
+    }
+    unsigned char master[32];
+    bool ok = masterKey(password, header + SALT_OFFSET, nullptr, master) &&
+              subKey(master, header + SALT_OFFSET + SALT_SIZE, key);
+    OPENSSL_cleanse(master, sizeof(master));
+    if (!ok) {
+        close();
+        return false;
+    }
+    offset = LOG_HEADER_SIZE;
+    return true;
+}
+
+bool SealedLogReader::poll(const SealedLog::RecordFn &record, uint64_t limit) {
+    if (!in.is_open()) return false;
+    vector<unsigned char> cipher;
+    string plain;
+    bool ok = true;
+    for (uint64_t n = 0; n < limit; ++n) {
+        in.clear(); // past the end last time; the writer may have added more since
+        in.seekg(streamoff(offset));
+        unsigned char len4[4];
+        if (!in.read(reinterpret_cast<char*>(len4), 4)) break;
+        uint32_t len = 0;
+        for (int i = 3; i >= 0; --i) len = (len << 8) | len4[i];
+        if (len > MAX_RECORD_SIZE) { ok = false; break; }
+        cipher.resize(size_t(len) + TAG_SIZE);
+        if (!in.read(reinterpret_cast<char*>(cipher.data()), streamsize(cipher.size()))) break; // still being written
+        plain.resize(len);
+        ok = cryptChunk(false, key, header, LOG_HEADER_SIZE, count, false, cipher.data(), len,
+                        reinterpret_cast<unsigned char*>(&plain[0])) && record(plain);
+        if (!ok) break;
+        ++count;
+        offset += 4 + len + TAG_SIZE;
+    }
+    wipeThreadCipher();
+    if (!plain.empty()) OPENSSL_cleanse(&plain[0], plain.size());
+    return ok;
+}
+
 } // namespace CryptoUtils
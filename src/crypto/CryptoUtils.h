@@ -1,10 +1,159 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
+class ThreadPool;
+
+// Files are written as a chunked AES-256-GCM container (version 2):
+//   header  "SBKGCM01" | version u8 | reserved 3 | chunk size u32 LE | salt 16 | file salt 16
+//           | nonce prefix 4
+//   chunks  ciphertext | tag 16, every chunk 'chunk size' bytes of plaintext except the last
+// The key is HMAC-SHA256(PBKDF2(password, salt), file salt). Files written by one run share
+// the PBKDF2 salt and its result is cached, so loading several of them derives it once.
+// (Version 1 has no file salt and uses the PBKDF2 result as the key.) Chunk i uses the nonce
+// prefix || i (u64 BE) and authenticates the header, i and a last-chunk flag, so chunks
+// cannot be reordered, dropped or cut off at the end. An empty file is one empty last chunk.
+// Chunks are sealed and opened in parallel, straight between memory-mapped input and output
+// files where possible, and any byte range can be read by decrypting only the chunks it
+// touches. The original AES-256-CBC files (salt | iv | ciphertext) and version 1 containers
+// are still read everywhere a file is decrypted; they are rewritten as version 2 on save.
+// Every reader below also takes a SealedLog, whose records then play the part of chunks.
 namespace CryptoUtils {
 
-bool encryptFile(const std::string &inPath, const std::string &outPath, const std::string &password);
+constexpr std::uint32_t DEFAULT_CHUNK_SIZE = 1 << 18;
+
+// 'threads' = 0 uses one per core.
+bool encryptFile(const std::string &inPath, const std::string &outPath, std::string_view password,
+                 std::size_t threads = 0);
+
+// Seals 'len' bytes held in memory as 'outPath', as encryptFile would seal them from a file,
+// so plaintext that only exists in memory never has to be written out first.
+bool encryptBuffer(const void *data, std::size_t len, const std::string &outPath, std::string_view password,
+                   std::size_t threads = 0);
+
+bool decryptFile(const std::string &inPath, const std::string &outPath, std::string_view password);
+
+// Decrypts inPath and hands the plaintext to 'sink' chunk by chunk instead of writing a file.
+// Stops early (returning false) if the sink returns false.
+using PlainSink = std::function<bool(const unsigned char *data, std::size_t len)>;
+bool decryptStream(const std::string &inPath, std::string_view password, const PlainSink &sink);
+
+// True for files that can be read from any offset: chunked containers and sealed logs.
+bool isChunkedFile(const std::string &path);
+bool isSealedLog(const std::string &path);
+// Plaintext size without decrypting: exact for chunked files and sealed logs (up to their last
+// complete record), an upper bound for CBC ones.
+bool plainSize(const std::string &path, std::uint64_t &size);
+
+// Replaces 'out' with plaintext bytes [offset, offset + len), clipped at the end of the file.
+// CBC files have to be decrypted from the start up to the range.
+bool readRange(const std::string &path, std::string_view password, std::uint64_t offset, std::size_t len,
+               std::string &out);
+
+// Integrity without secrecy, for JournalChain. macKey derives a 32-byte key for 'purpose'
+// from the password, sharing the containers' PBKDF2 (a null salt picks one and reports it in
+// 'saltOut', as for a new file).
+bool macKey(std::string_view password, const unsigned char *salt, unsigned char *saltOut, std::string_view purpose,
+            unsigned char *key);
+bool hmacSha256(const unsigned char *key, const void *data, std::size_t len, unsigned char *mac);
+// One hash chain step, out = SHA-256(prev || data); 'out' may be 'prev'. Keeps a digest
+// context per thread, so chains of short records do not allocate.
+bool chainStep(const unsigned char *prev, std::string_view data, unsigned char *out);
+
+struct CipherSource;
+struct ChunkLayout;
+
+// Repeated range reads from one chunked file or sealed log; the key is derived once, in open().
+// One reader serves one thread at a time.
+class ChunkedReader {
+public:
+    ChunkedReader();
+    ~ChunkedReader(); // wipes the key
+
+    bool open(const std::string &path, std::string_view password, std::size_t threads = 0);
+    std::uint64_t size() const { return plainBytes; }
+    // Every chunk the range touches is authenticated before any of it is returned.
+    bool read(std::uint64_t offset, std::size_t len, std::string &out);
+
+private:
+    std::unique_ptr<CipherSource> source; // the mapped (or opened) file
+    std::unique_ptr<ChunkLayout> layout;  // where its chunks, or records, are
+    unsigned char header[52];
+    unsigned char key[32];
+    std::uint64_t plainBytes = 0;
+    std::size_t threads = 0;
+    std::unique_ptr<ThreadPool> pool; // created for the first read that spans several chunks
+};
+
+// An append-only file of small records, each sealed on its own, for changes that should not
+// rewrite a whole container:
+//   header  "SBKLOG01" | version u8 | reserved 7 | salt 16 | file salt 16 | nonce prefix 4
+//   record  length u32 LE | ciphertext | tag 16
+// Keys come from the password as for version 2 containers (sharing the cached PBKDF2), and
+// record i is sealed like chunk i of a container, so records cannot be altered or reordered.
+// A record cut short at the end, as a crash in the middle of append() leaves it, is dropped,
+// and the records before it are re-sealed under a new file salt and nonce prefix, so the
+// nonce of the lost record is never used again.
+class SealedLog {
+public:
+    using RecordFn = std::function<bool(const std::string &record)>;
+
+    SealedLog();
+    ~SealedLog(); // wipes the keys
+
+    // Opens 'path' (creating an empty log if there is none) and hands every record to 'record'
+    // in order. False on a wrong password, a damaged record or if 'record' returns false. An
+    // empty 'record' only counts the records, for a log that is appended to and read elsewhere.
+    bool open(const std::string &path, std::string_view password, const RecordFn &record);
+    bool append(std::string_view record); // written and flushed before it returns
+    // Several records in one write and flush.
+    bool append(const std::vector<std::string_view> &records);
+    // Replaces the log with an empty one under a fresh file key.
+    bool reset();
+    void close();
+    bool opened() const { return isOpen; }
+    std::uint64_t records() const { return count; }
+
+private:
+    std::string path;
+    std::ofstream out;
+    unsigned char header[52];
+    unsigned char master[32];
+    unsigned char key[32];
+    std::uint64_t count = 0;
+    bool isOpen = false;
+
+    bool create();
+    bool rewrite(const unsigned char *bytes, const ChunkLayout &layout, const std::string &tmp);
+};
+
+// Follows a SealedLog that another process may still be appending to. Unlike SealedLog::open
+// it never truncates: a record still being written is simply left for the next poll().
+class SealedLogReader {
+public:
+    SealedLogReader();
+    ~SealedLogReader(); // wipes the key
+
+    bool open(const std::string &path, std::string_view password);
+    // Hands the records completed since the last poll to 'record', in order, at most 'limit'
+    // of them. False on a damaged record or if 'record' returns false; true when there is
+    // nothing new.
+    bool poll(const SealedLog::RecordFn &record, std::uint64_t limit = UINT64_MAX);
+    std::uint64_t records() const { return count; }
+    void close();
 
-bool decryptFile(const std::string &inPath, const std::string &outPath, const std::string &password);
+private:
+    std::ifstream in;
+    unsigned char header[52];
+    unsigned char key[32];
+    std::uint64_t count = 0;
+    std::uint64_t offset = 0; // file offset of the next record
+};
 
 }
@@ -0,0 +1,128 @@
+#include "MappedFile.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#if defined(_WIN32)
+
+static bool mapView(HANDLE file, uint64_t size, bool write, void *&mapping, unsigned char *&base) {
+    DWORD protect = write ? PAGE_READWRITE : PAGE_READONLY;
+    mapping = CreateFileMappingA(file, NULL, protect, DWORD(size >> 32), DWORD(size & 0xFFFFFFFFu), NULL);
+    if (!mapping) return false;
+    base = static_cast<unsigned char*>(MapViewOfFile(mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+    return base != nullptr;
+}
+
+bool MappedFile::openRead(const string &path) {
+    close();
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    file = h;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(h, &size)) { close(); return false; }
+    length = uint64_t(size.QuadPart);
+    if (length == 0) return true;
+    if (!mapView(h, length, false, mapping, base)) { close(); return false; }
+    return true;
+}
+
+bool MappedFile::create(const string &path, uint64_t size) {
+    close();
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    file = h;
+    length = size;
+    writable = true;
+    if (length == 0) return true;
+    // Mapping a view larger than the file grows the file to that size.
+    if (!mapView(h, length, true, mapping, base)) { close(); return false; }
+    return true;
+}
+
+bool MappedFile::close(bool durable) {
+    bool ok = true;
+    if (base) {
+        if (durable && writable) ok = FlushViewOfFile(base, 0) != 0;
+        UnmapViewOfFile(base);
+    }
+    if (mapping) CloseHandle(mapping);
+    if (file) {
+        if (durable && writable) ok = FlushFileBuffers(file) != 0 && ok;
+        CloseHandle(file);
+    }
+    base = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    length = 0;
+    writable = false;
+    return ok;
+}
+
+#else
+
+bool MappedFile::openRead(const string &path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(); return false; }
+    length = uint64_t(st.st_size);
+    if (length == 0) return true;
+    void *p = mmap(nullptr, size_t(length), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { close(); return false; }
+    base = static_cast<unsigned char*>(p);
+    madvise(p, size_t(length), MADV_SEQUENTIAL);
+    return true;
+}
+
+bool MappedFile::create(const string &path, uint64_t size) {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return false;
+    length = size;
+    writable = true;
+    if (length == 0) return true;
+    // The blocks are allocated up front: a sparse file that runs out of space while pages are
+    // written through the mapping raises SIGBUS instead of reporting an error.
+#if defined(__APPLE__)
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, off_t(length), 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1 || ftruncate(fd, off_t(length)) != 0) { close(); return false; }
+#else
+    if (posix_fallocate(fd, 0, off_t(length)) != 0) { close(); return false; }
+#endif
+    void *p = mmap(nullptr, size_t(length), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { close(); return false; }
+    base = static_cast<unsigned char*>(p);
+    return true;
+}
+
+bool MappedFile::close(bool durable) {
+    bool ok = true;
+    if (base) {
+        if (durable && writable) ok = msync(base, size_t(length), MS_SYNC) == 0;
+        munmap(base, size_t(length));
+    }
+    if (fd >= 0) {
+        if (durable && writable) ok = fsync(fd) == 0 && ok;
+        ::close(fd);
+    }
+    base = nullptr;
+    fd = -1;
+    length = 0;
+    writable = false;
+    return ok;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped into memory (mmap, or a file mapping on Windows), so the crypto code
+// can work straight from the page cache instead of copying through stream buffers.
+// An empty file is valid and has no mapping (data() is null).
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool openRead(const std::string &path);
+    // Creates (or truncates) 'path' at exactly 'size' bytes, with its disk space allocated, and
+    // maps it for writing. Fails, rather than faulting later, if the space is not there.
+    bool create(const std::string &path, std::uint64_t size);
+    // Unmaps and closes; 'durable' flushes written pages to disk first. False if that fails.
+    bool close(bool durable = false);
+
+    const unsigned char *data() const { return base; }
+    unsigned char *writableData() { return writable ? base : nullptr; }
+    std::uint64_t size() const { return length; }
+
+private:
+    unsigned char *base = nullptr;
+    std::uint64_t length = 0;
+    bool writable = false;
+#if defined(_WIN32)
+    void *file = nullptr;    // HANDLE
+    void *mapping = nullptr; // HANDLE
+#else
+    int fd = -1;
+#endif
+};
@@ -0,0 +1,130 @@
+#include "SecureArena.h"
+#include <openssl/crypto.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static constexpr size_t MIN_SLAB = 64 << 10;
+static constexpr size_t MIN_BLOCKS_PER_SLAB = 8;
+static constexpr size_t LARGE_HEADER = 16; // in front of a large block: whether it is locked
+
+static size_t pageSize() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return size_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+static size_t largeSize(size_t size) {
+    static const size_t page = pageSize();
+    return (size + LARGE_HEADER + page - 1) / page * page;
+}
+
+SecureArena &SecureArena::instance() {
+    static SecureArena *arena = new SecureArena();
+    return *arena;
+}
+
+void *SecureArena::mapPages(size_t size, bool &locked) {
+#if defined(_WIN32)
+    void *p = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!p) throw bad_alloc();
+    locked = VirtualLock(p, size) != 0;
+#else
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw bad_alloc();
+    // Locking is best effort: past RLIMIT_MEMLOCK the pages are still wiped, just swappable.
+    locked = mlock(p, size) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(p, size, MADV_DONTDUMP); // keep them out of core dumps as well
+#endif
+#endif
+    mappedBytes += size;
+    if (locked) lockedBytes += size;
+    return p;
+}
+
+void SecureArena::unmapPages(void *p, size_t size, bool locked) noexcept {
+#if defined(_WIN32)
+    if (locked) VirtualUnlock(p, size);
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    if (locked) munlock(p, size);
+    munmap(p, size);
+#endif
+    mappedBytes -= size;
+    if (locked) lockedBytes -= size;
+}
+
+void *SecureArena::allocate(size_t size) {
+    size = max<size_t>(size, 1);
+    if (size > MAX_BLOCK) {
+        size_t total = largeSize(size);
+        bool locked;
+        unsigned char *base = static_cast<unsigned char*>(mapPages(total, locked));
+        base[0] = locked;
+        inUseBytes += total;
+        return base + LARGE_HEADER;
+    }
+    size_t c = 0;
+    while ((MIN_BLOCK << c) < size) ++c;
+    size_t block = MIN_BLOCK << c;
+    SizeClass &sc = classes[c];
+    FreeBlock *b;
+    {
+        lock_guard<mutex> lk(sc.mtx);
+        if (!sc.free) {
+            size_t slab = max(MIN_SLAB, MIN_BLOCKS_PER_SLAB * block);
+            bool locked;
+            char *p = static_cast<char*>(mapPages(slab, locked));
+            for (size_t off = slab; off >= block; off -= block) {
+                FreeBlock *f = reinterpret_cast<FreeBlock*>(p + off - block);
+                f->next = sc.free;
+                sc.free = f;
+            }
+        }
+        b = sc.free;
+        sc.free = b->next;
+    }
+    b->next = nullptr; // the rest of the block was wiped on release (or is fresh from the OS)
+    inUseBytes += block;
+    return b;
+}
+
+void SecureArena::release(void *p, size_t size) noexcept {
+    if (!p) return;
+    size = max<size_t>(size, 1);
+    if (size > MAX_BLOCK) {
+        unsigned char *base = static_cast<unsigned char*>(p) - LARGE_HEADER;
+        size_t total = largeSize(size);
+        bool locked = base[0] != 0;
+        OPENSSL_cleanse(base, total);
+        unmapPages(base, total, locked);
+        inUseBytes -= total;
+        return;
+    }
+    OPENSSL_cleanse(p, size);
+    size_t c = 0;
+    while ((MIN_BLOCK << c) < size) ++c;
+    FreeBlock *f = static_cast<FreeBlock*>(p);
+    {
+        lock_guard<mutex> lk(classes[c].mtx);
+        f->next = classes[c].free;
+        classes[c].free = f;
+    }
+    inUseBytes -= MIN_BLOCK << c;
+}
+
+SecureArena::Stats SecureArena::stats() const {
+    return Stats{mappedBytes.load(), lockedBytes.load(), inUseBytes.load()};
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Pool allocator for secrets and the records that hold them. Memory comes from the OS in
+// slabs, locked into RAM where the OS allows it (mlock / VirtualLock) so it is not written to
+// swap, and is cut into power-of-two blocks kept on one free list per size. Once the pool has
+// warmed up an allocation is a pop under a lock, with no call into the general heap. Every
+// block is wiped when it is released. Blocks over 64 KB get a locked mapping of their own.
+// Slabs are kept for reuse, never handed back to the OS.
+class SecureArena {
+public:
+    static SecureArena &instance(); // process-wide; never destroyed, so usable from any destructor
+
+    void *allocate(std::size_t size); // throws std::bad_alloc, as allocators must
+    void release(void *p, std::size_t size) noexcept;
+
+    struct Stats {
+        std::size_t mappedBytes; // slabs and large blocks taken from the OS
+        std::size_t lockedBytes; // the part of those the OS agreed to lock
+        std::size_t inUseBytes;  // handed out and not yet released, by block size
+    };
+    Stats stats() const;
+
+private:
+    static constexpr std::size_t MIN_BLOCK = 16;
+    static constexpr std::size_t CLASS_COUNT = 13; // 16 bytes .. 64 KB
+    static constexpr std::size_t MAX_BLOCK = MIN_BLOCK << (CLASS_COUNT - 1);
+
+    struct FreeBlock { FreeBlock *next; };
+    struct SizeClass {
+        std::mutex mtx;
+        FreeBlock *free = nullptr;
+    };
+    SizeClass classes[CLASS_COUNT];
+    std::atomic<std::size_t> mappedBytes{0}, lockedBytes{0}, inUseBytes{0};
+
+    SecureArena() = default;
+    void *mapPages(std::size_t size, bool &locked);
+    void unmapPages(void *p, std::size_t size, bool locked) noexcept;
+};
+
+// Standard allocator over SecureArena, for containers and strings that hold secrets.
+template <typename T>
+struct SecureAllocator {
+    using value_type = T;
+
+    SecureAllocator() noexcept = default;
+    template <typename U> SecureAllocator(const SecureAllocator<U>&) noexcept {}
+
+    T *allocate(std::size_t n) { return static_cast<T*>(SecureArena::instance().allocate(n * sizeof(T))); }
+    void deallocate(T *p, std::size_t n) noexcept { SecureArena::instance().release(p, n * sizeof(T)); }
+
+    template <typename U> bool operator==(const SecureAllocator<U>&) const noexcept { return true; }
+    template <typename U> bool operator!=(const SecureAllocator<U>&) const noexcept { return false; }
+};
+
+// Characters past the small-string buffer live in the arena and are wiped when freed. Short
+// strings sit inside the string object itself, so keep those objects in arena memory too
+// (e.g. in a container using SecureAllocator) where it matters.
+using SecureString = std::basic_string<char, std::char_traits<char>, SecureAllocator<char>>;
+
+// std::hash has no specialization for strings with their own allocator; this one hashes the
+// characters as std::string does, for unordered containers keyed by SecureString.
+struct SecureStringHash {
+    std::size_t operator()(const SecureString &s) const noexcept {
+        return std::hash<std::string_view>()(std::string_view(s.data(), s.size()));
+    }
+};
@@ -0,0 +1,191 @@
+#include "AccountTableModel.h"
+#include <algorithm>
+#include <cctype>
+using namespace std;
+
+static constexpr int FETCH_BATCH = 256;
+
+AccountTableModel::AccountTableModel(Bank *bank, QObject *parent)
+    : QAbstractTableModel(parent), bank(bank) {
+    rebuild();
+}
+
+int AccountTableModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : fetched;
+}
+
+int AccountTableModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : 3;
+}
+
+int AccountTableModel::positionAt(int row) const {
+    return identity ? row : order[row];
+}
+
+QVariant AccountTableModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole || index.row() >= fetched) return {};
+    int pos = positionAt(index.row());
+    if (pos >= int(accounts->size())) return {};
+    const BankAccount &acc = (*accounts)[pos];
+    switch (index.column()) {
+    case 0: return acc.getAccountNumber();
+    case 1: return QString::fromUtf8(acc.getHolderName().data(), int(acc.getHolderName().size()));
+    case 2: return acc.getBalance();
+    }
+    return {};
+}
+
+QVariant AccountTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return {};
+    switch (section) {
+    case 0: return QStringLiteral("Account No");
+    case 1: return QStringLiteral("Holder");
+    case 2: return QStringLiteral("Balance");
+    }
+    return {};
+}
+
+bool AccountTableModel::canFetchMore(const QModelIndex &parent) const {
+    return !parent.isValid() && (fetched < total || moreNames);
+}
+
+void AccountTableModel::fetchMore(const QModelIndex &parent) {
+    if (parent.isValid()) return;
+    if (fetched == total && moreNames) readNames();
+    int n = min(FETCH_BATCH, total - fetched);
+    if (n <= 0) return;
+    beginInsertRows(QModelIndex(), fetched, fetched + n - 1);
+    fetched += n;
+    endInsertRows();
+}
+
+void AccountTableModel::sort(int column, Qt::SortOrder order) {
+    sortColumn = column;
+    sortOrder = order;
+    reload();
+}
+
+void AccountTableModel::setFilter(const QString &text) {
+    string f = text.trimmed().toLower().toStdString();
+    if (f == filter) return;
+    filter = f;
+    reload();
+}
+
+void AccountTableModel::reload() {
+    beginResetModel();
+    rebuild();
+    endResetModel();
+}
+
+void AccountTableModel::applyChange(const ChangeEvent &ev) {
+    accounts = bank->accountsSnapshot();
+    if (ev.kind == ChangeEvent::Reset || (!identity && ev.kind != ChangeEvent::BalanceChanged)) {
+        reload();
+        return;
+    }
+    int pos = int(ev.position);
+    switch (ev.kind) {
+    case ChangeEvent::AccountCreated:
+        // Appended at the end of the bank's table.
+        ++total;
+        if (fetched == total - 1) {
+            beginInsertRows(QModelIndex(), fetched, fetched);
+            ++fetched;
+            endInsertRows();
+        }
+        break;
+    case ChangeEvent::AccountDeleted:
+        // The last account moved into 'pos' and the table shrank by one.
+        --total;
+        if (fetched > total) {
+            beginRemoveRows(QModelIndex(), total, total);
+            --fetched;
+            endRemoveRows();
+        }
+        if (pos < fetched) emit dataChanged(index(pos, 0), index(pos, 2));
+        break;
+    case ChangeEvent::BalanceChanged: {
+        int row = identity ? pos : (pos < int(rowOfPosition.size()) ? rowOfPosition[pos] : -1);
+        if (row >= 0 && row < fetched) emit dataChanged(index(row, 2), index(row, 2));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int AccountTableModel::accountNumberAt(int row) const {
+    if (row < 0 || row >= fetched) return -1;
+    int pos = positionAt(row);
+    return pos < int(accounts->size()) ? (*accounts)[pos].getAccountNumber() : -1;
+}
+
+// The next page of name matches, from where the last one stopped. Each page comes with the
+// table it was read from; only balances can have changed since the previous page, because a
+// create or delete queues a reload.
+void AccountTableModel::readNames() {
+    HolderQuery query;
+    query.mode = HolderQuery::Prefix;
+    query.text = filter;
+    query.limit = FETCH_BATCH;
+    query.after = nameCursor;
+    Bank::HolderPage page;
+    bank->searchHolders(query, page);
+    accounts = page.view;
+    nameCursor = page.next;
+    moreNames = page.more;
+    rowOfPosition.resize(accounts->size(), -1);
+    for (size_t pos : page.positions) {
+        rowOfPosition[pos] = int(order.size());
+        order.push_back(int(pos));
+    }
+    total = int(order.size());
+}
+
+void AccountTableModel::rebuild() {
+    bool byNumber = all_of(filter.begin(), filter.end(), [](char c) { return isdigit(static_cast<unsigned char>(c)); });
+    order.clear();
+    rowOfPosition.clear();
+    nameCursor = HolderIndex::Key();
+    moreNames = false;
+    identity = filter.empty() && sortColumn < 0;
+    if (!byNumber) {
+        // Names go through the bank's holder index a page at a time, in name order; sorting
+        // by a column needs every match, so then all the pages are read up front.
+        readNames();
+        while (moreNames && sortColumn >= 0) readNames();
+    } else {
+        accounts = bank->accountsSnapshot();
+    }
+    const auto &view = *accounts;
+    if (identity) {
+        total = int(view.size());
+    } else if (!byNumber && sortColumn < 0) {
+        // readNames() has set order, rowOfPosition and total.
+    } else {
+        if (byNumber) {
+            order.reserve(view.size());
+            for (int i = 0; i < int(view.size()); ++i) {
+                if (!filter.empty() && to_string(view[i].getAccountNumber()).find(filter) == string::npos) continue;
+                order.push_back(i);
+            }
+        }
+        if (sortColumn >= 0) {
+            auto less = [&](int a, int b) {
+                const BankAccount &x = view[a], &y = view[b];
+                switch (sortColumn) {
+                case 1: return x.getHolderName() < y.getHolderName();
+                case 2: return x.getBalance() < y.getBalance();
+                default: return x.getAccountNumber() < y.getAccountNumber();
+                }
+            };
+            if (sortOrder == Qt::AscendingOrder) stable_sort(order.begin(), order.end(), less);
+            else stable_sort(order.begin(), order.end(), [&](int a, int b) { return less(b, a); });
+        }
+        total = int(order.size());
+        rowOfPosition.assign(view.size(), -1);
+        for (int r = 0; r < total; ++r) rowOfPosition[order[r]] = r;
+    }
+    fetched = min(FETCH_BATCH, total);
+}
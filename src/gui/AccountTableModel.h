@@ -0,0 +1,52 @@
+#pragma once
+#include <QAbstractTableModel>
+#include "../core/Bank.h"
+#include "../core/ChangeFeed.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+// Read-only view over the bank's accounts. Cells are produced on demand from a snapshot of
+// the bank's table, taken again on every reload and change, so painting never waits for the
+// bank; rows are handed to the view in batches (fetchMore), and sorting/filtering only
+// permute account positions; nothing is copied out of the bank.
+class AccountTableModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    explicit AccountTableModel(Bank *bank, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    void setFilter(const QString &text);
+    void reload();
+    // Patches the affected rows only. In identity order every event is O(1); when sorted or
+    // filtered, balance changes are patched and creates/deletes fall back to reload().
+    void applyChange(const ChangeEvent &ev);
+    int accountNumberAt(int row) const; // -1 if out of range
+
+private:
+    Bank *bank;
+    shared_ptr<const Bank::AccountsView> accounts;
+    // Positions into 'accounts'. Left empty while unsorted and unfiltered,
+    // in which case row i is simply position i.
+    vector<int> order;
+    vector<int> rowOfPosition; // inverse of order, -1 where filtered out
+    bool identity = true;
+    int total = 0;
+    int fetched = 0;
+    string filter; // lower-cased
+    HolderIndex::Key nameCursor; // where the next page of name matches starts
+    bool moreNames = false;      // name matches not read yet
+    int sortColumn = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+
+    int positionAt(int row) const;
+    void readNames();
+    void rebuild();
+};
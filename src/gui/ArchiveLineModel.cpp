@@ -0,0 +1,28 @@
+#include "ArchiveLineModel.h"
+#include "../archive/ArchivePager.h"
+#include <algorithm>
+#include <climits>
+#include <string>
+using namespace std;
+
+ArchiveLineModel::ArchiveLineModel(ArchivePager *pager, QObject *parent)
+    : QAbstractListModel(parent), pager(pager) {}
+
+int ArchiveLineModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : rows;
+}
+
+QVariant ArchiveLineModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole || index.row() >= rows) return {};
+    string text;
+    if (!pager->line(uint64_t(index.row()), text)) return {};
+    return QString::fromStdString(text);
+}
+
+void ArchiveLineModel::setIndexedLines(qint64 lines) {
+    int target = int(min<qint64>(lines, INT_MAX));
+    if (target <= rows) return;
+    beginInsertRows(QModelIndex(), rows, target - 1);
+    rows = target;
+    endInsertRows();
+}
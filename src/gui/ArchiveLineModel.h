@@ -0,0 +1,24 @@
+#pragma once
+#include <QAbstractListModel>
+using namespace std;
+
+class ArchivePager;
+
+// One row per archived log line. Rows are read through the pager when the view paints
+// them, so only the pages on screen (and the pager's cache) are ever decoded. The row count
+// follows the pager's background line index.
+class ArchiveLineModel : public QAbstractListModel {
+    Q_OBJECT
+public:
+    explicit ArchiveLineModel(ArchivePager *pager, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Appends the rows for lines the index has reached since the last call.
+    void setIndexedLines(qint64 lines);
+
+private:
+    ArchivePager *pager;
+    int rows = 0;
+};
@@ -0,0 +1,124 @@
+#include "ArchiveViewerDialog.h"
+#include "ArchiveLineModel.h"
+#include "../archive/ArchivePager.h"
+#include <QFontDatabase>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListView>
+#include <QPushButton>
+#include <QVBoxLayout>
+#include <algorithm>
+using namespace std;
+
+ArchiveViewerDialog::ArchiveViewerDialog(QWidget *parent)
+    : QDialog(parent), pager(make_unique<ArchivePager>()) {
+    setWindowTitle("Archived Log Contents");
+    resize(900, 600);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QHBoxLayout *searchLayout = new QHBoxLayout();
+    searchEdit = new QLineEdit(this);
+    searchEdit->setPlaceholderText("Search");
+    findBtn = new QPushButton("Find Next", this);
+    searchLayout->addWidget(searchEdit);
+    searchLayout->addWidget(findBtn);
+    layout->addLayout(searchLayout);
+
+    model = new ArchiveLineModel(pager.get(), this);
+    view = new QListView(this);
+    view->setModel(model);
+    view->setUniformItemSizes(true); // lets the view size millions of rows without asking for them
+    view->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    view->setSelectionMode(QAbstractItemView::SingleSelection);
+    layout->addWidget(view);
+
+    QHBoxLayout *bottomLayout = new QHBoxLayout();
+    status = new QLabel(this);
+    QPushButton *closeBtn = new QPushButton("Close", this);
+    bottomLayout->addWidget(status, 1);
+    bottomLayout->addWidget(closeBtn);
+    layout->addLayout(bottomLayout);
+
+    connect(closeBtn, &QPushButton::clicked, this, &QDialog::accept);
+    connect(searchEdit, &QLineEdit::textEdited, this, &ArchiveViewerDialog::onSearchEdited);
+    connect(searchEdit, &QLineEdit::returnPressed, this, &ArchiveViewerDialog::onFindNext);
+    connect(findBtn, &QPushButton::clicked, this, &ArchiveViewerDialog::onFindNext);
+    connect(this, &ArchiveViewerDialog::indexProgressed, this, &ArchiveViewerDialog::onIndexProgressed,
+            Qt::QueuedConnection);
+    connect(this, &ArchiveViewerDialog::searchFinished, this, &ArchiveViewerDialog::onSearchFinished,
+            Qt::QueuedConnection);
+}
+
+ArchiveViewerDialog::~ArchiveViewerDialog() {
+    pager.reset();
+}
+
+bool ArchiveViewerDialog::openArchive(const QString &path) {
+    if (!pager->open(path.toStdString())) return false;
+    setWindowTitle("Archived Log Contents - " + path);
+    status->setText("Indexing...");
+    pager->buildIndex([this](uint64_t lines, bool finished) {
+        emit indexProgressed(qint64(lines), finished);
+    });
+    return true;
+}
+
+void ArchiveViewerDialog::showStatus(qint64 lines) {
+    status->setText(indexed ? QString("%1 lines").arg(lines) : QString("Indexing... %1 lines").arg(lines));
+}
+
+void ArchiveViewerDialog::onIndexProgressed(qint64 lines, bool finished) {
+    indexed = finished;
+    model->setIndexedLines(lines);
+    if (pendingJump >= 0 && pendingJump < model->rowCount()) jumpTo(pendingJump);
+    else if (pendingJump < 0) showStatus(lines);
+}
+
+void ArchiveViewerDialog::startSearch(qint64 fromLine) {
+    QString text = searchEdit->text();
+    pendingJump = -1;
+    if (text.isEmpty()) {
+        pager->cancelSearch();
+        showStatus(model->rowCount());
+        return;
+    }
+    quint64 id = ++searchId;
+    status->setText("Searching...");
+    pager->search(text.toStdString(), uint64_t(max<qint64>(fromLine, 0)), [this, id](int64_t line) {
+        emit searchFinished(qint64(line), id);
+    });
+}
+
+// Typing refines the current match, so the search starts at the selected line itself.
+void ArchiveViewerDialog::onSearchEdited() {
+    QModelIndex current = view->currentIndex();
+    startSearch(current.isValid() ? current.row() : 0);
+}
+
+void ArchiveViewerDialog::onFindNext() {
+    QModelIndex current = view->currentIndex();
+    startSearch(current.isValid() ? current.row() + 1 : 0);
+}
+
+void ArchiveViewerDialog::onSearchFinished(qint64 line, quint64 id) {
+    if (id != searchId) return;
+    if (line < 0) {
+        status->setText("No matches.");
+        return;
+    }
+    jumpTo(line);
+}
+
+void ArchiveViewerDialog::jumpTo(qint64 line) {
+    if (line >= model->rowCount()) {
+        // Found past the end of the index; the view catches up once the index gets there.
+        pendingJump = line;
+        status->setText(QString("Match at line %1, still indexing...").arg(line + 1));
+        return;
+    }
+    pendingJump = -1;
+    QModelIndex index = model->index(int(line));
+    view->setCurrentIndex(index);
+    view->scrollTo(index, QAbstractItemView::PositionAtCenter);
+    status->setText(QString("Match at line %1").arg(line + 1));
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <QDialog>
+#include <memory>
+using namespace std;
+
+class ArchivePager;
+class ArchiveLineModel;
+class QListView;
+class QLineEdit;
+class QPushButton;
+class QLabel;
+
+// Pages through an archive of any size: lines are decoded on demand as they scroll into view,
+// the line index grows in the background, and searches run off the UI thread.
+class ArchiveViewerDialog : public QDialog {
+    Q_OBJECT
+public:
+    explicit ArchiveViewerDialog(QWidget *parent = nullptr);
+    ~ArchiveViewerDialog(); // stops the pager's threads before the widgets go away
+
+    bool openArchive(const QString &path); // false if the archive cannot be read
+
+signals:
+    // Emitted from the pager's threads; connected queued so the slots run on the UI thread.
+    void indexProgressed(qint64 lines, bool finished);
+    void searchFinished(qint64 line, quint64 searchId);
+
+private slots:
+    void onIndexProgressed(qint64 lines, bool finished);
+    void onSearchFinished(qint64 line, quint64 searchId);
+    void onSearchEdited();
+    void onFindNext();
+
+private:
+    unique_ptr<ArchivePager> pager;
+    ArchiveLineModel *model = nullptr;
+    QListView *view;
+    QLineEdit *searchEdit;
+    QPushButton *findBtn;
+    QLabel *status;
+    quint64 searchId = 0; // results of older searches are ignored
+    qint64 pendingJump = -1; // a match the index has not reached yet
+    bool indexed = false;
+
+    void startSearch(qint64 fromLine);
+    void jumpTo(qint64 line);
+    void showStatus(qint64 lines);
+};
@@ -1,45 +1,73 @@
 #include "MainWindow.h"
+#include "AccountTableModel.h"
+#include "VaultTableModel.h"
+#include "ArchiveViewerDialog.h"
+#include "StartupLoader.h"
+#include "../archive/ArchiveJob.h"
+#include "../archive/ArchiveCatalog.h"
+#include "../replication/ReplicationPrimary.h"
 #include <QTabWidget>
-#include <QTableWidget>
+#include <QTableView>
+#include <QHeaderView>
+#include <QLineEdit>
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QProgressDialog>
+#include <QFormLayout>
+#include <QDialogButtonBox>
+#include <QPlainTextEdit>
+#include <QLabel>
+#include <atomic>
 #include <filesystem>
 #include <chrono>
 #include <thread>
-#include <QTextEdit> 
 #include <QDialog>  
 #include <fstream>   
+#include <cstdlib>
 
 #include"../crypto/CryptoUtils.h"
-#include "../compression/Huffman.h"
 
 using namespace std;
 
 MainWindow::MainWindow(const QString &masterPwd, QWidget *parent)
-    : QMainWindow(parent), masterPassword(masterPwd) {
+    : QMainWindow(parent) {
+    QByteArray utf8 = masterPwd.toUtf8();
+    masterPassword.assign(utf8.constData(), size_t(utf8.size()));
+    utf8.fill('\0');
     // Initialize backend: data files in working directory
     QString dataFile = "accounts.dat";
     QString logFile = "transactions.dat";
     QString vaultFile = "vault.dat";
-    bank = make_unique<Bank>(dataFile.toStdString(), logFile.toStdString(), masterPwd.toStdString());
-    pwdMgr = make_unique<PasswordManager>(vaultFile.toStdString(), masterPwd.toStdString());
-    bool ok1 = bank->load();
-    bool ok2 = pwdMgr->load();
-    if (!ok1) {
-        QMessageBox::warning(this, "Error", "Failed to load bank data. Starting fresh.");
-    }
-    if (!ok2) {
-        QMessageBox::warning(this, "Error", "Failed to load vault. Starting fresh.");
-    }
+    QString catalogFile = "archives.cat";
+    bank = make_unique<Bank>(dataFile.toStdString(), logFile.toStdString(), masterPassword);
+    pwdMgr = make_unique<PasswordManager>(vaultFile.toStdString(), masterPassword);
+    archiveCatalog = make_unique<ArchiveCatalog>(catalogFile.toStdString());
+    // Optional: without shared memory the app works the same, just unmonitored.
+    accountMirror = make_unique<AccountTablePublisher>(*bank);
+    accountMirror->start();
+    // The window comes up at once with the tabs disabled; each fills in as its data arrives.
+    // Models are built over the still-empty stores first, so nothing reads them mid-load.
     setupUI();
-    loadData();
+    connect(this, &MainWindow::startupStageFinished, this, &MainWindow::onStartupStageFinished,
+            Qt::QueuedConnection);
+    startup = make_unique<StartupLoader>(*bank, *pwdMgr, *archiveCatalog);
+    startup->start([this](StartupLoader::Stage stage, bool ok) { emit startupStageFinished(int(stage), ok); });
 }
 
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow() {
+    // Let queued bank jobs (pending saves) finish while the window is still intact.
+    // Start-up stages, a running archive job, the account mirror and replication hold references
+    // to the bank, so they go first.
+    startup.reset();
+    archiveJob.reset();
+    accountMirror.reset();
+    replication.reset();
+    bank.reset();
+}
 
 void MainWindow::setupUI() {
     tabs = new QTabWidget(this);
@@ -48,10 +76,16 @@ void MainWindow::setupUI() {
     // Accounts Tab
     accountsTab = new QWidget(this);
     QVBoxLayout *accLayout = new QVBoxLayout(accountsTab);
-    accountsTable = new QTableWidget(this);
-    accountsTable->setColumnCount(3);
-    accountsTable->setHorizontalHeaderLabels({"Account No", "Holder", "Balance"});
-    accLayout->addWidget(accountsTable);
+    accountsStatus = new QLabel("Loading accounts...", this);
+    accLayout->addWidget(accountsStatus);
+    accountsFilter = new QLineEdit(this);
+    accountsFilter->setPlaceholderText("Filter by holder or account number");
+    accLayout->addWidget(accountsFilter);
+    accountsModel = new AccountTableModel(bank.get(), this);
+    accountsView = new QTableView(this);
+    setupTableView(accountsView, accountsModel);
+    accLayout->addWidget(accountsView);
+    connect(accountsFilter, &QLineEdit::textChanged, accountsModel, &AccountTableModel::setFilter);
     QHBoxLayout *accBtnLayout = new QHBoxLayout();
     addAccBtn = new QPushButton("Add Account", this);
     depositBtn = new QPushButton("Deposit", this);
@@ -61,17 +95,28 @@ void MainWindow::setupUI() {
     accBtnLayout->addWidget(withdrawBtn);
     accLayout->addLayout(accBtnLayout);
     tabs->addTab(accountsTab, "Accounts");
+    accountsTab->setEnabled(false);
     connect(addAccBtn, &QPushButton::clicked, this, &MainWindow::onAddAccount);
     connect(depositBtn, &QPushButton::clicked, this, &MainWindow::onDeposit);
     connect(withdrawBtn, &QPushButton::clicked, this, &MainWindow::onWithdraw);
+    connect(this, &MainWindow::bankOperationFinished, this, &MainWindow::onBankOperationFinished,
+            Qt::QueuedConnection);
+    connect(this, &MainWindow::accountsChanged, this, &MainWindow::onAccountsChanged, Qt::QueuedConnection);
+    accountFeed = bank->subscribe(4096, [this] { emit accountsChanged(); });
 
     // Vault Tab
     vaultTab = new QWidget(this);
     QVBoxLayout *vaultLayout = new QVBoxLayout(vaultTab);
-    vaultTable = new QTableWidget(this);
-    vaultTable->setColumnCount(3);
-    vaultTable->setHorizontalHeaderLabels({"Service", "Username", "Password"});
-    vaultLayout->addWidget(vaultTable);
+    vaultStatus = new QLabel("Loading vault...", this);
+    vaultLayout->addWidget(vaultStatus);
+    vaultFilter = new QLineEdit(this);
+    vaultFilter->setPlaceholderText("Filter by service or username");
+    vaultLayout->addWidget(vaultFilter);
+    vaultModel = new VaultTableModel(pwdMgr.get(), this);
+    vaultView = new QTableView(this);
+    setupTableView(vaultView, vaultModel);
+    vaultLayout->addWidget(vaultView);
+    connect(vaultFilter, &QLineEdit::textChanged, vaultModel, &VaultTableModel::setFilter);
     QHBoxLayout *vaultBtnLayout = new QHBoxLayout();
     addVaultBtn = new QPushButton("Add Entry", this);
     delVaultBtn = new QPushButton("Delete Entry", this);
@@ -79,6 +124,7 @@ void MainWindow::setupUI() {
     vaultBtnLayout->addWidget(delVaultBtn);
     vaultLayout->addLayout(vaultBtnLayout);
     tabs->addTab(vaultTab, "Password Vault");
+    vaultTab->setEnabled(false);
     connect(addVaultBtn, &QPushButton::clicked, this, &MainWindow::onAddVaultEntry);
     connect(delVaultBtn, &QPushButton::clicked, this, &MainWindow::onDeleteVaultEntry);
 
@@ -87,87 +133,149 @@ void MainWindow::setupUI() {
     QVBoxLayout *logLayout = new QVBoxLayout(logsTab);
     archiveBtn = new QPushButton("Archive Transaction Logs", this);
     viewArchiveBtn = new QPushButton("View Archived Log", this);
+    searchArchivesBtn = new QPushButton("Search Archives", this);
     logLayout->addWidget(archiveBtn);
     logLayout->addWidget(viewArchiveBtn);
+    logLayout->addWidget(searchArchivesBtn);
+    logLayout->addWidget(new QLabel("Recent transactions:", this));
+    recentLog = new QPlainTextEdit(this);
+    recentLog->setReadOnly(true);
+    recentLog->setPlaceholderText("Loading recent transactions...");
+    logLayout->addWidget(recentLog);
     tabs->addTab(logsTab, "Logs");
+    // Archiving registers into the catalog, so both wait for it.
+    archiveBtn->setEnabled(false);
+    searchArchivesBtn->setEnabled(false);
     connect(archiveBtn, &QPushButton::clicked, this, &MainWindow::onArchiveLogs);
     connect(viewArchiveBtn, &QPushButton::clicked, this, &MainWindow::onViewArchive);
+    connect(searchArchivesBtn, &QPushButton::clicked, this, &MainWindow::onSearchArchives);
+    connect(this, &MainWindow::archiveProgressed, this, &MainWindow::onArchiveProgressed, Qt::QueuedConnection);
+    connect(this, &MainWindow::archiveFinished, this, &MainWindow::onArchiveFinished, Qt::QueuedConnection);
 }
 
-void MainWindow::loadData() {
-    // Populate accounts table
-    onRefreshAccounts();
-    // Populate vault
-    onRefreshVault();
+void MainWindow::setupTableView(QTableView *view, QAbstractItemModel *model) {
+    view->setModel(model);
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setSelectionMode(QAbstractItemView::SingleSelection);
+    // Start in engine order; a header click sorts inside the model.
+    view->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+    view->setSortingEnabled(true);
 }
 
-void MainWindow::onRefreshAccounts() {
-    const auto &accounts = bank->getAllAccounts();
-    accountsTable->setRowCount(int(accounts.size()));
-    for (int i = 0; i < int(accounts.size()); ++i) {
-        auto &acc = accounts[i];
-        accountsTable->setItem(i, 0, new QTableWidgetItem(QString::number(acc.getAccountNumber())));
-        accountsTable->setItem(i, 1, new QTableWidgetItem(QString::fromStdString(acc.getHolderName())));
-        accountsTable->setItem(i, 2, new QTableWidgetItem(QString::number(acc.getBalance())));
+void MainWindow::onStartupStageFinished(int stage, bool ok) {
+    switch (StartupLoader::Stage(stage)) {
+    case StartupLoader::Accounts:
+        // The bank's Reset event has already been queued and reloads the table.
+        accountsStatus->hide();
+        accountsTab->setEnabled(true);
+        if (!ok) QMessageBox::warning(this, "Error", "Failed to load bank data. Starting fresh.");
+        // Log shipping to a warm standby (bank_replica standby <dir>), once the accounts are in.
+        if (const char *dir = getenv("SBANK_REPLICATION_DIR")) {
+            replication = make_unique<ReplicationPrimary>(*bank, dir, masterPassword);
+            if (!replication->start()) {
+                replication.reset();
+                QMessageBox::warning(this, "Replication", QString("Cannot ship changes to %1.").arg(dir));
+            }
+        }
+        break;
+    case StartupLoader::Journal: {
+        if (!ok) {
+            recentLog->setPlaceholderText("Could not read the transaction log.");
+            break;
+        }
+        QStringList lines;
+        for (const Transaction &tr : startup->journalTail()) {
+            lines << QString("%1  %2  %3  account %4").arg(QString::fromStdString(tr.timestamp),
+                                                         QString::fromStdString(tr.type))
+                         .arg(tr.amount, 0, 'f', 2).arg(tr.relatedAccount);
+        }
+        recentLog->setPlainText(lines.join('\n'));
+        recentLog->setPlaceholderText("No transactions yet.");
+        break;
+    }
+    case StartupLoader::Vault:
+        vaultStatus->hide();
+        vaultTab->setEnabled(true);
+        onRefreshVault();
+        if (!ok) QMessageBox::warning(this, "Error", "Failed to load vault. Starting fresh.");
+        break;
+    case StartupLoader::Catalog:
+        archiveBtn->setEnabled(!archiveJob);
+        searchArchivesBtn->setEnabled(true);
+        if (!ok) QMessageBox::warning(this, "Error", "Failed to load the archive catalog. Starting a new one.");
+        break;
+    default:
+        break;
     }
 }
 
+void MainWindow::onRefreshAccounts() {
+    accountsModel->reload();
+}
+
 void MainWindow::onAddAccount() {
     bool ok;
     QString holder = QInputDialog::getText(this, "Add Account", "Holder Name:", QLineEdit::Normal, "", &ok);
     if (!ok || holder.isEmpty()) return;
     double initDep = QInputDialog::getDouble(this, "Initial Deposit", "Amount:", 0.0, 0.0, 1e12, 2, &ok);
     if (!ok) return;
-    BankAccount* acc = bank->createAccount(holder.toStdString(), initDep);
-    if (acc) {
-        bank->save();
-        onRefreshAccounts();
-    } else {
-        QMessageBox::warning(this, "Error", "Failed to create account.");
-    }
+    bank->createAccountAsync(holder.toStdString(), initDep, [this](int accNo) {
+        emit bankOperationFinished(accNo >= 0, "Failed to create account.");
+    });
+    saveBankAsync();
 }
 
 void MainWindow::onDeposit() {
-    QModelIndexList sel = accountsTable->selectionModel()->selectedRows();
+    QModelIndexList sel = accountsView->selectionModel()->selectedRows();
     if (sel.empty()) { QMessageBox::information(this, "Info", "Select an account row."); return; }
-    int row = sel.first().row();
-    int accNo = accountsTable->item(row, 0)->text().toInt();
+    int accNo = accountsModel->accountNumberAt(sel.first().row());
     bool ok;
     double amt = QInputDialog::getDouble(this, "Deposit", "Amount:", 0.0, 0.01, 1e12, 2, &ok);
     if (!ok) return;
-    if (bank->deposit(accNo, amt)) {
-        bank->save();
-        onRefreshAccounts();
-    } else {
-        QMessageBox::warning(this, "Error", "Deposit failed.");
-    }
+    bank->depositAsync(accNo, amt, [this](bool succeeded) {
+        emit bankOperationFinished(succeeded, "Deposit failed.");
+    });
+    saveBankAsync();
 }
 
 void MainWindow::onWithdraw() {
-    QModelIndexList sel = accountsTable->selectionModel()->selectedRows();
+    QModelIndexList sel = accountsView->selectionModel()->selectedRows();
     if (sel.empty()) { QMessageBox::information(this, "Info", "Select an account row."); return; }
-    int row = sel.first().row();
-    int accNo = accountsTable->item(row, 0)->text().toInt();
+    int accNo = accountsModel->accountNumberAt(sel.first().row());
     bool ok;
     double amt = QInputDialog::getDouble(this, "Withdraw", "Amount:", 0.0, 0.01, 1e12, 2, &ok);
     if (!ok) return;
-    if (bank->withdraw(accNo, amt)) {
-        bank->save();
+    bank->withdrawAsync(accNo, amt, [this](bool succeeded) {
+        emit bankOperationFinished(succeeded, "Withdraw failed (insufficient funds?).");
+    });
+    saveBankAsync();
+}
+
+void MainWindow::saveBankAsync() {
+    // Queued behind the mutation on the same worker, so it persists the new state.
+    // Only failures are reported; success was already signalled by the mutation itself.
+    bank->saveAsync([this](bool ok) {
+        if (!ok) emit bankOperationFinished(false, "Failed to save bank data.");
+    });
+}
+
+void MainWindow::onBankOperationFinished(bool ok, const QString &failureMessage) {
+    // Successful changes reach the table through the change feed (onAccountsChanged).
+    if (!ok) QMessageBox::warning(this, "Error", failureMessage);
+}
+
+void MainWindow::onAccountsChanged() {
+    if (accountFeed->resyncNeeded()) {
+        // Events were dropped; patching would leave gaps, so rebuild once instead.
+        accountFeed->drain([](const ChangeEvent &) {});
         onRefreshAccounts();
-    } else {
-        QMessageBox::warning(this, "Error", "Withdraw failed (insufficient funds?).");
+        return;
     }
+    accountFeed->drain([this](const ChangeEvent &ev) { accountsModel->applyChange(ev); });
 }
 
 void MainWindow::onRefreshVault() {
-    auto entries = pwdMgr->listEntries();
-    vaultTable->setRowCount(int(entries.size()));
-    for (int i = 0; i < int(entries.size()); ++i) {
-        const auto &e = entries[i];
-        vaultTable->setItem(i, 0, new QTableWidgetItem(QString::fromStdString(e.service)));
-        vaultTable->setItem(i, 1, new QTableWidgetItem(QString::fromStdString(e.username)));
-        vaultTable->setItem(i, 2, new QTableWidgetItem(QString::fromStdString(e.password)));
-    }
+    vaultModel->reload();
 }
 
 void MainWindow::onAddVaultEntry() {
@@ -178,7 +286,11 @@ void MainWindow::onAddVaultEntry() {
     if (!ok) return;
     QString password = QInputDialog::getText(this, "Password", "Password:", QLineEdit::Normal, "", &ok);
     if (!ok) return;
-    if (pwdMgr->addEntry(service.toStdString(), username.toStdString(), password.toStdString())) {
+    QByteArray secret = password.toUtf8();
+    bool added = pwdMgr->addEntry(service.toStdString(), username.toStdString(),
+                                  string_view(secret.constData(), size_t(secret.size())));
+    secret.fill('\0');
+    if (added) {
         onRefreshVault();
     } else {
         QMessageBox::warning(this, "Error", "Failed to add (maybe duplicate service).");
@@ -186,10 +298,9 @@ void MainWindow::onAddVaultEntry() {
 }
 
 void MainWindow::onDeleteVaultEntry() {
-    QModelIndexList sel = vaultTable->selectionModel()->selectedRows();
+    QModelIndexList sel = vaultView->selectionModel()->selectedRows();
     if (sel.empty()) { QMessageBox::information(this, "Info", "Select an entry row."); return; }
-    int row = sel.first().row();
-    QString service = vaultTable->item(row, 0)->text();
+    QString service = vaultModel->serviceAt(sel.first().row());
     if (pwdMgr->deleteEntry(service.toStdString())) {
         onRefreshVault();
     } else {
@@ -198,17 +309,15 @@ void MainWindow::onDeleteVaultEntry() {
 }
 
 void MainWindow::onArchiveLogs() {
+    if (archiveJob) {
+        QMessageBox::information(this, "Info", "An archive job is already running.");
+        return;
+    }
     QString inPath = "transactions.dat";
     if (!filesystem::exists(inPath.toStdString())) {
         QMessageBox::information(this, "Info", "No transaction log to archive.");
         return;
     }
-    // Decrypt log to plaintext
-    QString tempPlain = "temp_decrypted_log.txt";
-    if (!CryptoUtils::decryptFile(inPath.toStdString(), tempPlain.toStdString(), masterPassword.toStdString())) {
-        QMessageBox::warning(this, "Error", "Failed to decrypt log.");
-        return;
-    }
     // Choose output archive path
     auto now = chrono::system_clock::now();
     auto t_c = chrono::system_clock::to_time_t(now);
@@ -221,47 +330,127 @@ void MainWindow::onArchiveLogs() {
     char buf[32];
     strftime(buf, sizeof(buf), "archive_%Y%m%d_%H%M%S.huff", &tm);
     QString outPath = QFileDialog::getSaveFileName(this, "Save Archive As", buf, "Huffman Archive (*.huff)");
-    if (outPath.isEmpty()) {
-        filesystem::remove(tempPlain.toStdString());
-        return;
+    if (outPath.isEmpty()) return;
+
+    archiveProgress = new QProgressDialog("Archiving transaction log...", "Cancel", 0, 1000, this);
+    archiveProgress->setMinimumDuration(0);
+    archiveProgress->setAutoClose(false);
+    archiveProgress->setAutoReset(false);
+    archiveProgress->setValue(0);
+    archiveBtn->setEnabled(false);
+    archiveJob = make_unique<ArchiveJob>(*bank, outPath.toStdString(), masterPassword,
+                                         archiveCatalog.get());
+    connect(archiveProgress, &QProgressDialog::canceled, this, [this] {
+        if (archiveJob) archiveJob->cancel();
+    });
+    archiveJob->start(
+        [this](uint64_t done, uint64_t total) {
+            emit archiveProgressed(qint64(done), qint64(total));
+        },
+        [this](ArchiveJob::Result result, const string &message) {
+            emit archiveFinished(int(result), QString::fromStdString(message));
+        });
+}
+
+void MainWindow::onArchiveProgressed(qint64 done, qint64 total) {
+    if (archiveProgress && total > 0) archiveProgress->setValue(int(done * 1000 / total));
+}
+
+void MainWindow::onArchiveFinished(int result, const QString &message) {
+    archiveJob.reset();
+    if (archiveProgress) {
+        archiveProgress->deleteLater();
+        archiveProgress = nullptr;
     }
-    // Compress
-    bool ok = Huffman::compressFile(tempPlain.toStdString(), outPath.toStdString());
-    filesystem::remove(tempPlain.toStdString());
-    if (!ok) {
-        QMessageBox::warning(this, "Error", "Compression failed.");
-        return;
+    archiveBtn->setEnabled(true);
+    switch (ArchiveJob::Result(result)) {
+    case ArchiveJob::Result::Done:
+        QMessageBox::information(this, "Success", message);
+        break;
+    case ArchiveJob::Result::Cancelled:
+        break;
+    case ArchiveJob::Result::Failed:
+        QMessageBox::warning(this, "Error", message);
+        break;
     }
-    QMessageBox::information(this, "Success", "Archive created: " + outPath);
-    // Optionally clear the log: here we truncate encrypted file
-    ofstream empty("temp_empty.txt", ios::trunc);
-    empty.close();
-    CryptoUtils::encryptFile("temp_empty.txt", inPath.toStdString(), masterPassword.toStdString());
-    filesystem::remove("temp_empty.txt");
 }
 
 void MainWindow::onViewArchive() {
     QString inPath = QFileDialog::getOpenFileName(this, "Select Archive", "", "Huffman Archive (*.huff)");
     if (inPath.isEmpty()) return;
-    QString tempOut = "temp_decompressed_log.txt";
-    if (!Huffman::decompressFile(inPath.toStdString(), tempOut.toStdString())) {
+    ArchiveViewerDialog dlg(this);
+    if (!dlg.openArchive(inPath)) {
         QMessageBox::warning(this, "Error", "Decompression failed.");
         return;
     }
-    // Display in a dialog
-    ifstream in(tempOut.toStdString());
-    string content((istreambuf_iterator<char>(in)), {});
-    in.close();
-    filesystem::remove(tempOut.toStdString());
+    dlg.exec();
+}
+
+void MainWindow::onSearchArchives() {
+    QDialog form(this);
+    form.setWindowTitle("Search Archives");
+    QFormLayout *fields = new QFormLayout(&form);
+    QLineEdit *accountEdit = new QLineEdit(&form);
+    QLineEdit *fromEdit = new QLineEdit(&form);
+    QLineEdit *toEdit = new QLineEdit(&form);
+    accountEdit->setPlaceholderText("any");
+    fromEdit->setPlaceholderText("e.g. 2024-01-01");
+    toEdit->setPlaceholderText("e.g. 2024-03-31");
+    fields->addRow("Account number", accountEdit);
+    fields->addRow("From (UTC)", fromEdit);
+    fields->addRow("To (UTC)", toEdit);
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &form);
+    fields->addRow(buttons);
+    connect(buttons, &QDialogButtonBox::accepted, &form, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &form, &QDialog::reject);
+    if (form.exec() != QDialog::Accepted) return;
+
+    ArchiveQuery query;
+    QString account = accountEdit->text().trimmed();
+    if (!account.isEmpty()) {
+        bool ok = false;
+        query.account = account.toInt(&ok);
+        if (!ok) { QMessageBox::warning(this, "Error", "Invalid account number."); return; }
+    }
+    query.from = fromEdit->text().trimmed().toStdString();
+    query.to = toEdit->text().trimmed().toStdString();
+
     QDialog dlg(this);
-    dlg.setWindowTitle("Archived Log Contents");
+    dlg.setWindowTitle("Archive Search Results");
     QVBoxLayout *layout = new QVBoxLayout(&dlg);
-    QTextEdit *textEdit = new QTextEdit(&dlg);
-    textEdit->setReadOnly(true);
-    textEdit->setPlainText(QString::fromStdString(content));
-    layout->addWidget(textEdit);
+    QPlainTextEdit *results = new QPlainTextEdit(&dlg);
+    results->setReadOnly(true);
+    layout->addWidget(results);
+    QLabel *status = new QLabel("Searching...", &dlg);
+    layout->addWidget(status);
     QPushButton *closeBtn = new QPushButton("Close", &dlg);
     layout->addWidget(closeBtn);
     connect(closeBtn, &QPushButton::clicked, &dlg, &QDialog::accept);
+
+    // The query runs on its own thread and streams matches into the dialog in batches;
+    // closing the dialog stops it.
+    atomic<bool> stop{false};
+    thread search([&, query] {
+        QStringList batch;
+        auto flush = [&] {
+            if (batch.isEmpty()) return;
+            QString text = batch.join('\n');
+            batch.clear();
+            QMetaObject::invokeMethod(results, [results, text] { results->appendPlainText(text); }, Qt::QueuedConnection);
+        };
+        QueryStats stats;
+        bool ok = archiveCatalog->query(query, [&](const Transaction &tr, const string &) {
+            batch << QString::fromStdString(tr.serialize());
+            if (batch.size() >= 256) flush();
+            return !stop;
+        }, &stats);
+        flush();
+        QString summary = QString("%1 matches in %2 archives (%3 skipped by the catalog)%4")
+                              .arg(qulonglong(stats.matches)).arg(stats.archivesSearched).arg(stats.archivesSkipped)
+                              .arg(ok ? "" : "; some archives could not be read");
+        QMetaObject::invokeMethod(status, [status, summary] { status->setText(summary); }, Qt::QueuedConnection);
+    });
     dlg.exec();
+    stop = true;
+    search.join();
 }
@@ -6,11 +6,23 @@ namespace Ui { class MainWindow; } // if using .ui; here we build UI in code.
 
 #include "../core/Bank.h"
 #include "../password/PasswordManager.h"
+#include "../shm/AccountTablePublisher.h"
 
 
 class QTabWidget;
-class QTableWidget;
+class QTableView;
 class QPushButton;
+class QLineEdit;
+class QProgressDialog;
+class QLabel;
+class QPlainTextEdit;
+class ArchiveJob;
+class ArchiveCatalog;
+class QAbstractItemModel;
+class AccountTableModel;
+class VaultTableModel;
+class StartupLoader;
+class ReplicationPrimary;
 
 
 class MainWindow : public QMainWindow {
@@ -19,36 +31,63 @@ public:
     MainWindow(const QString &masterPwd, QWidget *parent = nullptr);
     ~MainWindow();
 
+signals:
+    // Emitted from the bank's worker thread; connected queued so the slot runs on the UI thread.
+    void bankOperationFinished(bool ok, const QString &failureMessage);
+    // Raised by the bank's change feed when account events are waiting; also queued.
+    void accountsChanged();
+    // Archive job progress/completion, emitted from the job's thread (queued).
+    void archiveProgressed(qint64 done, qint64 total);
+    void archiveFinished(int result, const QString &message);
+    // A start-up stage (StartupLoader::Stage) is done; emitted from its worker thread (queued).
+    void startupStageFinished(int stage, bool ok);
+
 private slots:
+    void onStartupStageFinished(int stage, bool ok);
+
     void onAddAccount();
     void onDeposit();
     void onWithdraw();
     void onRefreshAccounts();
+    void onBankOperationFinished(bool ok, const QString &failureMessage);
+    void onAccountsChanged();
 
     void onAddVaultEntry();
     void onDeleteVaultEntry();
     void onRefreshVault();
 
     void onArchiveLogs();
+    void onArchiveProgressed(qint64 done, qint64 total);
+    void onArchiveFinished(int result, const QString &message);
     void onViewArchive();
+    void onSearchArchives();
 
 private:
     unique_ptr<Bank> bank;
+    shared_ptr<ChangeSubscription> accountFeed;
+    unique_ptr<AccountTablePublisher> accountMirror; // balances for local reporting processes
+    unique_ptr<ReplicationPrimary> replication;       // set when SBANK_REPLICATION_DIR is
     unique_ptr<PasswordManager> pwdMgr;
-    QString masterPassword;
+    SecureString masterPassword; // kept for archiving; wiped when freed
 
     // UI elements
     QTabWidget *tabs;
     // Accounts tab
     QWidget *accountsTab;
-    QTableWidget *accountsTable;
+    QLabel *accountsStatus;
+    QLineEdit *accountsFilter;
+    QTableView *accountsView;
+    AccountTableModel *accountsModel;
     QPushButton *addAccBtn;
     QPushButton *depositBtn;
     QPushButton *withdrawBtn;
 
     // Password vault tab
     QWidget *vaultTab;
-    QTableWidget *vaultTable;
+    QLabel *vaultStatus;
+    QLineEdit *vaultFilter;
+    QTableView *vaultView;
+    VaultTableModel *vaultModel;
     QPushButton *addVaultBtn;
     QPushButton *delVaultBtn;
 
@@ -56,7 +95,14 @@ private:
     QWidget *logsTab;
     QPushButton *archiveBtn;
     QPushButton *viewArchiveBtn;
+    QPushButton *searchArchivesBtn;
+    QPlainTextEdit *recentLog;
+    unique_ptr<ArchiveCatalog> archiveCatalog; // outlives archiveJob, which registers into it
+    unique_ptr<ArchiveJob> archiveJob;
+    QProgressDialog *archiveProgress = nullptr;
+    unique_ptr<StartupLoader> startup; // holds references to bank, pwdMgr and archiveCatalog
 
     void setupUI();
-    void loadData();
+    void setupTableView(QTableView *view, QAbstractItemModel *model);
+    void saveBankAsync();
 };
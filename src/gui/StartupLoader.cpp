@@ -0,0 +1,21 @@
+#include "StartupLoader.h"
+using namespace std;
+
+StartupLoader::StartupLoader(Bank &bank, PasswordManager &vault, ArchiveCatalog &catalog, size_t journalEntries)
+    : bank(bank), vault(vault), catalog(catalog), journalEntries(journalEntries) {}
+
+StartupLoader::~StartupLoader() {}
+
+void StartupLoader::start(StageFn done) {
+    auto run = [this, done](Stage stage, function<bool()> load) {
+        pool.post([this, done, stage, load] {
+            bool ok = load();
+            --remaining;
+            if (done) done(stage, ok);
+        });
+    };
+    run(Accounts, [this] { return bank.load(); });
+    run(Journal, [this] { return bank.loadJournalTail(journalEntries, journal); });
+    run(Vault, [this] { return vault.load(); });
+    run(Catalog, [this] { return catalog.load(); });
+}
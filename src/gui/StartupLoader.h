@@ -0,0 +1,39 @@
+#pragma once
+#include "../core/Bank.h"
+#include "../password/PasswordManager.h"
+#include "../archive/ArchiveCatalog.h"
+#include "../concurrency/ThreadPool.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+using namespace std;
+
+// Loads the bank's accounts, the tail of its journal, the vault and the archive catalog side
+// by side, one worker thread each, so start-up takes as long as the slowest stage rather than
+// all of them in a row. The encrypted stages share one PBKDF2 through CryptoUtils' key cache.
+class StartupLoader {
+public:
+    enum Stage { Accounts, Journal, Vault, Catalog, STAGE_COUNT };
+    // Called on the stage's worker thread as each stage finishes.
+    using StageFn = function<void(Stage stage, bool ok)>;
+
+    StartupLoader(Bank &bank, PasswordManager &vault, ArchiveCatalog &catalog, size_t journalEntries = 200);
+    ~StartupLoader(); // waits for stages still running
+
+    StartupLoader(const StartupLoader&) = delete;
+    StartupLoader& operator=(const StartupLoader&) = delete;
+
+    void start(StageFn done);
+    bool finished() const { return remaining == 0; }
+    // Filled by the Journal stage; read it only after that stage has reported.
+    const vector<Transaction> &journalTail() const { return journal; }
+
+private:
+    Bank &bank;
+    PasswordManager &vault;
+    ArchiveCatalog &catalog;
+    size_t journalEntries;
+    vector<Transaction> journal;
+    atomic<int> remaining{STAGE_COUNT};
+    ThreadPool pool{STAGE_COUNT}; // last, so it is joined before the rest goes away
+};
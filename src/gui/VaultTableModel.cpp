@@ -0,0 +1,118 @@
+#include "VaultTableModel.h"
+#include <algorithm>
+using namespace std;
+
+static constexpr int FETCH_BATCH = 256;
+
+VaultTableModel::VaultTableModel(PasswordManager *vault, QObject *parent)
+    : QAbstractTableModel(parent), vault(vault) {
+    rebuild();
+}
+
+int VaultTableModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : fetched;
+}
+
+int VaultTableModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : 3;
+}
+
+int VaultTableModel::positionAt(int row) const {
+    return identity ? row : order[row];
+}
+
+QVariant VaultTableModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole || index.row() >= fetched) return {};
+    int pos = positionAt(index.row());
+    if (pos >= int(entries->size())) return {};
+    const VaultEntry &e = (*entries)[pos];
+    switch (index.column()) {
+    case 0: return QString::fromUtf8(e.service.data(), int(e.service.size()));
+    case 1: return QString::fromUtf8(e.username.data(), int(e.username.size()));
+    case 2: return QString::fromUtf8(e.password.data(), int(e.password.size()));
+    }
+    return {};
+}
+
+QVariant VaultTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return {};
+    switch (section) {
+    case 0: return QStringLiteral("Service");
+    case 1: return QStringLiteral("Username");
+    case 2: return QStringLiteral("Password");
+    }
+    return {};
+}
+
+bool VaultTableModel::canFetchMore(const QModelIndex &parent) const {
+    return !parent.isValid() && fetched < total;
+}
+
+void VaultTableModel::fetchMore(const QModelIndex &parent) {
+    if (parent.isValid()) return;
+    int n = min(FETCH_BATCH, total - fetched);
+    if (n <= 0) return;
+    beginInsertRows(QModelIndex(), fetched, fetched + n - 1);
+    fetched += n;
+    endInsertRows();
+}
+
+void VaultTableModel::sort(int column, Qt::SortOrder order) {
+    sortColumn = column;
+    sortOrder = order;
+    reload();
+}
+
+void VaultTableModel::setFilter(const QString &text) {
+    string f = text.trimmed().toLower().toStdString();
+    if (f == filter) return;
+    filter = f;
+    reload();
+}
+
+void VaultTableModel::reload() {
+    beginResetModel();
+    rebuild();
+    endResetModel();
+}
+
+QString VaultTableModel::serviceAt(int row) const {
+    if (row < 0 || row >= fetched) return {};
+    int pos = positionAt(row);
+    if (pos >= int(entries->size())) return QString();
+    const SecureString &service = (*entries)[pos].service;
+    return QString::fromUtf8(service.data(), int(service.size()));
+}
+
+void VaultTableModel::rebuild() {
+    entries = vault->snapshot();
+    int count = int(entries->size());
+    order.clear();
+    identity = filter.empty() && sortColumn < 0;
+    if (identity) {
+        total = count;
+    } else {
+        // A filter goes through the vault's search index, which ranks the matches; sorting
+        // reads the keys from the snapshot, and only positions are kept.
+        if (!filter.empty()) {
+            for (size_t pos : vault->search(filter, size_t(count))) {
+                if (pos < size_t(count)) order.push_back(int(pos)); // skip entries added since
+            }
+        } else {
+            order.resize(count);
+            for (int i = 0; i < count; ++i) order[i] = i;
+        }
+        if (sortColumn >= 0) {
+            const auto &view = *entries;
+            auto key = [&](int pos) -> string_view {
+                const VaultEntry &e = view[pos];
+                return sortColumn == 1 ? string_view(e.username) : sortColumn == 2 ? string_view(e.password) : string_view(e.service);
+            };
+            auto less = [&](int a, int b) { return key(a) < key(b); };
+            if (sortOrder == Qt::AscendingOrder) stable_sort(order.begin(), order.end(), less);
+            else stable_sort(order.begin(), order.end(), [&](int a, int b) { return less(b, a); });
+        }
+        total = int(order.size());
+    }
+    fetched = min(FETCH_BATCH, total);
+}
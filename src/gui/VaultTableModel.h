@@ -0,0 +1,40 @@
+#pragma once
+#include <QAbstractTableModel>
+#include "../password/PasswordManager.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+// Read-only view over the password vault. Rows are read from a snapshot of the vault, taken
+// again on every reload, when the view paints them; nothing is copied wholesale.
+class VaultTableModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    explicit VaultTableModel(PasswordManager *vault, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    void setFilter(const QString &text);
+    void reload();
+    QString serviceAt(int row) const; // empty if out of range
+
+private:
+    PasswordManager *vault;
+    shared_ptr<const PasswordManager::EntriesView> entries;
+    vector<int> order; // vault positions; empty while unsorted and unfiltered (row == position)
+    bool identity = true;
+    int total = 0;
+    int fetched = 0;
+    string filter; // lower-cased
+    int sortColumn = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+
+    int positionAt(int row) const;
+    void rebuild();
+};
@@ -1,81 +1,177 @@
 #include "PasswordManager.h"
 #include "../crypto/CryptoUtils.h"
-#include <fstream>
 #include <filesystem>
-#include <sstream>
+#include <algorithm>
 using namespace std;
 
-string VaultEntry::serialize() const {
-    return service + "|" + username + "|" + password;
+SecureString VaultEntry::serialize() const {
+    SecureString line;
+    line.reserve(service.size() + username.size() + password.size() + 2);
+    line.append(service).append(1, '|').append(username).append(1, '|').append(password);
+    return line;
 }
-VaultEntry VaultEntry::deserialize(const string &line) {
-    istringstream iss(line);
-    string s, u, p;
-    if (!getline(iss, s, '|')) return {};
-    if (!getline(iss, u, '|')) return {};
-    if (!getline(iss, p, '|')) return {};
-    return VaultEntry{s,u,p};
+VaultEntry VaultEntry::deserialize(string_view line) {
+    size_t u = line.find('|');
+    if (u == string_view::npos) return {};
+    size_t p = line.find('|', u + 1);
+    if (p == string_view::npos || p + 1 == line.size()) return {};
+    VaultEntry e;
+    e.service.assign(line.substr(0, u));
+    e.username.assign(line.substr(u + 1, p - u - 1));
+    e.password = line.substr(p + 1, line.find('|', p + 1) - p - 1);
+    return e;
 }
-PasswordManager::PasswordManager(const string &vaultFile, const string &masterPassword){
+PasswordManager::PasswordManager(const string &vaultFile, string_view masterPassword){
 
     vaultFilePath=vaultFile;
-    tempPlainVault="temp_vault.txt";
     masterPwd=masterPassword;
 }
 
+// Change log records: 'A' + entry adds (or replaces) an entry, 'D' + service deletes one. Both
+// are idempotent, so replaying a log over a snapshot that already holds it changes nothing;
+// that is what happens after a crash between writing a snapshot and resetting the log.
+static constexpr size_t MIN_COMPACT_RECORDS = 64;
+
 bool PasswordManager::load() {
     lock_guard<mutex> lk(mtx);
     entries.clear();
+    index.clear();
+    searchIndex.clear();
+    changes.close();
     if (filesystem::exists(vaultFilePath)) {
-        if (!CryptoUtils::decryptFile(vaultFilePath, tempPlainVault, masterPwd)) return false;
-        ifstream in(tempPlainVault);
-        if (!in) return false;
-        string line;
-        while (getline(in, line)) {
-            if (line.empty()) continue;
-            entries.push_back(VaultEntry::deserialize(line));
+        SecureString text;
+        bool ok = CryptoUtils::decryptStream(vaultFilePath, masterPwd, [&text](const unsigned char *data, size_t len) {
+            text.append(reinterpret_cast<const char*>(data), len);
+            return true;
+        });
+        if (!ok) {
+            entries.publish();
+            return false;
+        }
+        for (string_view rest(text); !rest.empty();) {
+            size_t nl = rest.find('\n');
+            string_view line = rest.substr(0, nl);
+            rest.remove_prefix(nl == string_view::npos ? rest.size() : nl + 1);
+            if (!line.empty()) put(VaultEntry::deserialize(line));
         }
-        in.close();
-        filesystem::remove(tempPlainVault);
     }
-    return true;
+    bool ok = changes.open(vaultFilePath + ".log", masterPwd, [this](const string &record) {
+        if (record.empty()) return false;
+        if (record[0] == 'A') put(VaultEntry::deserialize(string_view(record).substr(1)));
+        else if (record[0] == 'D') remove(SecureString(string_view(record).substr(1)));
+        else return false;
+        return true;
+    });
+    entries.publish();
+    return ok;
 }
 
 bool PasswordManager::save() {
     lock_guard<mutex> lk(mtx);
-    ofstream out(tempPlainVault, ios::trunc);
-    if (!out) return false;
-    for (auto &e : entries) {
-        out << e.serialize() << "\n";
+    return saveLocked();
+}
+
+bool PasswordManager::saveLocked() {
+    // The plaintext only exists in memory, in the secure arena.
+    SecureString text;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        text.append(entries[i].serialize()).append(1, '\n');
     }
-    out.close();
-    if (!CryptoUtils::encryptFile(tempPlainVault, vaultFilePath, masterPwd)) return false;
-    filesystem::remove(tempPlainVault);
+    // Written aside and renamed, so a failed save leaves the previous snapshot intact.
+    string tempCipher = vaultFilePath + ".tmp";
+    if (!CryptoUtils::encryptBuffer(text.data(), text.size(), tempCipher, masterPwd)) return false;
+    error_code ec;
+    filesystem::rename(tempCipher, vaultFilePath, ec);
+    if (ec) return false;
+    // The snapshot holds every change now, so the log starts over.
+    if (changes.reset()) return true;
+    string logPath = vaultFilePath + ".log";
+    filesystem::remove(logPath, ec);
+    return changes.open(logPath, masterPwd, [](const string &) { return true; });
+}
+
+bool PasswordManager::logChange(string_view record) {
+    // Without a usable log the change goes into a full snapshot instead.
+    if (!changes.append(record)) return saveLocked();
+    // Compacting once the log is as long as the vault keeps both the log and the
+    // amortized cost per change bounded.
+    if (changes.records() >= max(MIN_COMPACT_RECORDS, entries.size())) return saveLocked();
     return true;
 }
 
-vector<VaultEntry> PasswordManager::listEntries() {
+void PasswordManager::put(const VaultEntry &entry) {
+    searchIndex.add(entry.service, entry.username);
+    auto it = index.find(entry.service);
+    if (it != index.end()) {
+        entries.edit(it->second) = entry;
+        return;
+    }
+    index[entry.service] = entries.size();
+    entries.push_back(entry);
+}
+
+bool PasswordManager::remove(const SecureString &service) {
+    auto it = index.find(service);
+    if (it == index.end()) return false;
+    size_t pos = it->second;
+    index.erase(it);
+    searchIndex.remove(service);
+    // Swap with the last entry so positions of everything else stay put.
+    if (pos != entries.size() - 1) {
+        entries.edit(pos) = entries.back();
+        index[entries[pos].service] = pos;
+    }
+    entries.pop_back();
+    return true;
+}
+
+shared_ptr<const PasswordManager::EntriesView> PasswordManager::snapshot() const {
+    return entries.snapshot();
+}
+
+size_t PasswordManager::entryCount() {
+    lock_guard<mutex> lk(mtx);
+    return entries.size();
+}
+
+bool PasswordManager::entryAt(size_t index, VaultEntry &out) {
     lock_guard<mutex> lk(mtx);
-    return entries;
+    if (index >= entries.size()) return false;
+    out = entries[index];
+    return true;
 }
 
-bool PasswordManager::addEntry(const string &service, const string &username, const string &password) {
+vector<size_t> PasswordManager::search(const string &query, size_t limit) {
     lock_guard<mutex> lk(mtx);
-    // If duplicate service, reject or overwrite? Here we reject duplicates.
-    for (auto &e: entries) {
-        if (e.service == service) return false;
+    vector<size_t> positions;
+    for (const SecureString &service : searchIndex.search(query, limit)) {
+        auto it = index.find(service);
+        if (it != index.end()) positions.push_back(it->second);
     }
-    entries.push_back(VaultEntry{service, username, password});
-    return save();
+    return positions;
+}
+
+bool PasswordManager::addEntry(const string &service, const string &username, string_view password) {
+    lock_guard<mutex> lk(mtx);
+    // Duplicate services are rejected.
+    VaultEntry entry{SecureString(service), SecureString(username), SecureString(password)};
+    if (index.count(entry.service)) return false;
+    put(entry);
+    bool ok = logChange("A" + entry.serialize());
+    if (!ok) remove(entry.service); // keep memory in step with what is on disk
+    entries.publish();
+    return ok;
 }
 
 bool PasswordManager::deleteEntry(const string &service) {
     lock_guard<mutex> lk(mtx);
-    for (auto it = entries.begin(); it != entries.end(); ++it) {
-        if (it->service == service) {
-            entries.erase(it);
-            return save();
-        }
-    }
-    return false;
+    SecureString key(service);
+    auto it = index.find(key);
+    if (it == index.end()) return false;
+    VaultEntry removed = entries[it->second];
+    remove(key);
+    bool ok = logChange("D" + key);
+    if (!ok) put(removed);
+    entries.publish();
+    return ok;
 }
@@ -1,32 +1,61 @@
 #pragma once
+#include "../crypto/CryptoUtils.h"
+#include "VaultSearchIndex.h"
+#include "../concurrency/VersionedVector.h"
+#include "../crypto/SecureArena.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <mutex>
+#include <unordered_map>
 using namespace std;
 
 struct VaultEntry {
-    string service;
-    string username;
-    string password;
-    string serialize() const;
-    static VaultEntry deserialize(const string &line);
+    SecureString service;
+    SecureString username;
+    SecureString password;
+    SecureString serialize() const;
+    static VaultEntry deserialize(string_view line);
 };
 
+// The vault is a snapshot (vaultFile, a full encrypted container) plus a change log next to
+// it (vaultFile + ".log", a SealedLog). Adding or deleting an entry appends one record to the
+// log; once the log outgrows the vault it is folded into a new snapshot. Entries are found
+// through a hash index on the service name, and a delete moves the last entry into the gap.
 class PasswordManager {
 public:
-    PasswordManager(const string &vaultFile, const string &masterPassword);
+    PasswordManager(const string &vaultFile, string_view masterPassword);
 
-    bool load();   // decrypt vault to memory
-    bool save();   // encrypt vault to disk
+    bool load();   // decrypt the snapshot and replay the change log
+    bool save();   // write a full snapshot and start an empty change log
 
-    vector<VaultEntry> listEntries();
-    bool addEntry(const string &service, const string &username, const string &password);
+    // Immutable view of all entries as of the last completed change, in entryAt order. O(1),
+    // takes no lock and never waits for writers.
+    using EntriesView = VersionedVector<VaultEntry, SecureAllocator<VaultEntry>>::Snapshot;
+    shared_ptr<const EntriesView> snapshot() const;
+    // Row access for views that read lazily instead of copying the whole vault.
+    size_t entryCount();
+    bool entryAt(size_t index, VaultEntry &out);
+    // Positions (for entryAt) of up to 'limit' entries matching 'query' by service or username
+    // prefix, or fuzzily; best matches first. See VaultSearchIndex.
+    vector<size_t> search(const string &query, size_t limit);
+    bool addEntry(const string &service, const string &username, string_view password);
     bool deleteEntry(const string &service);
 
 private:
-    vector<VaultEntry> entries;
+    // Published at the end of every public change. Entries, their names and the indexes over
+    // them live in the secure arena, so freed ones leave nothing behind, short strings included.
+    VersionedVector<VaultEntry, SecureAllocator<VaultEntry>> entries;
+    unordered_map<SecureString, size_t, SecureStringHash, equal_to<SecureString>,
+                  SecureAllocator<pair<const SecureString, size_t>>> index; // service -> position in entries
+    VaultSearchIndex searchIndex;
+    CryptoUtils::SealedLog changes;
     string vaultFilePath;
-    string tempPlainVault;
-    string masterPwd;
+    SecureString masterPwd;
     mutex mtx;
+
+    bool saveLocked();
+    bool logChange(string_view record); // appends, compacting when the log has grown
+    void put(const VaultEntry &entry);
+    bool remove(const SecureString &service);
 };
@@ -0,0 +1,147 @@
+#include "VaultSearchIndex.h"
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+static constexpr double MIN_TRIGRAM_SHARE = 0.4; // of the query's trigrams, for a fuzzy match
+static constexpr size_t MIN_SWEEP_DEAD = 64;
+
+static SecureString lowerAscii(string_view s) {
+    SecureString out(s);
+    for (char &c : out)
+        if (c >= 'A' && c <= 'Z') c = char(c - 'A' + 'a');
+    return out;
+}
+
+// Trigrams of "  " + s + " ", packed into 24 bits, sorted and without duplicates. The padding
+// makes the first and last letters count, which short names and typos near the ends need.
+VaultSearchIndex::Grams VaultSearchIndex::trigrams(string_view lower) {
+    SecureString padded;
+    padded.reserve(lower.size() + 3);
+    padded.append("  ").append(lower).append(" ");
+    Grams grams;
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        grams.push_back(uint32_t(uint8_t(padded[i])) << 16 | uint32_t(uint8_t(padded[i + 1])) << 8 |
+                        uint8_t(padded[i + 2]));
+    }
+    sort(grams.begin(), grams.end());
+    grams.erase(unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+VaultSearchIndex::Grams VaultSearchIndex::docTrigrams(const Doc &doc) const {
+    Grams grams = trigrams(doc.lowerService), user = trigrams(doc.lowerUser), both;
+    set_union(grams.begin(), grams.end(), user.begin(), user.end(), back_inserter(both));
+    return both;
+}
+
+void VaultSearchIndex::add(string_view service, string_view username) {
+    remove(service);
+    uint32_t id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = uint32_t(docs.size());
+        docs.emplace_back();
+    }
+    Doc &doc = docs[id];
+    doc.service = service;
+    doc.lowerService = lowerAscii(service);
+    doc.lowerUser = lowerAscii(username);
+    doc.live = true;
+    ids[doc.service] = id;
+    byService.emplace(doc.lowerService, id);
+    byUser.emplace(doc.lowerUser, id);
+    for (uint32_t g : docTrigrams(doc)) postings[g].push_back(id);
+}
+
+void VaultSearchIndex::remove(string_view service) {
+    auto it = ids.find(SecureString(service));
+    if (it == ids.end()) return;
+    uint32_t id = it->second;
+    Doc &doc = docs[id];
+    byService.erase({doc.lowerService, id});
+    byUser.erase({doc.lowerUser, id});
+    doc = Doc();
+    ids.erase(it);
+    if (++dead >= max(MIN_SWEEP_DEAD, ids.size())) sweep();
+}
+
+void VaultSearchIndex::sweep() {
+    postings.clear();
+    freeIds.clear();
+    for (uint32_t id = 0; id < docs.size(); ++id) {
+        if (!docs[id].live) {
+            freeIds.push_back(id);
+            continue;
+        }
+        for (uint32_t g : docTrigrams(docs[id])) postings[g].push_back(id);
+    }
+    dead = 0;
+}
+
+void VaultSearchIndex::clear() {
+    docs.clear();
+    freeIds.clear();
+    dead = 0;
+    ids.clear();
+    byService.clear();
+    byUser.clear();
+    postings.clear();
+    shared.clear();
+    taken.clear();
+    touched.clear();
+}
+
+VaultSearchIndex::Names VaultSearchIndex::search(const string &query, size_t limit) const {
+    Names out;
+    SecureString q = lowerAscii(query);
+    if (q.empty() || limit == 0) return out;
+    if (shared.size() < docs.size()) { // grows with the vault, not per query
+        shared.resize(docs.size());
+        taken.resize(docs.size());
+    }
+    auto take = [&](uint32_t id) {
+        if (taken[id]) return;
+        if (!shared[id]) touched.push_back(id);
+        taken[id] = 1;
+        out.push_back(docs[id].service);
+    };
+    auto reset = [&] {
+        for (uint32_t id : touched) shared[id] = taken[id] = 0;
+        touched.clear();
+    };
+    for (const auto *names : {&byService, &byUser}) {
+        for (auto it = names->lower_bound({q, 0});
+             it != names->end() && out.size() < limit && it->first.compare(0, q.size(), q) == 0; ++it)
+            take(it->second);
+    }
+    if (q.size() < 3 || out.size() >= limit) {
+        reset();
+        return out;
+    }
+
+    Grams grams = trigrams(q);
+    size_t named = touched.size(); // the prefix matches, already taken
+    for (uint32_t g : grams) {
+        auto p = postings.find(g);
+        if (p == postings.end()) continue;
+        for (uint32_t id : p->second) {
+            if (shared[id]++ == 0 && !taken[id]) touched.push_back(id);
+        }
+    }
+    size_t need = max<size_t>(1, size_t(ceil(grams.size() * MIN_TRIGRAM_SHARE)));
+    vector<pair<uint32_t, uint32_t>> hits; // (shared, id)
+    for (size_t i = named; i < touched.size(); ++i) {
+        uint32_t id = touched[i];
+        if (shared[id] >= need && docs[id].live) hits.emplace_back(shared[id], id);
+    }
+    sort(hits.begin(), hits.end(), [this](const pair<uint32_t, uint32_t> &a, const pair<uint32_t, uint32_t> &b) {
+        if (a.first != b.first) return a.first > b.first;
+        return docs[a.second].lowerService < docs[b.second].lowerService;
+    });
+    for (size_t i = 0; i < hits.size() && out.size() < limit; ++i) take(hits[i].second);
+    reset();
+    return out;
+}
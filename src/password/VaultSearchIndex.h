@@ -0,0 +1,61 @@
+#pragma once
+#include "../crypto/SecureArena.h"
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// As-you-type lookup over vault entries by service and username, case-insensitive (ASCII).
+// Prefix matches come from ordered sets of the lower-cased names; fuzzy matches (typos,
+// substrings) from an index of the padded trigrams of both names. Both are kept up to date
+// entry by entry. A delete only marks the entry dead in the trigram index; dead ids are
+// swept out, and become reusable, once they are as many as the live ones. Names, and the
+// trigrams cut from them, are kept in the secure arena like the entries themselves.
+class VaultSearchIndex {
+public:
+    using Names = vector<SecureString, SecureAllocator<SecureString>>;
+
+    void add(string_view service, string_view username);
+    void remove(string_view service);
+    void clear();
+
+    // Services matching 'query', best first: service prefix matches, then username prefix
+    // matches, then entries sharing enough trigrams with the query (queries of 3+ characters).
+    // Costs what the query touches, not the vault size; one search at a time, like add/remove.
+    Names search(const string &query, size_t limit) const;
+
+private:
+    struct Doc {
+        SecureString service; // as stored
+        SecureString lowerService;
+        SecureString lowerUser;
+        bool live = false;
+    };
+    template <typename T> using Secure = SecureAllocator<T>;
+    using Grams = vector<uint32_t, Secure<uint32_t>>;
+    using NameKey = pair<SecureString, uint32_t>;
+
+    vector<Doc, Secure<Doc>> docs; // by id
+    vector<uint32_t> freeIds;      // swept ids, free for reuse
+    size_t dead = 0;               // removed ids still in postings
+    unordered_map<SecureString, uint32_t, SecureStringHash, equal_to<SecureString>,
+                  Secure<pair<const SecureString, uint32_t>>> ids; // service -> id
+    set<NameKey, less<NameKey>, Secure<NameKey>> byService;        // (lower-cased service, id)
+    set<NameKey, less<NameKey>, Secure<NameKey>> byUser;           // (lower-cased username, id)
+    unordered_map<uint32_t, vector<uint32_t>, hash<uint32_t>, equal_to<uint32_t>,
+                  Secure<pair<const uint32_t, vector<uint32_t>>>> postings; // trigram -> ids, unordered
+
+    // Per-query state by id, kept between searches so a query does not allocate and clear
+    // arrays over every entry; each search zeroes only the ids it touched.
+    mutable vector<uint32_t> shared;  // trigrams in common with the query
+    mutable vector<uint8_t> taken;    // already in the results
+    mutable vector<uint32_t> touched; // ids with either set
+
+    static Grams trigrams(string_view lower);
+    Grams docTrigrams(const Doc &doc) const;
+    void sweep();
+};
@@ -0,0 +1,131 @@
+#include "ReplicationLog.h"
+#include "../crypto/CryptoUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+using namespace std;
+
+namespace ReplicationLog {
+
+static constexpr size_t IMAGE_BATCH = 4096; // accounts per image record
+
+// Zero-padded so that names sort like the numbers.
+static string numbered(const string &dir, uint64_t seq, const char *ext) {
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu%s", static_cast<unsigned long long>(seq), ext);
+    return (filesystem::path(dir) / name).string();
+}
+
+string segmentPath(const string &dir, uint64_t firstSeq) { return numbered(dir, firstSeq, ".segment"); }
+string imagePath(const string &dir, uint64_t seq) { return numbered(dir, seq, ".image"); }
+string journalPath(const string &dir, uint64_t seq) { return numbered(dir, seq, ".journal"); }
+string statusPath(const string &dir) { return (filesystem::path(dir) / "primary.status").string(); }
+string ackPath(const string &dir) { return (filesystem::path(dir) / "standby.ack").string(); }
+
+static vector<uint64_t> numberedFiles(const string &dir, const string &ext) {
+    vector<uint64_t> out;
+    error_code ec;
+    for (filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        filesystem::path p = it->path();
+        string stem = p.stem().string();
+        if (p.extension() != ext || stem.size() != 20 || !all_of(stem.begin(), stem.end(), ::isdigit)) continue;
+        out.push_back(stoull(stem));
+    }
+    sort(out.begin(), out.end());
+    return out;
+}
+
+vector<uint64_t> segments(const string &dir) { return numberedFiles(dir, ".segment"); }
+vector<uint64_t> images(const string &dir) { return numberedFiles(dir, ".image"); }
+
+int64_t nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool writeMark(const string &path, uint64_t seq, int64_t ns) {
+    string tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::trunc);
+        out << seq << " " << ns << "\n";
+        if (!out) return false;
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+bool readMark(const string &path, uint64_t &seq, int64_t &ns) {
+    ifstream in(path);
+    return bool(in >> seq >> ns);
+}
+
+bool writeImage(const string &dir, uint64_t seq, const Bank::AccountsView &accounts, string_view password) {
+    string tmp = imagePath(dir, seq) + ".tmp";
+    error_code ec;
+    filesystem::remove(tmp, ec);
+    CryptoUtils::SealedLog image;
+    if (!image.open(tmp, password, [](const string&) { return true; })) return false;
+    bool ok = image.append("S|" + to_string(seq) + "|" + to_string(accounts.size()));
+    SecureString batch;
+    for (size_t i = 0; ok && i < accounts.size(); i += IMAGE_BATCH) {
+        batch.clear();
+        for (size_t j = i; j < min(accounts.size(), i + IMAGE_BATCH); ++j) {
+            const BankAccount &acc = accounts[j];
+            batch += to_string(acc.getAccountNumber());
+            batch += '|';
+            batch += formatAmount(acc.getBalance());
+            batch += '|';
+            batch += acc.getHolderName();
+            batch += '\n';
+        }
+        ok = image.append(batch);
+    }
+    image.close();
+    if (ok) filesystem::rename(tmp, imagePath(dir, seq), ec);
+    if (!ok || ec) {
+        filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool readImage(const string &dir, uint64_t seq, string_view password, vector<BankAccount> &accounts) {
+    accounts.clear();
+    CryptoUtils::SealedLogReader image;
+    if (!image.open(imagePath(dir, seq), password)) return false;
+    bool header = false;
+    size_t expected = 0;
+    bool ok = image.poll([&](const string &record) {
+        if (!header) {
+            header = true;
+            unsigned long long s = 0;
+            size_t n = 0;
+            if (sscanf(record.c_str(), "S|%llu|%zu", &s, &n) != 2 || s != seq) return false;
+            expected = n;
+            accounts.reserve(n);
+            return true;
+        }
+        size_t pos = 0;
+        while (pos < record.size()) {
+            size_t end = record.find('\n', pos);
+            if (end == string::npos) return false;
+            size_t bar1 = record.find('|', pos);
+            size_t bar2 = bar1 < end ? record.find('|', bar1 + 1) : string::npos;
+            if (bar2 >= end) return false;
+            try {
+                int number = stoi(record.substr(pos, bar1 - pos));
+                double balance = stod(record.substr(bar1 + 1, bar2 - bar1 - 1));
+                accounts.emplace_back(number, string_view(record).substr(bar2 + 1, end - bar2 - 1), balance);
+            } catch (const exception&) {
+                return false;
+            }
+            pos = end + 1;
+        }
+        return true;
+    });
+    return ok && header && accounts.size() == expected;
+}
+
+}
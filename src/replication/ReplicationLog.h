@@ -0,0 +1,60 @@
+#pragma once
+#include "../core/Bank.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// The shared directory a primary bank ships its changes through to a standby (see
+// ReplicationPrimary and ReplicationStandby). Everything in it is sealed with the master
+// password, so the directory can sit on any disk both processes can reach:
+//
+//   <seq>.segment   SealedLog of change records; the first has sequence number <seq> and
+//                   the rest follow without gaps. Only the newest segment is still written.
+//   <seq>.image     SealedLog holding the accounts after record <seq>: a header record
+//                   "S|<seq>|<accounts>" and then batches of "number|balance|holder" lines.
+//   <seq>.journal   the primary's transaction journal at the same point (absent if empty).
+//   primary.status  "<last shipped seq> <time ns>", rewritten a few times a second.
+//   standby.ack     "<last applied seq> <time ns>", rewritten by the standby.
+//
+// Each change record is "<primary time ns>|<Bank replication record>". A standby starts from
+// the newest image and applies the segments after it; the primary writes a new image every so
+// often and deletes the segments and images it supersedes.
+namespace ReplicationLog {
+
+string segmentPath(const string &dir, uint64_t firstSeq);
+string imagePath(const string &dir, uint64_t seq);
+string journalPath(const string &dir, uint64_t seq);
+string statusPath(const string &dir);
+string ackPath(const string &dir);
+
+// First sequence numbers of the segments / sequence numbers of the images, ascending.
+vector<uint64_t> segments(const string &dir);
+vector<uint64_t> images(const string &dir);
+
+int64_t nowNs(); // system_clock, comparable between processes on one machine
+
+// "<seq> <time ns>" files, replaced atomically.
+bool writeMark(const string &path, uint64_t seq, int64_t ns);
+bool readMark(const string &path, uint64_t &seq, int64_t &ns);
+
+// Image records: writeImage seals it aside and renames it into place; readImage checks the
+// header against 'seq'.
+bool writeImage(const string &dir, uint64_t seq, const Bank::AccountsView &accounts, string_view password);
+bool readImage(const string &dir, uint64_t seq, string_view password, vector<BankAccount> &accounts);
+
+}
+
+// Counters both ends report. Rates are over roughly the last second.
+struct ReplicationMetrics {
+    uint64_t lastSeq = 0;     // primary: last record shipped; standby: last record applied
+    uint64_t peerSeq = 0;     // primary: last record the standby acknowledged; standby: last shipped
+    uint64_t lagRecords = 0;  // records shipped but not yet applied
+    double lagMs = 0;         // standby: time from shipping to applying, for the last record applied
+    uint64_t records = 0;     // since start
+    uint64_t bytes = 0;
+    double recordsPerSec = 0;
+    double bytesPerSec = 0;
+    uint64_t images = 0;      // primary: written; standby: restored
+};
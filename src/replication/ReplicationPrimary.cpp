@@ -0,0 +1,180 @@
+#include "ReplicationPrimary.h"
+#include <chrono>
+#include <filesystem>
+using namespace std;
+
+static constexpr auto TICK = chrono::milliseconds(200); // status file and rate updates
+
+ReplicationPrimary::ReplicationPrimary(Bank &b, const string &d, string_view pwd)
+    : bank(b), dir(d), password(pwd) {}
+
+ReplicationPrimary::~ReplicationPrimary() {
+    stop();
+}
+
+bool ReplicationPrimary::start() {
+    if (worker.joinable()) return true;
+    error_code ec;
+    filesystem::create_directories(dir, ec);
+    if (ec) return false;
+
+    // Continue the sequence already in the directory, but skip a number: this run's state
+    // need not follow from the last run's records (its data file may be older than what it
+    // shipped), so a standby has to start again from this run's first image.
+    uint64_t last = 0;
+    vector<uint64_t> segs = ReplicationLog::segments(dir);
+    vector<uint64_t> imgs = ReplicationLog::images(dir);
+    if (!imgs.empty()) last = imgs.back();
+    if (!segs.empty()) {
+        CryptoUtils::SealedLogReader reader;
+        if (!reader.open(ReplicationLog::segmentPath(dir, segs.back()), password) ||
+            !reader.poll([](const string&) { return true; }))
+            return false;
+        last = max(last, segs.back() + reader.records() - 1);
+    }
+    lastSeq = last + 1;
+    // A fresh segment, so nothing is appended behind a torn record of the last run; it has to
+    // exist before the first image, which may prune every older one.
+    if (!openSegment(last + 2)) return false;
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = false;
+        imageWanted = true;
+    }
+    bank.setReplicationSink([this](const string &record) { ship(record); });
+    worker = thread(&ReplicationPrimary::run, this);
+    return true;
+}
+
+void ReplicationPrimary::stop() {
+    if (!worker.joinable()) return;
+    bank.setReplicationSink(nullptr);
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+    segment.close();
+}
+
+bool ReplicationPrimary::openSegment(uint64_t firstSeq) {
+    string path = ReplicationLog::segmentPath(dir, firstSeq);
+    error_code ec;
+    filesystem::remove(path, ec); // an empty segment left by a previous run, or a torn one
+    return segment.open(path, password, [](const string&) { return true; });
+}
+
+void ReplicationPrimary::ship(const string &record) {
+    if (broken) return; // the next image covers it
+    string framed = to_string(ReplicationLog::nowNs()) + "|" + record;
+    if (!segment.append(framed)) {
+        broken = true;
+    } else {
+        uint64_t seq = ++lastSeq;
+        ++shippedRecords;
+        shippedBytes += framed.size();
+        if (segment.records() >= SEGMENT_RECORDS && !openSegment(seq + 1)) broken = true;
+    }
+    if (broken || ++sinceImage >= IMAGE_EVERY) {
+        lock_guard<mutex> lk(mtx);
+        imageWanted = true;
+        wake.notify_one();
+    }
+}
+
+bool ReplicationPrimary::writeImage() {
+    string journalTmp = (filesystem::path(dir) / "image.journal.tmp").string();
+    shared_ptr<const Bank::AccountsView> view;
+    uint64_t seq = 0;
+    bool captured = bank.captureState(journalTmp, [&](shared_ptr<const Bank::AccountsView> accounts) {
+        if (broken) {
+            // Records were lost: skip a sequence number so the standby sees the gap, and
+            // carry on in a new segment. The image below includes everything lost.
+            uint64_t next = lastSeq + 2;
+            if (!openSegment(next)) return; // still broken; try again with the next image
+            lastSeq = next - 1;
+            broken = false;
+        }
+        sinceImage = 0;
+        seq = lastSeq;
+        view = move(accounts);
+    });
+    if (!captured || !view) return false;
+
+    error_code ec;
+    bool ok = true;
+    if (filesystem::exists(journalTmp)) {
+        filesystem::rename(journalTmp, ReplicationLog::journalPath(dir, seq), ec);
+        ok = !ec;
+    }
+    // The image goes last: once it is there, the standby may use it.
+    ok = ok && ReplicationLog::writeImage(dir, seq, *view, password);
+    if (!ok) return false;
+    ++imagesWritten;
+    prune(seq);
+    return true;
+}
+
+// Removes images older than 'imageSeq' and the segments holding only records up to it. On
+// Windows a file the standby still has open stays; the next prune gets it.
+void ReplicationPrimary::prune(uint64_t imageSeq) {
+    error_code ec;
+    for (uint64_t seq : ReplicationLog::images(dir)) {
+        if (seq >= imageSeq) break;
+        filesystem::remove(ReplicationLog::imagePath(dir, seq), ec);
+        filesystem::remove(ReplicationLog::journalPath(dir, seq), ec);
+    }
+    vector<uint64_t> segs = ReplicationLog::segments(dir);
+    for (size_t i = 0; i + 1 < segs.size() && segs[i + 1] <= imageSeq + 1; ++i)
+        filesystem::remove(ReplicationLog::segmentPath(dir, segs[i]), ec);
+}
+
+void ReplicationPrimary::run() {
+    string status = ReplicationLog::statusPath(dir);
+    string ack = ReplicationLog::ackPath(dir);
+    auto sampled = chrono::steady_clock::now();
+    uint64_t sampledRecords = shippedRecords, sampledBytes = shippedBytes;
+    unique_lock<mutex> lk(mtx);
+    while (!stopping) {
+        if (imageWanted) {
+            imageWanted = false;
+            lk.unlock();
+            bool ok = writeImage();
+            lk.lock();
+            if (!ok) imageWanted = true; // retried on the next tick
+        }
+        lk.unlock();
+        ReplicationLog::writeMark(status, lastSeq, ReplicationLog::nowNs());
+        uint64_t seq = 0;
+        int64_t ns = 0;
+        if (ReplicationLog::readMark(ack, seq, ns)) ackedSeq = seq;
+        auto now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - sampled).count();
+        if (seconds >= 1.0) {
+            uint64_t records = shippedRecords, bytes = shippedBytes;
+            recordRate = (records - sampledRecords) / seconds;
+            byteRate = (bytes - sampledBytes) / seconds;
+            sampled = now;
+            sampledRecords = records;
+            sampledBytes = bytes;
+        }
+        lk.lock();
+        wake.wait_for(lk, TICK, [this] { return stopping || imageWanted; });
+    }
+    lk.unlock();
+    ReplicationLog::writeMark(status, lastSeq, ReplicationLog::nowNs());
+}
+
+ReplicationMetrics ReplicationPrimary::metrics() const {
+    ReplicationMetrics m;
+    m.lastSeq = lastSeq;
+    m.peerSeq = ackedSeq;
+    m.lagRecords = m.lastSeq > m.peerSeq ? m.lastSeq - m.peerSeq : 0;
+    m.records = shippedRecords;
+    m.bytes = shippedBytes;
+    m.recordsPerSec = recordRate;
+    m.bytesPerSec = byteRate;
+    m.images = imagesWritten;
+    return m;
+}
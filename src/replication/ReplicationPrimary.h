@@ -0,0 +1,64 @@
+#pragma once
+#include "ReplicationLog.h"
+#include "../core/Bank.h"
+#include "../crypto/CryptoUtils.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+using namespace std;
+
+// Primary side of log shipping: every change the bank makes is appended, in order and before
+// the bank's lock is released, to the newest segment in the replication directory (see
+// ReplicationLog). A worker thread writes images, prunes what they supersede and publishes
+// the shipping position. Start it once the bank is loaded; a load() while shipping is not
+// replicated.
+class ReplicationPrimary {
+public:
+    static constexpr uint64_t SEGMENT_RECORDS = 1 << 16; // records per segment
+    static constexpr uint64_t IMAGE_EVERY = 1 << 20;     // records between images
+
+    ReplicationPrimary(Bank &bank, const string &dir, string_view password);
+    ~ReplicationPrimary(); // stop()
+
+    ReplicationPrimary(const ReplicationPrimary&) = delete;
+    ReplicationPrimary& operator=(const ReplicationPrimary&) = delete;
+
+    // Continues the sequence found in 'dir' (or starts it), hooks into the bank and writes
+    // the first image. False if the directory is unusable or sealed under another password.
+    bool start();
+    void stop();
+    ReplicationMetrics metrics() const;
+
+private:
+    Bank &bank;
+    string dir;
+    SecureString password;
+
+    // Under the bank's lock (the sink and the image capture run there).
+    CryptoUtils::SealedLog segment;
+    bool broken = false;       // a record could not be written: next image starts a new segment
+    uint64_t sinceImage = 0;
+
+    atomic<uint64_t> lastSeq{0};
+    atomic<uint64_t> shippedRecords{0};
+    atomic<uint64_t> shippedBytes{0};
+    atomic<uint64_t> imagesWritten{0};
+    atomic<uint64_t> ackedSeq{0};
+    atomic<double> recordRate{0};
+    atomic<double> byteRate{0};
+
+    mutex mtx;
+    condition_variable wake;
+    bool imageWanted = false;
+    bool stopping = false;
+    thread worker;
+
+    void ship(const string &record); // the bank's replication sink
+    bool openSegment(uint64_t firstSeq);
+    bool writeImage();
+    void prune(uint64_t imageSeq);
+    void run();
+};
@@ -0,0 +1,190 @@
+#include "ReplicationStandby.h"
+#include <algorithm>
+#include <filesystem>
+using namespace std;
+
+ReplicationStandby::ReplicationStandby(Bank &b, const string &d, string_view pwd)
+    : bank(b), dir(d), password(pwd) {}
+
+ReplicationStandby::~ReplicationStandby() {
+    stop();
+}
+
+void ReplicationStandby::start() {
+    if (worker.joinable()) return;
+    bank.setReadOnly(true);
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = promoting = drained = false;
+    }
+    worker = thread(&ReplicationStandby::run, this);
+}
+
+void ReplicationStandby::stop() {
+    if (!worker.joinable()) return;
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+    segment.close();
+    following = false;
+}
+
+bool ReplicationStandby::promote() {
+    if (worker.joinable()) {
+        unique_lock<mutex> lk(mtx);
+        promoting = true;
+        wake.notify_all();
+        wake.wait(lk, [this] { return drained || stopping; });
+        lk.unlock();
+        stop();
+    }
+    if (imagesRestored == 0 || !bank.save()) return false; // never had the primary's state
+    bank.setReadOnly(false);
+    return true;
+}
+
+bool ReplicationStandby::caughtUp() const {
+    return following && appliedSeq >= shippedSeq;
+}
+
+// Restores the newest image that is ahead of what has been applied, then follows from it.
+bool ReplicationStandby::bootstrap() {
+    vector<uint64_t> imgs = ReplicationLog::images(dir);
+    if (imgs.empty() || (appliedSeq > 0 && imgs.back() <= appliedSeq)) return false;
+    uint64_t seq = imgs.back();
+    vector<BankAccount> state;
+    if (!ReplicationLog::readImage(dir, seq, password, state)) return false; // pruned meanwhile: retry
+    if (!bank.restoreState(state, ReplicationLog::journalPath(dir, seq))) return false;
+    // Pruned while it was copied, the journal may have gone missing: take the newer image.
+    if (!filesystem::exists(ReplicationLog::imagePath(dir, seq))) return false;
+    appliedSeq = seq;
+    ++imagesRestored;
+    segment.close();
+    segmentFirst = 0;
+    following = true;
+    return true;
+}
+
+bool ReplicationStandby::apply(const string &record) {
+    size_t bar = record.find('|');
+    if (bar == string::npos) return false;
+    int64_t shippedNs = 0;
+    try {
+        shippedNs = stoll(record.substr(0, bar));
+    } catch (const exception&) {
+        return false;
+    }
+    if (!bank.applyReplicated(record.substr(bar + 1))) return false;
+    lagMs = (ReplicationLog::nowNs() - shippedNs) / 1e6;
+    ++appliedSeq;
+    ++appliedRecords;
+    appliedBytes += record.size();
+    return true;
+}
+
+bool ReplicationStandby::follow() {
+    uint64_t before = appliedSeq;
+    bool more = false;
+    auto take = [this](const string &record) {
+        uint64_t seq = segmentFirst + segment.records();
+        return seq <= appliedSeq || apply(record); // skip what the image already holds
+    };
+    for (;;) {
+        if (segmentFirst == 0) {
+            // The segment holding the next record: the last one starting at or before it.
+            vector<uint64_t> segs = ReplicationLog::segments(dir);
+            auto it = upper_bound(segs.begin(), segs.end(), appliedSeq + 1);
+            if (it == segs.begin()) {
+                if (!segs.empty()) following = false; // pruned past us
+                break;
+            }
+            if (!segment.open(ReplicationLog::segmentPath(dir, *--it), password)) break;
+            segmentFirst = *it;
+        }
+        uint64_t polled = segment.records();
+        if (!segment.poll(take, APPLY_BATCH)) { // damaged, or the bank refused it: rebuild from an image
+            following = false;
+            break;
+        }
+        if (segment.records() - polled == APPLY_BATCH) { // more is likely waiting: next pass
+            more = true;
+            break;
+        }
+        // Move on once the primary has started the next segment. It only does that after the
+        // last record of this one, so one more poll is sure to have seen everything.
+        vector<uint64_t> segs = ReplicationLog::segments(dir);
+        auto next = upper_bound(segs.begin(), segs.end(), segmentFirst);
+        if (next == segs.end()) break;
+        if (!segment.poll(take) || *next != appliedSeq + 1) { // a gap: a later image covers it
+            following = false;
+            break;
+        }
+        segment.close();
+        segmentFirst = 0;
+    }
+    if (!following) {
+        segment.close();
+        segmentFirst = 0;
+    }
+    return more || appliedSeq != before;
+}
+
+void ReplicationStandby::run() {
+    string status = ReplicationLog::statusPath(dir);
+    string ack = ReplicationLog::ackPath(dir);
+    auto sampled = chrono::steady_clock::now();
+    auto checkpointed = sampled;
+    uint64_t sampledRecords = appliedRecords, sampledBytes = appliedBytes;
+    uint64_t acked = UINT64_MAX;
+    uint64_t saved = appliedSeq;
+    for (;;) {
+        bool progressed = following ? follow() : bootstrap();
+        uint64_t seq = 0;
+        int64_t ns = 0;
+        if (ReplicationLog::readMark(status, seq, ns)) shippedSeq = seq;
+        if (appliedSeq != acked) {
+            acked = appliedSeq;
+            ReplicationLog::writeMark(ack, acked, ReplicationLog::nowNs());
+        }
+        auto now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - sampled).count();
+        if (seconds >= 1.0) {
+            uint64_t records = appliedRecords, bytes = appliedBytes;
+            recordRate = (records - sampledRecords) / seconds;
+            byteRate = (bytes - sampledBytes) / seconds;
+            sampled = now;
+            sampledRecords = records;
+            sampledBytes = bytes;
+        }
+        if (following && appliedSeq != saved && now - checkpointed >= CHECKPOINT && bank.save()) {
+            saved = appliedSeq;
+            checkpointed = now;
+        }
+
+        unique_lock<mutex> lk(mtx);
+        if (stopping) break;
+        if (promoting && !progressed) {
+            drained = true; // nothing more shipped since the last look
+            wake.notify_all();
+            break;
+        }
+        if (!progressed) wake.wait_for(lk, POLL, [this] { return stopping || promoting; });
+    }
+}
+
+ReplicationMetrics ReplicationStandby::metrics() const {
+    ReplicationMetrics m;
+    m.lastSeq = appliedSeq;
+    m.peerSeq = shippedSeq;
+    m.lagRecords = m.peerSeq > m.lastSeq ? m.peerSeq - m.lastSeq : 0;
+    m.lagMs = lagMs;
+    m.records = appliedRecords;
+    m.bytes = appliedBytes;
+    m.recordsPerSec = recordRate;
+    m.bytesPerSec = byteRate;
+    m.images = imagesRestored;
+    return m;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "ReplicationLog.h"
+#include "../core/Bank.h"
+#include "../crypto/CryptoUtils.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+using namespace std;
+
+// Standby side of log shipping: keeps a read-only bank in step with a primary by restoring
+// its newest image and then applying the segments after it (see ReplicationLog) as they
+// grow. The bank publishes ordinary change events while it follows, and is saved every
+// CHECKPOINT so its own files stay close behind. A standby that falls behind the primary's
+// pruning, or meets a gap, starts again from the next image.
+class ReplicationStandby {
+public:
+    static constexpr chrono::milliseconds POLL{20};
+    static constexpr chrono::seconds CHECKPOINT{10};
+    // Records applied per pass at most, so the marks, metrics and checkpoints between passes
+    // keep up while the primary is busy.
+    static constexpr uint64_t APPLY_BATCH = 4096;
+
+    ReplicationStandby(Bank &bank, const string &dir, string_view password);
+    ~ReplicationStandby(); // stop()
+
+    ReplicationStandby(const ReplicationStandby&) = delete;
+    ReplicationStandby& operator=(const ReplicationStandby&) = delete;
+
+    // Makes the bank read-only and starts following; the first image may not exist yet.
+    void start();
+    void stop();
+    // Applies everything shipped so far, stops following, saves the bank and makes it
+    // writable. False if no image was ever restored. The primary must be stopped first
+    // (nothing here fences it off).
+    bool promote();
+    bool caughtUp() const; // everything the primary last reported shipping is applied
+    ReplicationMetrics metrics() const;
+
+private:
+    Bank &bank;
+    string dir;
+    SecureString password;
+
+    // Worker state.
+    CryptoUtils::SealedLogReader segment;
+    uint64_t segmentFirst = 0;
+    atomic<bool> following{false};
+
+    atomic<uint64_t> appliedSeq{0};
+    atomic<uint64_t> shippedSeq{0};
+    atomic<double> lagMs{0};
+    atomic<uint64_t> appliedRecords{0};
+    atomic<uint64_t> appliedBytes{0};
+    atomic<uint64_t> imagesRestored{0};
+    atomic<double> recordRate{0};
+    atomic<double> byteRate{0};
+
+    mutable mutex mtx;
+    condition_variable wake;
+    bool stopping = false;
+    bool promoting = false;
+    bool drained = false;
+    thread worker;
+
+    void run();
+    bool bootstrap();
+    bool follow(); // true if anything was applied, or a pass stopped at APPLY_BATCH
+    bool apply(const string &record);
+};
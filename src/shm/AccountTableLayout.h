@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+using namespace std;
+
+// Memory layout of the shared account table, written by AccountTablePublisher and read by
+// AccountTableReader in other processes. There are two segments: a small root at <name> that
+// never changes size and names the current table, and the table itself at <name>.<generation>.
+// When the table has to grow the publisher builds a bigger one under a new generation, points
+// the root at it and marks the old one retired; readers move over on their next read.
+//
+// Every field another process may read while it changes is a lock-free atomic. Rows are
+// guarded by a per-row seqlock: the publisher makes 'seq' odd, writes the row, and makes it
+// even again; a reader copies the row and keeps the copy only if 'seq' was the same even value
+// before and after.
+namespace AccountTableLayout {
+
+static_assert(atomic<uint64_t>::is_always_lock_free && atomic<int64_t>::is_always_lock_free,
+              "the shared table needs address-free 64-bit atomics");
+
+constexpr char ROOT_MAGIC[8] = {'S', 'B', 'K', 'S', 'H', 'M', 'R', '1'};
+constexpr char TABLE_MAGIC[8] = {'S', 'B', 'K', 'S', 'H', 'M', 'T', '1'};
+constexpr uint32_t VERSION = 1;
+
+constexpr int64_t EMPTY_KEY = INT64_MIN;
+constexpr int64_t TOMBSTONE_KEY = INT64_MIN + 1;
+
+struct Root {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    atomic<uint64_t> generation; // the current table is <name>.<generation>; 0 before the first
+};
+
+struct TableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rowSize;
+    uint64_t capacity;            // rows
+    uint64_t slotCount;           // index slots, a power of two
+    atomic<uint64_t> retired;     // nonzero once a newer generation has replaced this table
+    atomic<uint64_t> rowCount;
+    atomic<uint64_t> bankVersion; // Bank snapshot version the table was last brought up to
+    atomic<int64_t> updatedNs;    // system_clock time of that update, for staleness checks
+    atomic<uint64_t> indexEpoch;  // odd while the index is being rebuilt
+    uint64_t reserved[7];
+};
+static_assert(sizeof(TableHeader) % 64 == 0, "rows start on a cache line");
+
+// One account, at the same position as in the bank's table.
+struct Row {
+    atomic<uint64_t> seq;
+    atomic<int64_t> accountNumber;
+    atomic<uint64_t> balanceBits; // the balance's IEEE-754 bits
+    atomic<uint64_t> version;     // Bank snapshot version the row was written from
+};
+
+// Open-addressed index from account number to row. Only a hint: readers check the row.
+struct Slot {
+    atomic<int64_t> key; // EMPTY_KEY, TOMBSTONE_KEY or an account number
+    atomic<uint64_t> row;
+};
+
+inline size_t tableBytes(uint64_t capacity, uint64_t slotCount) {
+    return sizeof(TableHeader) + capacity * sizeof(Row) + slotCount * sizeof(Slot);
+}
+
+template <typename H>
+auto rows(H *header) {
+    using R = conditional_t<is_const<H>::value, const Row, Row>;
+    return reinterpret_cast<R*>(header + 1);
+}
+
+template <typename H>
+auto slots(H *header) {
+    using S = conditional_t<is_const<H>::value, const Slot, Slot>;
+    return reinterpret_cast<S*>(rows(header) + header->capacity);
+}
+
+inline uint64_t slotOf(int64_t key, uint64_t slotCount) {
+    uint64_t x = uint64_t(key) * 0x9E3779B97F4A7C15ull;
+    return (x ^ (x >> 29)) & (slotCount - 1);
+}
+
+}
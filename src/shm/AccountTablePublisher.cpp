@@ -0,0 +1,227 @@
+#include "AccountTablePublisher.h"
+#include <chrono>
+#include <cstring>
+using namespace std;
+using namespace AccountTableLayout;
+
+static constexpr uint64_t MIN_CAPACITY = 1024;
+
+static string tableName(const string &name, uint64_t generation) {
+    return name + "." + to_string(generation);
+}
+
+static int64_t nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+AccountTablePublisher::AccountTablePublisher(Bank &bank, const string &name) : bank(bank), name(name) {}
+
+AccountTablePublisher::~AccountTablePublisher() {
+    stop();
+}
+
+bool AccountTablePublisher::start() {
+    if (worker.joinable()) return true;
+    if (!root.create(name, sizeof(Root))) return false;
+    Root *r = static_cast<Root*>(root.data());
+    memcpy(r->magic, ROOT_MAGIC, sizeof(ROOT_MAGIC));
+    r->version = VERSION;
+    // Generations are named after the start time, so tables left behind by an earlier run
+    // (which a reader may still have open) are never reused.
+    generation = uint64_t(nowNs());
+    stopping = false;
+    pending = true; // the first pass copies the whole table
+    feed = bank.subscribe(4096, [this] {
+        lock_guard<mutex> lk(mtx);
+        pending = true;
+        wake.notify_one();
+    });
+    worker = thread([this] { run(); });
+    return true;
+}
+
+void AccountTablePublisher::stop() {
+    if (!worker.joinable()) return;
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = true;
+        wake.notify_one();
+    }
+    worker.join();
+    bank.unsubscribe(feed);
+    feed.reset();
+    if (header) header->retired.store(1, memory_order_release);
+    header = nullptr;
+    table.reset();
+    SharedMemory::remove(tableName(name, generation));
+    root.close();
+    SharedMemory::remove(name);
+}
+
+uint64_t AccountTablePublisher::mirroredVersion() const {
+    return mirrored.load(memory_order_acquire);
+}
+
+void AccountTablePublisher::run() {
+    bool full = true;
+    vector<size_t> touched;
+    for (;;) {
+        {
+            unique_lock<mutex> lk(mtx);
+            wake.wait(lk, [this] { return pending || stopping; });
+            if (stopping) return;
+            pending = false;
+        }
+        if (feed->resyncNeeded()) full = true;
+        touched.clear();
+        feed->drain([&](const ChangeEvent &ev) {
+            if (ev.kind == ChangeEvent::Reset) full = true;
+            else touched.push_back(ev.position);
+        });
+        // The bank publishes a snapshot before the events for it, so this one covers at least
+        // every event drained above; later events bring the rows they change again.
+        auto view = bank.accountsSnapshot();
+        sync(*view, touched, full);
+        full = false;
+    }
+}
+
+void AccountTablePublisher::sync(const Bank::AccountsView &view, const vector<size_t> &touched, bool full) {
+    if (!header || view.size() > header->capacity) {
+        if (!grow(view)) return;
+    } else {
+        uint64_t version = view.version();
+        size_t count = view.size();
+        size_t old = header->rowCount.load(memory_order_relaxed);
+        if (full) {
+            for (size_t i = 0; i < count; ++i) writeRow(i, view[i], version);
+        } else {
+            for (size_t pos : touched) {
+                if (pos < min(old, count)) writeRow(pos, view[pos], version);
+            }
+            for (size_t i = old; i < count; ++i) writeRow(i, view[i], version);
+        }
+        // Rows past the end leave the index; their contents stay until they are reused.
+        Row *r = rows(header);
+        for (size_t i = count; i < indexed; ++i) indexErase(r[i].accountNumber.load(memory_order_relaxed), i);
+        indexed = min<uint64_t>(indexed, count);
+        header->rowCount.store(count, memory_order_release);
+        header->bankVersion.store(version, memory_order_release);
+    }
+    header->updatedNs.store(nowNs(), memory_order_release);
+    mirrored.store(view.version(), memory_order_release);
+}
+
+// Builds a table with room to spare under the next generation, fills it from 'view' and
+// points the root at it; the old table is marked retired for readers that still have it.
+bool AccountTablePublisher::grow(const Bank::AccountsView &view) {
+    uint64_t capacity = MIN_CAPACITY;
+    while (capacity < view.size() + view.size() / 2) capacity *= 2;
+    uint64_t slotCount = capacity * 2;
+    auto next = make_unique<SharedMemory>();
+    if (!next->create(tableName(name, generation + 1), tableBytes(capacity, slotCount))) return false;
+    TableHeader *h = static_cast<TableHeader*>(next->data());
+    memcpy(h->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    h->version = VERSION;
+    h->rowSize = sizeof(Row);
+    h->capacity = capacity;
+    h->slotCount = slotCount;
+    Slot *s = slots(h);
+    for (uint64_t i = 0; i < slotCount; ++i) s[i].key.store(EMPTY_KEY, memory_order_relaxed);
+
+    TableHeader *old = header;
+    header = h;
+    indexed = 0;
+    slotsInUse = 0;
+    for (size_t i = 0; i < view.size(); ++i) writeRow(i, view[i], view.version());
+    h->rowCount.store(view.size(), memory_order_relaxed);
+    h->bankVersion.store(view.version(), memory_order_relaxed);
+
+    ++generation;
+    static_cast<Root*>(root.data())->generation.store(generation, memory_order_release);
+    if (old) old->retired.store(1, memory_order_release);
+    table = move(next);
+    SharedMemory::remove(tableName(name, generation - 1));
+    return true;
+}
+
+void AccountTablePublisher::writeRow(size_t row, const BankAccount &acc, uint64_t version) {
+    Row &r = rows(header)[row];
+    int64_t before = r.accountNumber.load(memory_order_relaxed);
+    int64_t number = acc.getAccountNumber();
+    double balance = acc.getBalance();
+    uint64_t bits;
+    memcpy(&bits, &balance, sizeof(bits));
+
+    uint64_t seq = r.seq.load(memory_order_relaxed);
+    r.seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    r.accountNumber.store(number, memory_order_relaxed);
+    r.balanceBits.store(bits, memory_order_relaxed);
+    r.version.store(version, memory_order_relaxed);
+    r.seq.store(seq + 2, memory_order_release);
+
+    if (row < indexed) {
+        if (before == number) return;
+        indexErase(before, row);
+    }
+    indexPut(number, row);
+    if (row >= indexed) indexed = row + 1; // new rows are written in order
+}
+
+void AccountTablePublisher::indexPut(int64_t key, uint64_t row) {
+    if ((slotsInUse + 1) * 4 > header->slotCount * 3) rebuildIndex();
+    Slot *s = slots(header);
+    uint64_t mask = header->slotCount - 1;
+    Slot *reuse = nullptr;
+    for (uint64_t i = slotOf(key, header->slotCount);; i = (i + 1) & mask) {
+        int64_t k = s[i].key.load(memory_order_relaxed);
+        if (k == key) {
+            s[i].row.store(row, memory_order_release);
+            return;
+        }
+        if (k == TOMBSTONE_KEY && !reuse) reuse = &s[i];
+        if (k == EMPTY_KEY) {
+            if (!reuse) {
+                reuse = &s[i];
+                ++slotsInUse;
+            }
+            break;
+        }
+    }
+    reuse->row.store(row, memory_order_relaxed);
+    reuse->key.store(key, memory_order_release);
+}
+
+void AccountTablePublisher::indexErase(int64_t key, uint64_t row) {
+    Slot *s = slots(header);
+    uint64_t mask = header->slotCount - 1;
+    for (uint64_t i = slotOf(key, header->slotCount);; i = (i + 1) & mask) {
+        int64_t k = s[i].key.load(memory_order_relaxed);
+        if (k == EMPTY_KEY) return;
+        if (k == key) {
+            // The account may already have moved to another row and been re-pointed there.
+            if (s[i].row.load(memory_order_relaxed) == row) s[i].key.store(TOMBSTONE_KEY, memory_order_release);
+            return;
+        }
+    }
+}
+
+// Drops the tombstones. Readers that catch the index mid-rebuild (odd epoch) scan instead.
+void AccountTablePublisher::rebuildIndex() {
+    header->indexEpoch.fetch_add(1, memory_order_acq_rel);
+    Slot *s = slots(header);
+    for (uint64_t i = 0; i < header->slotCount; ++i) s[i].key.store(EMPTY_KEY, memory_order_relaxed);
+    slotsInUse = 0;
+    Row *r = rows(header);
+    uint64_t mask = header->slotCount - 1;
+    for (uint64_t row = 0; row < indexed; ++row) {
+        int64_t key = r[row].accountNumber.load(memory_order_relaxed);
+        uint64_t i = slotOf(key, header->slotCount);
+        while (s[i].key.load(memory_order_relaxed) != EMPTY_KEY) i = (i + 1) & mask;
+        s[i].row.store(row, memory_order_relaxed);
+        s[i].key.store(key, memory_order_relaxed);
+        ++slotsInUse;
+    }
+    header->indexEpoch.fetch_add(1, memory_order_release);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "AccountTableLayout.h"
+#include "SharedMemory.h"
+#include "../core/Bank.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Mirrors the bank's account table (number, balance, version) into shared memory, so that
+// reporting and monitoring processes can read current balances with AccountTableReader
+// without going through this process. A worker thread follows the bank's change feed and
+// copies the rows each batch of changes touched from the bank's latest snapshot; the bank
+// itself never waits on the mirror. See AccountTableLayout for the format.
+class AccountTablePublisher {
+public:
+    explicit AccountTablePublisher(Bank &bank, const string &name = "sbank-accounts");
+    ~AccountTablePublisher(); // stops and removes the segments
+
+    AccountTablePublisher(const AccountTablePublisher&) = delete;
+    AccountTablePublisher& operator=(const AccountTablePublisher&) = delete;
+
+    // Creates the segments and starts mirroring. False if shared memory is unavailable.
+    bool start();
+    void stop();
+    // Bank snapshot version the table was last brought up to (0 before the first sync).
+    uint64_t mirroredVersion() const;
+
+private:
+    Bank &bank;
+    string name;
+    shared_ptr<ChangeSubscription> feed;
+    SharedMemory root;
+    unique_ptr<SharedMemory> table;
+    AccountTableLayout::TableHeader *header = nullptr;
+    uint64_t generation = 0;
+    uint64_t indexed = 0;    // rows whose account numbers are in the index
+    uint64_t slotsInUse = 0; // live keys plus tombstones
+    atomic<uint64_t> mirrored{0};
+
+    mutex mtx;
+    condition_variable wake;
+    bool pending = false;
+    bool stopping = false;
+    thread worker;
+
+    void run();
+    void sync(const Bank::AccountsView &view, const vector<size_t> &touched, bool full);
+    bool grow(const Bank::AccountsView &view);
+    void writeRow(size_t row, const BankAccount &acc, uint64_t version);
+    void indexPut(int64_t key, uint64_t row);
+    void indexErase(int64_t key, uint64_t row);
+    void rebuildIndex();
+};
@@ -0,0 +1,129 @@
+#include "AccountTableReader.h"
+#include <cstring>
+#include <thread>
+using namespace std;
+using namespace AccountTableLayout;
+
+static constexpr int MAX_READ_SPINS = 1 << 16; // a publisher that died mid-row does not hang us
+
+bool AccountTableReader::open(const string &tableName) {
+    close();
+    name = tableName;
+    if (openRoot() && attach()) return true;
+    close();
+    return false;
+}
+
+void AccountTableReader::close() {
+    header = nullptr;
+    generation = 0;
+    table.reset();
+    root.close();
+}
+
+bool AccountTableReader::openRoot() {
+    if (!root.openRead(name) || root.size() < sizeof(Root)) return false;
+    const Root *r = static_cast<const Root*>(root.data());
+    return memcmp(r->magic, ROOT_MAGIC, sizeof(ROOT_MAGIC)) == 0 && r->version == VERSION;
+}
+
+bool AccountTableReader::attach() {
+    if (!root.data()) return false;
+    uint64_t gen = static_cast<const Root*>(root.data())->generation.load(memory_order_acquire);
+    if (gen == 0 || gen == generation) return false; // no table yet, or no successor to this one
+    auto next = make_unique<SharedMemory>();
+    if (!next->openRead(name + "." + to_string(gen)) || next->size() < sizeof(TableHeader)) return false;
+    const TableHeader *h = static_cast<const TableHeader*>(next->data());
+    if (memcmp(h->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 || h->version != VERSION ||
+        h->rowSize != sizeof(Row) || next->size() < tableBytes(h->capacity, h->slotCount))
+        return false;
+    table = move(next);
+    header = h;
+    generation = gen;
+    return true;
+}
+
+bool AccountTableReader::current() {
+    if (header && !header->retired.load(memory_order_acquire)) return true;
+    if (attach()) return true;
+    // The publisher stopped, or started over with a new root: look the name up again.
+    return openRoot() && attach();
+}
+
+bool AccountTableReader::readAt(const TableHeader *h, size_t row, SharedAccount &out) const {
+    const Row &r = rows(h)[row];
+    for (int spin = 0; spin < MAX_READ_SPINS; ++spin) {
+        uint64_t before = r.seq.load(memory_order_acquire);
+        if (before & 1) {
+            if (spin > 64) this_thread::yield();
+            continue;
+        }
+        int64_t number = r.accountNumber.load(memory_order_relaxed);
+        uint64_t bits = r.balanceBits.load(memory_order_relaxed);
+        uint64_t version = r.version.load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (r.seq.load(memory_order_relaxed) != before) continue;
+        out.accountNumber = int(number);
+        memcpy(&out.balance, &bits, sizeof(bits));
+        out.version = version;
+        return true;
+    }
+    return false;
+}
+
+size_t AccountTableReader::size() {
+    return current() ? size_t(header->rowCount.load(memory_order_acquire)) : 0;
+}
+
+bool AccountTableReader::readRow(size_t row, SharedAccount &out) {
+    if (!current() || row >= header->rowCount.load(memory_order_acquire)) return false;
+    return readAt(header, row, out);
+}
+
+bool AccountTableReader::find(int accountNumber, SharedAccount &out) {
+    if (!current()) return false;
+    const TableHeader *h = header;
+    uint64_t count = h->rowCount.load(memory_order_acquire);
+    uint64_t epoch = h->indexEpoch.load(memory_order_acquire);
+    if (!(epoch & 1)) {
+        const Slot *s = slots(h);
+        uint64_t mask = h->slotCount - 1;
+        uint64_t i = slotOf(accountNumber, h->slotCount);
+        bool moving = false;
+        for (uint64_t probes = 0; probes < h->slotCount; ++probes, i = (i + 1) & mask) {
+            int64_t key = s[i].key.load(memory_order_acquire);
+            if (key == EMPTY_KEY) break;
+            if (key != accountNumber) continue;
+            uint64_t row = s[i].row.load(memory_order_acquire);
+            if (row < count && readAt(h, row, out) && out.accountNumber == accountNumber) return true;
+            moving = true; // the entry and its row disagree: the account is being moved
+            break;
+        }
+        // A miss is final unless the index was rebuilt meanwhile.
+        if (!moving && h->indexEpoch.load(memory_order_acquire) == epoch) return false;
+    }
+    // Index unusable right now: scan.
+    for (uint64_t row = 0; row < count; ++row) {
+        if (readAt(h, row, out) && out.accountNumber == accountNumber) return true;
+    }
+    return false;
+}
+
+bool AccountTableReader::forEach(const function<bool(const SharedAccount&)> &visit) {
+    if (!current()) return false;
+    const TableHeader *h = header;
+    SharedAccount acc;
+    for (uint64_t row = 0; row < h->rowCount.load(memory_order_acquire); ++row) {
+        if (h->retired.load(memory_order_acquire) || !readAt(h, row, acc)) return false;
+        if (!visit(acc)) break;
+    }
+    return true;
+}
+
+uint64_t AccountTableReader::bankVersion() {
+    return current() ? header->bankVersion.load(memory_order_acquire) : 0;
+}
+
+int64_t AccountTableReader::updatedNs() {
+    return current() ? header->updatedNs.load(memory_order_acquire) : 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "AccountTableLayout.h"
+#include "SharedMemory.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+using namespace std;
+
+struct SharedAccount {
+    int accountNumber = 0;
+    double balance = 0.0;
+    uint64_t version = 0; // Bank snapshot version the row was written from
+};
+
+// Reads the account table that an AccountTablePublisher mirrors into shared memory. Reads
+// go straight to the shared pages without locks or messages to the publisher; each row comes
+// back consistent (per-row seqlock), and rows can be from slightly different versions when
+// the publisher is mid-update. Follows the publisher to a new table when it grows. Not
+// thread-safe: use one reader per thread.
+class AccountTableReader {
+public:
+    bool open(const string &name = "sbank-accounts");
+    void close();
+
+    size_t size();                               // rows right now
+    bool readRow(size_t row, SharedAccount &out); // false past the end or if the table is gone
+    bool find(int accountNumber, SharedAccount &out);
+    // Visits rows 0..size()-1; stops early if 'visit' returns false. False if the table went
+    // away or was replaced part way; start over after that.
+    bool forEach(const function<bool(const SharedAccount&)> &visit);
+
+    uint64_t bankVersion();  // version the publisher last brought the table up to
+    int64_t updatedNs();     // system_clock time of that, in ns since the epoch; 0 if closed
+
+private:
+    string name;
+    SharedMemory root;
+    unique_ptr<SharedMemory> table;
+    const AccountTableLayout::TableHeader *header = nullptr;
+    uint64_t generation = 0;
+
+    bool openRoot();
+    bool attach();  // opens the table the root names, if it is not the one already open
+    bool current(); // moves to the newest table if this one was retired
+    bool readAt(const AccountTableLayout::TableHeader *h, size_t row, SharedAccount &out) const;
+};
@@ -0,0 +1,112 @@
+#include "SharedMemory.h"
+#include <cstring>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+SharedMemory::~SharedMemory() {
+    close();
+}
+
+#if defined(_WIN32)
+
+static string platformName(const string &name) {
+    return "Local\\" + name;
+}
+
+bool SharedMemory::create(const string &name, size_t size) {
+    close();
+    uint64_t size64 = size;
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, DWORD(size64 >> 32),
+                                 DWORD(size64 & 0xFFFFFFFFu), platformName(name).c_str());
+    if (!mapping) return false;
+    // A name cannot be taken over while others hold it open; a mapping that already exists
+    // keeps its old size and contents, so it is reused only if big enough, and cleared.
+    bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    base = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!base || (existed && (!VirtualQuery(base, &info, sizeof(info)) || info.RegionSize < size))) {
+        close();
+        return false;
+    }
+    if (existed) memset(base, 0, size);
+    length = size;
+    return true;
+}
+
+bool SharedMemory::openRead(const string &name) {
+    close();
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, platformName(name).c_str());
+    if (!mapping) return false;
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!base || !VirtualQuery(base, &info, sizeof(info))) { close(); return false; }
+    length = info.RegionSize;
+    return true;
+}
+
+void SharedMemory::close() {
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    base = nullptr;
+    mapping = nullptr;
+    length = 0;
+}
+
+void SharedMemory::remove(const string &) {}
+
+#else
+
+static string platformName(const string &name) {
+    return "/" + name;
+}
+
+bool SharedMemory::create(const string &name, size_t size) {
+    close();
+    string path = platformName(name);
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return false;
+    void *p = ftruncate(fd, off_t(size)) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                                              : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        return false;
+    }
+    base = p;
+    length = size;
+    return true;
+}
+
+bool SharedMemory::openRead(const string &name) {
+    close();
+    int fd = shm_open(platformName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    base = p;
+    length = size_t(st.st_size);
+    return true;
+}
+
+void SharedMemory::close() {
+    if (base) munmap(base, length);
+    base = nullptr;
+    length = 0;
+}
+
+void SharedMemory::remove(const string &name) {
+    shm_unlink(platformName(name).c_str());
+}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+using namespace std;
+
+// A named shared-memory segment (shm_open, or a named file mapping on Windows), for handing
+// data to other local processes without a copy. Names are plain words; the platform prefix
+// ("/" or "Local\") is added here.
+class SharedMemory {
+public:
+    SharedMemory() = default;
+    ~SharedMemory();
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Creates a zero-filled segment of 'size' bytes, replacing any segment of that name
+    // (on Windows, reusing it if it is still open elsewhere and big enough).
+    bool create(const string &name, size_t size);
+    bool openRead(const string &name);
+    void close();
+    // Unlinks the name, so no new opener finds it; mappings stay valid until closed.
+    // On Windows a segment goes away with its last handle and this does nothing.
+    static void remove(const string &name);
+
+    void *data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    void *base = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    void *mapping = nullptr; // HANDLE
+#endif
+};
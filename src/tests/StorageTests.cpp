@@ -0,0 +1,316 @@
+// storage_tests: checks the on-disk formats end to end, in a scratch directory under the
+// system temp dir: chunked containers (round trips, range reads, tampering), SealedLog
+// recovery from a torn record, HUFB block archives and the journal hash chain. Prints each
+// failed check and exits non-zero if there was one.
+#include "../core/Bank.h"
+#include "../core/JournalChain.h"
+#include "../crypto/CryptoUtils.h"
+#include "../compression/BlockArchive.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, int line) {
+    if (ok) return;
+    fprintf(stderr, "line %d: %s failed\n", line, what);
+    ++failures;
+}
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static const char *PASSWORD = "correct horse";
+static const uint32_t CHUNK = CryptoUtils::DEFAULT_CHUNK_SIZE;
+static const uint64_t CONTAINER_HEADER = 52; // see CryptoUtils.h
+static const uint64_t TAG = 16;
+
+static string randomBytes(size_t n, uint32_t seed) {
+    mt19937 rng(seed);
+    string s(n, '\0');
+    for (char &c : s) c = char(rng());
+    return s;
+}
+
+static string transactionLines(size_t count) {
+    string text;
+    for (size_t i = 0; i < count; ++i)
+        text += Transaction("2024-05-01T12:00:00Z", i % 3 ? "Deposit" : "Withdraw", double(i % 977) / 4, int(i % 5000))
+                    .serialize() + "\n";
+    return text;
+}
+
+static string readFile(const string &path) {
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+static void writeFile(const string &path, const string &bytes) {
+    ofstream(path, ios::binary | ios::trunc) << bytes;
+}
+
+static bool decryptAll(const string &path, string &out) {
+    out.clear();
+    return CryptoUtils::decryptStream(path, PASSWORD, [&out](const unsigned char *data, size_t len) {
+        out.append(reinterpret_cast<const char*>(data), len);
+        return true;
+    });
+}
+
+static void roundTrips(const string &dir) {
+    for (size_t size : {size_t(0), size_t(1), size_t(CHUNK), size_t(3 * CHUNK + 1000)}) {
+        string plain = randomBytes(size, uint32_t(size));
+        string sealed = dir + "/rt" + to_string(size), copy = sealed + ".plain", back = sealed + ".back";
+        string text;
+        CHECK(CryptoUtils::encryptBuffer(plain.data(), plain.size(), sealed, PASSWORD, 4));
+        CHECK(CryptoUtils::isChunkedFile(sealed));
+        CHECK(decryptAll(sealed, text) && text == plain);
+        uint64_t plainBytes = 0;
+        CHECK(CryptoUtils::plainSize(sealed, plainBytes) && plainBytes == size);
+
+        writeFile(copy, plain);
+        CHECK(CryptoUtils::encryptFile(copy, back, PASSWORD, 2));
+        CHECK(CryptoUtils::decryptFile(back, copy, PASSWORD) && readFile(copy) == plain);
+        CHECK(!decryptAll(sealed + "-missing", text));
+        CHECK(!CryptoUtils::decryptStream(sealed, "wrong password", [](const unsigned char*, size_t) { return true; }));
+    }
+}
+
+static void rangeReads(const string &dir) {
+    string plain = randomBytes(3 * CHUNK + 1000, 7), path = dir + "/ranges";
+    CHECK(CryptoUtils::encryptBuffer(plain.data(), plain.size(), path, PASSWORD));
+    CryptoUtils::ChunkedReader reader;
+    CHECK(reader.open(path, PASSWORD, 2));
+    CHECK(reader.size() == plain.size());
+    struct Range { uint64_t offset; size_t len; };
+    vector<Range> ranges = {
+        {0, 1}, {CHUNK - 1, 2}, {CHUNK - 10, CHUNK + 20}, {CHUNK, CHUNK}, {2 * CHUNK - 1, 1},
+        {100, 3 * CHUNK}, {3 * CHUNK - 5, 2000}, {plain.size() - 1, 10}, {plain.size(), 10},
+    };
+    for (const Range &r : ranges) {
+        string expected = r.offset < plain.size() ? plain.substr(size_t(r.offset), r.len) : string();
+        string got;
+        CHECK(CryptoUtils::readRange(path, PASSWORD, r.offset, r.len, got) && got == expected);
+        CHECK(reader.read(r.offset, r.len, got) && got == expected);
+    }
+}
+
+static void tampering(const string &dir) {
+    string plain = randomBytes(3 * CHUNK + 1000, 11), path = dir + "/tamper", bad = path + ".bad";
+    CHECK(CryptoUtils::encryptBuffer(plain.data(), plain.size(), path, PASSWORD));
+    string sealed = readFile(path), text;
+
+    // A flipped byte in the second chunk: whole reads fail, as do ranges touching that chunk.
+    string flipped = sealed;
+    flipped[size_t(CONTAINER_HEADER + (CHUNK + TAG) + 100)] ^= 0x01;
+    writeFile(bad, flipped);
+    CHECK(!decryptAll(bad, text));
+    CHECK(!CryptoUtils::readRange(bad, PASSWORD, CHUNK + 50, 10, text));
+    CHECK(CryptoUtils::readRange(bad, PASSWORD, 0, 10, text) && text == plain.substr(0, 10));
+
+    // A flipped header byte (the chunk size) is authenticated by every chunk.
+    flipped = sealed;
+    flipped[12] ^= 0x01;
+    writeFile(bad, flipped);
+    CHECK(!decryptAll(bad, text));
+
+    // A tail cut short, and a whole last chunk missing.
+    writeFile(bad, sealed.substr(0, sealed.size() - 10));
+    CHECK(!decryptAll(bad, text));
+    writeFile(bad, sealed.substr(0, size_t(CONTAINER_HEADER + 3 * (CHUNK + TAG))));
+    CHECK(!decryptAll(bad, text));
+    CryptoUtils::ChunkedReader reader;
+    CHECK(!reader.open(bad, PASSWORD) || !reader.read(3 * CHUNK - 10, 10, text));
+
+    // Chunks swapped.
+    string swapped = sealed;
+    size_t stride = CHUNK + TAG;
+    swapped.replace(size_t(CONTAINER_HEADER), stride, sealed, size_t(CONTAINER_HEADER + stride), stride);
+    swapped.replace(size_t(CONTAINER_HEADER + stride), stride, sealed, size_t(CONTAINER_HEADER), stride);
+    writeFile(bad, swapped);
+    CHECK(!decryptAll(bad, text));
+
+    CHECK(!CryptoUtils::readRange(path, "wrong password", 0, 10, text));
+}
+
+static bool readLog(const string &path, vector<string> &records) {
+    records.clear();
+    CryptoUtils::SealedLog log;
+    return log.open(path, PASSWORD, [&records](const string &record) {
+        records.push_back(record);
+        return true;
+    });
+}
+
+static void tornLog(const string &dir) {
+    string path = dir + "/log";
+    vector<string> written;
+    {
+        CryptoUtils::SealedLog log;
+        CHECK(log.open(path, PASSWORD, nullptr));
+        for (int i = 0; i < 100; ++i) {
+            written.push_back("record " + to_string(i) + "\n");
+            CHECK(log.append(written.back()));
+        }
+        CHECK(log.records() == 100);
+    }
+    string whole = readFile(path);
+    // A crash in the middle of the 101st append: its length prefix and part of its ciphertext.
+    {
+        ofstream out(path, ios::binary | ios::app);
+        uint32_t len = 60;
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out << string(20, 'x');
+    }
+    CryptoUtils::SealedLogReader reader;
+    uint64_t polled = 0;
+    CHECK(reader.open(path, PASSWORD) && reader.poll([&polled](const string&) { return ++polled, true; }));
+    CHECK(polled == 100);
+    reader.close();
+
+    vector<string> records;
+    CHECK(readLog(path, records) && records == written);
+    string rekeyed = readFile(path);
+    CHECK(rekeyed.size() == whole.size());
+    // Same salt, new file salt and nonce prefix (header bytes 32..52), new ciphertext.
+    CHECK(rekeyed.compare(0, 32, whole, 0, 32) == 0);
+    CHECK(rekeyed.compare(32, 20, whole, 32, 20) != 0);
+    CHECK(rekeyed.compare(52, string::npos, whole, 52, string::npos) != 0);
+
+    {
+        CryptoUtils::SealedLog log;
+        CHECK(log.open(path, PASSWORD, nullptr) && log.records() == 100);
+        written.push_back("after the crash\n");
+        CHECK(log.append(written.back()));
+    }
+    string text, joined;
+    for (const string &r : written) joined += r;
+    CHECK(readLog(path, records) && records == written);
+    CHECK(decryptAll(path, text) && text == joined);
+
+    string damaged = readFile(path);
+    damaged[damaged.size() / 2] ^= 0x01;
+    writeFile(path + ".bad", damaged);
+    CHECK(!readLog(path + ".bad", records));
+}
+
+static void blockArchives(const string &dir) {
+    string text = transactionLines(60000);
+    struct Setup { BlockCodec codec; EntropyCodec::Id entropy; };
+    for (Setup s : {Setup{BlockCodec::Generic, EntropyCodec::HUFFMAN}, Setup{BlockCodec::Generic, EntropyCodec::RANS},
+                    Setup{BlockCodec::Transactions, EntropyCodec::HUFFMAN}}) {
+        string path = dir + "/archive" + to_string(int(s.codec)) + to_string(int(s.entropy));
+        BlockArchiveWriter writer(1 << 16, 2, s.codec, s.entropy);
+        CHECK(writer.open(path));
+        CHECK(writer.write(text.data(), text.size() / 2));
+        CHECK(writer.writeBlock(text.substr(text.size() / 2, 1000)));
+        CHECK(writer.write(text.data() + text.size() / 2 + 1000, text.size() - text.size() / 2 - 1000));
+        CHECK(writer.close(true));
+
+        BlockArchiveReader reader;
+        CHECK(BlockArchiveReader::isBlockArchive(path));
+        CHECK(reader.open(path));
+        CHECK(reader.blockCount() > 2 && reader.rawSize() == text.size());
+        string all, block;
+        for (size_t i = 0; i < reader.blockCount(); ++i) {
+            bool ok = reader.readBlock(i, block) && block.size() == reader.block(i).rawSize &&
+                      reader.block(i).rawOffset == all.size();
+            CHECK(ok);
+            all += block;
+        }
+        CHECK(all == text);
+        CHECK(reader.decompressTo(path + ".out", 2) && readFile(path + ".out") == text);
+    }
+}
+
+// The journal as Bank keeps it: one SealedLog record per line, newline included.
+static bool appendLines(const string &path, JournalChain *chain, size_t from, size_t count) {
+    CryptoUtils::SealedLog log;
+    if (!log.open(path, PASSWORD, nullptr)) return false;
+    for (size_t i = from; i < from + count; ++i) {
+        string line = Transaction("2024-05-01T12:00:00Z", "Deposit", double(i), int(i % 7)).serialize();
+        if (!log.append(line + "\n") || (chain && !chain->append(line))) return false;
+    }
+    return true;
+}
+
+static bool intact(const string &path, bool incremental = false) {
+    JournalChain chain(path, PASSWORD);
+    chain.open();
+    JournalVerifyReport report;
+    return chain.verify(path, incremental, report, 2) && report.intact;
+}
+
+static void journalChain(const string &dir) {
+    string path = dir + "/journal";
+    size_t records = JournalChain::CHECKPOINT_EVERY + 500;
+    {
+        JournalChain chain(path, PASSWORD);
+        CHECK(chain.open());
+        CHECK(appendLines(path, &chain, 0, records));
+        JournalVerifyReport report;
+        CHECK(chain.verify(path, false, report, 2) && report.intact && report.recordsChecked == records);
+        CHECK(chain.verify(path, true, report) && report.intact);
+    }
+    CHECK(intact(path));
+
+    // A crash after the journal append but before the chain's: open() carries the chain on.
+    string chainFiles[] = {path + ".chain", path + ".chainhead"};
+    string saved[] = {readFile(chainFiles[0]), readFile(chainFiles[1])};
+    CHECK(appendLines(path, nullptr, records, 3));
+    {
+        JournalChain chain(path, PASSWORD);
+        CHECK(chain.open());
+        CHECK(appendLines(path, &chain, records + 3, 1));
+    }
+    CHECK(intact(path));
+
+    // A journal that lost records: no appends, and verify says why. The chain is rolled back
+    // to before the last four records, the journal by five.
+    string journal = readFile(path);
+    {
+        string plain;
+        CHECK(decryptAll(path, plain));
+        for (int i = 0; i < 5; ++i) plain.resize(plain.rfind('\n', plain.size() - 2) + 1);
+        CHECK(Bank::writeJournal(path, plain, PASSWORD));
+    }
+    writeFile(chainFiles[0], saved[0]);
+    writeFile(chainFiles[1], saved[1]);
+    {
+        JournalChain chain(path, PASSWORD);
+        CHECK(!chain.open() && chain.loadedOnly());
+        CHECK(!chain.append("2024-05-01T12:00:00Z|Deposit|1|1"));
+        JournalVerifyReport report;
+        CHECK(chain.verify(path, false, report) && !report.intact && !report.problem.empty());
+    }
+
+    // An altered record, behind records past the head that open() chains as before.
+    writeFile(path, journal);
+    {
+        string plain;
+        CHECK(decryptAll(path, plain));
+        size_t at = plain.find("Deposit", plain.size() / 2);
+        plain.replace(at, 7, "Withdra");
+        CHECK(Bank::writeJournal(path, plain, PASSWORD));
+    }
+    CHECK(!intact(path));
+}
+
+int main() {
+    string dir = (filesystem::temp_directory_path() / ("storage_tests_" + to_string(random_device()()))).string();
+    filesystem::create_directories(dir);
+    roundTrips(dir);
+    rangeReads(dir);
+    tampering(dir);
+    tornLog(dir);
+    blockArchives(dir);
+    journalChain(dir);
+    error_code ec;
+    filesystem::remove_all(dir, ec);
+    if (failures) fprintf(stderr, "%d checks failed\n", failures);
+    else fprintf(stderr, "all checks passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+// account_monitor: reads balances from the shared account table the banking app publishes,
+// without talking to the app.
+//
+//   account_monitor [--name <segment>] [<account>...]
+//   account_monitor [--name <segment>] --watch <ms>
+//
+// Without accounts every row is listed; with them each is looked up. --watch prints a summary
+// (rows, total balance, bank version, age of the last update) every <ms> until interrupted.
+#include "../shm/AccountTableReader.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static int usage() {
+    cerr << "usage: account_monitor [--name <segment>] [<account>...]\n"
+            "       account_monitor [--name <segment>] --watch <ms>\n";
+    return 2;
+}
+
+static double ageSeconds(int64_t updatedNs) {
+    int64_t now = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    return (now - updatedNs) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    string name = "sbank-accounts";
+    int watchMs = 0;
+    vector<int> accounts;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--name" && hasValue) name = argv[++i];
+            else if (arg == "--watch" && hasValue) watchMs = stoi(argv[++i]);
+            else if (arg.rfind("--", 0) != 0) accounts.push_back(stoi(arg));
+            else return usage();
+        } catch (...) {
+            return usage();
+        }
+    }
+
+    AccountTableReader reader;
+    if (!reader.open(name)) {
+        cerr << name << ": no account table published\n";
+        return 1;
+    }
+    if (watchMs > 0) {
+        for (;;) {
+            size_t rows = 0;
+            double total = 0;
+            bool complete = reader.forEach([&](const SharedAccount &acc) {
+                ++rows;
+                total += acc.balance;
+                return true;
+            });
+            if (complete) {
+                printf("%zu accounts  total %.2f  version %llu  updated %.3fs ago\n", rows, total,
+                       (unsigned long long)reader.bankVersion(), ageSeconds(reader.updatedNs()));
+            } else {
+                printf("table unavailable\n");
+            }
+            fflush(stdout);
+            this_thread::sleep_for(chrono::milliseconds(watchMs));
+        }
+    }
+    int status = 0;
+    SharedAccount acc;
+    if (accounts.empty()) {
+        if (!reader.forEach([](const SharedAccount &a) {
+                printf("%d\t%.2f\t%llu\n", a.accountNumber, a.balance, (unsigned long long)a.version);
+                return true;
+            })) {
+            cerr << name << ": table replaced while reading\n";
+            status = 1;
+        }
+    }
+    for (int number : accounts) {
+        if (reader.find(number, acc)) {
+            printf("%d\t%.2f\t%llu\n", acc.accountNumber, acc.balance, (unsigned long long)acc.version);
+        } else {
+            cerr << number << ": not found\n";
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,171 @@
+// bank_replica: runs either end of journal log shipping (see src/replication) from the
+// command line, so a primary and a warm standby can be run side by side on one machine.
+//
+//   bank_replica primary <dir> [--data <file>] [--log <file>]
+//   bank_replica standby <dir> [--data <file>] [--log <file>] [--every <ms>]
+//   bank_replica promote <dir>
+//
+// The master password comes from SBANK_PASSWORD, or else the first line of stdin. The
+// primary loads its bank, ships every change to <dir> and takes commands on stdin:
+//   create <holder> <amount> | deposit <n> <amount> | withdraw <n> <amount> | delete <n>
+//   burst <count> (that many one-cent deposits, spread over the accounts) | save | stats | quit
+// The standby follows <dir> into its own bank files, printing metrics every <ms>, until
+// 'bank_replica promote <dir>' asks it to take over: it applies what was shipped, saves,
+// prints its totals and exits. Run each end in its own working directory, or give each its
+// own --data and --log: a bank keeps its temporary files beside them.
+#include "../replication/ReplicationPrimary.h"
+#include "../replication/ReplicationStandby.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+using namespace std;
+
+static int usage() {
+    cerr << "usage: bank_replica primary <dir> [--data <file>] [--log <file>]\n"
+            "       bank_replica standby <dir> [--data <file>] [--log <file>] [--every <ms>]\n"
+            "       bank_replica promote <dir>\n";
+    return 2;
+}
+
+static string promotePath(const string &dir) {
+    return (filesystem::path(dir) / "promote").string();
+}
+
+static void printMetrics(const char *side, const ReplicationMetrics &m) {
+    printf("%s seq %llu peer %llu lag %llu records %.1f ms  %.0f records/s %.0f bytes/s  images %llu\n", side,
+           (unsigned long long)m.lastSeq, (unsigned long long)m.peerSeq, (unsigned long long)m.lagRecords,
+           m.lagMs, m.recordsPerSec, m.bytesPerSec, (unsigned long long)m.images);
+    fflush(stdout);
+}
+
+static void printTotals(Bank &bank) {
+    auto view = bank.accountsSnapshot();
+    double total = 0;
+    for (size_t i = 0; i < view->size(); ++i) total += (*view)[i].getBalance();
+    printf("%zu accounts  total %.2f\n", view->size(), total);
+    fflush(stdout);
+}
+
+static int runPrimary(Bank &bank, const string &dir, const SecureString &password) {
+    ReplicationPrimary primary(bank, dir, password);
+    if (!primary.start()) {
+        cerr << dir << ": cannot ship there\n";
+        return 1;
+    }
+    string line;
+    while (getline(cin, line)) {
+        istringstream in(line);
+        string cmd;
+        in >> cmd;
+        bool ok = true;
+        if (cmd == "create") {
+            string holder;
+            double amount = 0;
+            in >> holder >> amount;
+            int number = bank.createAccount(holder, amount);
+            ok = number >= 0;
+            if (ok) printf("%d\n", number);
+        } else if (cmd == "deposit" || cmd == "withdraw") {
+            int number = 0;
+            double amount = 0;
+            in >> number >> amount;
+            ok = cmd == "deposit" ? bank.deposit(number, amount) : bank.withdraw(number, amount);
+        } else if (cmd == "delete") {
+            int number = 0;
+            in >> number;
+            ok = bank.deleteAccount(number);
+        } else if (cmd == "burst") {
+            size_t count = 0;
+            in >> count;
+            auto view = bank.accountsSnapshot();
+            for (size_t i = 0; ok && i < count && !view->empty(); ++i)
+                ok = bank.deposit((*view)[i % view->size()].getAccountNumber(), 0.01);
+        } else if (cmd == "save") {
+            ok = bank.save();
+        } else if (cmd == "stats") {
+            printMetrics("primary", primary.metrics());
+            printTotals(bank);
+        } else if (cmd == "quit") {
+            break;
+        } else if (!cmd.empty()) {
+            cerr << "unknown command: " << cmd << "\n";
+            continue;
+        }
+        if (!ok) cerr << line << ": failed\n";
+        fflush(stdout);
+    }
+    primary.stop();
+    return bank.save() ? 0 : 1;
+}
+
+static int runStandby(Bank &bank, const string &dir, const SecureString &password, int everyMs) {
+    error_code ec;
+    filesystem::remove(promotePath(dir), ec); // a request left from an earlier run
+    ReplicationStandby standby(bank, dir, password);
+    standby.start();
+    auto printed = chrono::steady_clock::now();
+    while (!filesystem::exists(promotePath(dir))) {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        if (chrono::steady_clock::now() - printed >= chrono::milliseconds(everyMs)) {
+            printMetrics("standby", standby.metrics());
+            printed = chrono::steady_clock::now();
+        }
+    }
+    filesystem::remove(promotePath(dir), ec);
+    bool promoted = standby.promote();
+    printMetrics("standby", standby.metrics());
+    if (!promoted) {
+        cerr << "promotion failed\n";
+        return 1;
+    }
+    printf("promoted\n");
+    printTotals(bank);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) return usage();
+    string mode = argv[1], dir = argv[2];
+    string dataFile = mode == "standby" ? "standby_accounts.dat" : "accounts.dat";
+    string logFile = mode == "standby" ? "standby_transactions.dat" : "transactions.dat";
+    int everyMs = 1000;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--data" && hasValue) dataFile = argv[++i];
+            else if (arg == "--log" && hasValue) logFile = argv[++i];
+            else if (arg == "--every" && hasValue) everyMs = stoi(argv[++i]);
+            else return usage();
+        } catch (...) {
+            return usage();
+        }
+    }
+    if (mode == "promote") {
+        ofstream(promotePath(dir)).close();
+        return filesystem::exists(promotePath(dir)) ? 0 : 1;
+    }
+    if (mode != "primary" && mode != "standby") return usage();
+
+    SecureString password;
+    if (const char *env = getenv("SBANK_PASSWORD")) {
+        password = env;
+    } else {
+        string line;
+        getline(cin, line);
+        password = line;
+        fill(line.begin(), line.end(), '\0');
+    }
+    Bank bank(dataFile, logFile, password);
+    if (mode == "primary") {
+        if (!bank.load()) cerr << dataFile << ": could not load, starting empty\n";
+        return runPrimary(bank, dir, password);
+    }
+    return runStandby(bank, dir, password, everyMs);
+}
@@ -0,0 +1,124 @@
+// compression_bench: compares the archive codecs on real files.
+//
+//   compression_bench [--password <pw>] [--block <bytes>] <file>...
+//
+// With --password the inputs are decrypted first (transactions.dat, accounts.dat). Each file
+// is cut into archive-sized blocks and run through every layout/entropy coder pair the block
+// container can write; the table shows the stored size and single-thread encode/decode rates.
+#include "../compression/BlockArchive.h"
+#include "../compression/EntropyCodec.h"
+#include "../compression/TransactionCodec.h"
+#include "../crypto/CryptoUtils.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+using namespace std;
+
+static bool loadInput(const string &path, const string &password, string &data) {
+    data.clear();
+    if (password.empty()) {
+        ifstream in(path, ios::binary);
+        if (!in) return false;
+        data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        return true;
+    }
+    return CryptoUtils::decryptStream(path, password, [&](const unsigned char *p, size_t n) {
+        data.append(reinterpret_cast<const char*>(p), n);
+        return true;
+    });
+}
+
+// Splits at the last newline before each block boundary, as the archive job does.
+static vector<string> cutBlocks(const string &data, size_t blockSize) {
+    vector<string> blocks;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t end = min(data.size(), pos + blockSize);
+        if (end < data.size()) {
+            size_t nl = data.rfind('\n', end - 1);
+            if (nl != string::npos && nl >= pos) end = nl + 1;
+        }
+        blocks.push_back(data.substr(pos, end - pos));
+        pos = end;
+    }
+    return blocks;
+}
+
+template <typename F>
+static double bestSeconds(F f) {
+    double best = 1e30;
+    for (int rep = 0; rep < 5; ++rep) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+static void benchFile(const string &name, const string &data, size_t blockSize) {
+    vector<string> blocks = cutBlocks(data, blockSize);
+    printf("%s: %zu bytes, %zu blocks\n", name.c_str(), data.size(), blocks.size());
+    printf("  %-14s %-8s %12s %7s %10s %10s\n", "layout", "coder", "bytes", "ratio", "enc MB/s", "dec MB/s");
+    double mb = data.size() / 1e6;
+    for (BlockCodec layout : {BlockCodec::Generic, BlockCodec::Transactions}) {
+        for (const EntropyCodec *entropy : EntropyCodec::all()) {
+            vector<string> coded(blocks.size());
+            bool ok = true;
+            double enc = bestSeconds([&] {
+                for (size_t i = 0; i < blocks.size(); ++i) {
+                    coded[i].clear();
+                    const string &b = blocks[i];
+                    ok = (layout == BlockCodec::Transactions ? TransactionCodec::encode(b.data(), b.size(), coded[i], *entropy)
+                                                             : entropy->compress(b.data(), b.size(), coded[i])) && ok;
+                }
+            });
+            size_t total = 0;
+            for (const string &c : coded) total += c.size();
+            string back;
+            double dec = bestSeconds([&] {
+                back.clear();
+                for (size_t i = 0; i < coded.size(); ++i) {
+                    const string &c = coded[i];
+                    size_t rawSize = blocks[i].size();
+                    ok = (layout == BlockCodec::Transactions ? TransactionCodec::decode(c.data(), c.size(), back, rawSize)
+                                                             : entropy->decompress(c.data(), c.size(), back, rawSize)) && ok;
+                }
+            });
+            ok = ok && back == data;
+            printf("  %-14s %-8s %12zu %7.2f %10.0f %10.0f%s\n",
+                   layout == BlockCodec::Transactions ? "transactions" : "generic", entropy->name(), total,
+                   total ? double(data.size()) / total : 0.0, mb / enc, mb / dec, ok ? "" : "  ROUND-TRIP FAILED");
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    string password;
+    size_t blockSize = BlockArchiveWriter::DEFAULT_BLOCK_SIZE;
+    vector<string> files;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--password" && i + 1 < argc) password = argv[++i];
+        else if (arg == "--block" && i + 1 < argc) blockSize = stoul(argv[++i]);
+        else files.push_back(arg);
+    }
+    if (files.empty() || blockSize == 0) {
+        cerr << "usage: compression_bench [--password <pw>] [--block <bytes>] <file>...\n";
+        return 2;
+    }
+    int status = 0;
+    for (const string &f : files) {
+        string data;
+        if (!loadInput(f, password, data) || data.empty()) {
+            cerr << f << ": cannot read" << (password.empty() ? "" : " or decrypt") << "\n";
+            status = 1;
+            continue;
+        }
+        benchFile(f, data, blockSize);
+    }
+    return status;
+}
@@ -0,0 +1,171 @@
+// crypto_bench: file encryption throughput against the original implementation.
+//
+//   crypto_bench [--dir <path>] [--threads <n>] [<size>...]
+//
+// Sizes take K/M/G suffixes and default to 1M 100M 1G. For each size a file of that many
+// pseudo-random bytes is written to --dir (the temp directory by default) and encrypted and
+// decrypted with CryptoUtils, and with the original serial AES-256-CBC code that streamed
+// through 4 KB buffers. Every run includes its PBKDF2 key derivation; the best of a few runs
+// is shown, and the files are left in the page cache so the numbers are CPU and copy bound.
+#include "../crypto/CryptoUtils.h"
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// The file format and code the app shipped with: salt | iv | AES-256-CBC, 4 KB at a time.
+namespace Original {
+
+static bool deriveKey(const string &password, const unsigned char *salt, unsigned char *key) {
+    return PKCS5_PBKDF2_HMAC(password.c_str(), int(password.size()), salt, 16, 100000, EVP_sha256(), 32, key) == 1;
+}
+
+static bool crypt(bool encrypt, const string &inPath, const string &outPath, const string &password) {
+    ifstream in(inPath, ios::binary);
+    ofstream out(outPath, ios::binary);
+    if (!in || !out) return false;
+    unsigned char salt[16], iv[16], key[32];
+    if (encrypt) {
+        if (!RAND_bytes(salt, 16) || !RAND_bytes(iv, 16)) return false;
+        out.write(reinterpret_cast<char*>(salt), 16);
+        out.write(reinterpret_cast<char*>(iv), 16);
+    } else {
+        in.read(reinterpret_cast<char*>(salt), 16);
+        in.read(reinterpret_cast<char*>(iv), 16);
+        if (!in) return false;
+    }
+    if (!deriveKey(password, salt, key)) return false;
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx || EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv, encrypt ? 1 : 0) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        return false;
+    }
+    const size_t BUF_SIZE = 4096;
+    vector<unsigned char> inbuf(BUF_SIZE), outbuf(BUF_SIZE + 16);
+    int outlen = 0;
+    bool ok = true;
+    while (ok && in) {
+        in.read(reinterpret_cast<char*>(inbuf.data()), BUF_SIZE);
+        streamsize len = in.gcount();
+        if (len <= 0) break;
+        ok = EVP_CipherUpdate(ctx, outbuf.data(), &outlen, inbuf.data(), int(len)) == 1;
+        out.write(reinterpret_cast<char*>(outbuf.data()), outlen);
+    }
+    ok = ok && EVP_CipherFinal_ex(ctx, outbuf.data(), &outlen) == 1;
+    if (ok) out.write(reinterpret_cast<char*>(outbuf.data()), outlen);
+    EVP_CIPHER_CTX_free(ctx);
+    out.close();
+    return ok && bool(out);
+}
+
+}
+
+static bool parseSize(const string &arg, uint64_t &size) {
+    size_t end = 0;
+    try {
+        size = stoull(arg, &end);
+    } catch (...) {
+        return false;
+    }
+    string suffix = arg.substr(end);
+    if (suffix == "K" || suffix == "k") size <<= 10;
+    else if (suffix == "M" || suffix == "m") size <<= 20;
+    else if (suffix == "G" || suffix == "g") size <<= 30;
+    else if (!suffix.empty()) return false;
+    return size > 0;
+}
+
+static bool writeInput(const string &path, uint64_t size) {
+    ofstream out(path, ios::binary);
+    vector<unsigned char> buf(1 << 20);
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (uint64_t done = 0; done < size && out; done += buf.size()) {
+        for (size_t i = 0; i < buf.size(); i += 8) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            for (int k = 0; k < 8; ++k) buf[i + k] = static_cast<unsigned char>(x >> (8 * k));
+        }
+        out.write(reinterpret_cast<char*>(buf.data()), streamsize(min<uint64_t>(buf.size(), size - done)));
+    }
+    return bool(out);
+}
+
+static bool sameFile(const string &a, const string &b) {
+    ifstream fa(a, ios::binary), fb(b, ios::binary);
+    vector<char> ba(1 << 20), bb(1 << 20);
+    while (fa && fb) {
+        fa.read(ba.data(), ba.size());
+        fb.read(bb.data(), bb.size());
+        if (fa.gcount() != fb.gcount() || !equal(ba.begin(), ba.begin() + fa.gcount(), bb.begin())) return false;
+    }
+    return fa.eof() && fb.eof();
+}
+
+template <typename F>
+static double bestSeconds(int reps, bool &ok, F f) {
+    double best = 1e30;
+    for (int rep = 0; rep < reps; ++rep) {
+        auto t0 = chrono::steady_clock::now();
+        ok = f() && ok;
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    string dir = filesystem::temp_directory_path().string();
+    size_t threads = 0;
+    vector<uint64_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        uint64_t size;
+        if (arg == "--dir" && i + 1 < argc) dir = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = stoul(argv[++i]);
+        else if (parseSize(arg, size)) sizes.push_back(size);
+        else {
+            cerr << "usage: crypto_bench [--dir <path>] [--threads <n>] [<size>[K|M|G]...]\n";
+            return 2;
+        }
+    }
+    if (sizes.empty()) sizes = {1ull << 20, 100ull << 20, 1ull << 30};
+
+    const string password = "crypto_bench";
+    const string plain = (filesystem::path(dir) / "crypto_bench.plain").string();
+    const string sealed = (filesystem::path(dir) / "crypto_bench.enc").string();
+    const string back = (filesystem::path(dir) / "crypto_bench.dec").string();
+    printf("%10s %-9s %10s %10s\n", "size", "code", "enc MB/s", "dec MB/s");
+    int status = 0;
+    for (uint64_t size : sizes) {
+        if (!writeInput(plain, size)) {
+            cerr << plain << ": cannot write input\n";
+            return 1;
+        }
+        int reps = int(max<uint64_t>(1, min<uint64_t>(5, (256ull << 20) / size)));
+        double mb = size / 1e6;
+
+        bool ok = true;
+        double enc = bestSeconds(reps, ok, [&] { return Original::crypt(true, plain, sealed, password); });
+        double dec = bestSeconds(reps, ok, [&] { return Original::crypt(false, sealed, back, password); });
+        ok = ok && sameFile(plain, back);
+        printf("%9.0fM %-9s %10.0f %10.0f%s\n", size / 1048576.0, "original", mb / enc, mb / dec,
+               ok ? "" : "  ROUND-TRIP FAILED");
+        status |= !ok;
+
+        ok = true;
+        enc = bestSeconds(reps, ok, [&] { return CryptoUtils::encryptFile(plain, sealed, password, threads); });
+        dec = bestSeconds(reps, ok, [&] { return CryptoUtils::decryptFile(sealed, back, password); });
+        ok = ok && sameFile(plain, back);
+        printf("%9.0fM %-9s %10.0f %10.0f%s\n", size / 1048576.0, "chunked", mb / enc, mb / dec,
+               ok ? "" : "  ROUND-TRIP FAILED");
+        status |= !ok;
+    }
+    error_code ec;
+    for (const string &path : {plain, sealed, back}) filesystem::remove(path, ec);
+    return status;
+}
@@ -0,0 +1,107 @@
+// bank_search: looks accounts up by holder name through the bank's name index (see
+// src/core/HolderIndex.h), a page at a time.
+//
+//   bank_search [--data <file>] [--log <file>] [--shards <n>] [--exact | --prefix] [--page-size <n>]
+//               [--pages <n>] <name>
+//
+// Without --exact or --prefix the whole name is matched ignoring case and spacing; --prefix
+// matches the start of any word of it. Matches go to stdout one per line (number, holder,
+// balance), <n> pages of --page-size (default 50) at most; a summary goes to stderr. With
+// --shards the bank is a ShardedBank of <n> partitions (see src/core/ShardedBank.h), searched
+// all at once; a single-file bank is split over them first. The master password comes from
+// SBANK_PASSWORD, or else the first line of stdin.
+#include "../core/ShardedBank.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+using namespace std;
+
+static int usage() {
+    cerr << "usage: bank_search [--data <file>] [--log <file>] [--shards <n>] [--exact | --prefix] [--page-size <n>]\n"
+            "                   [--pages <n>] <name>\n";
+    return 2;
+}
+
+static void printAccount(const BankAccount &acc) {
+    printf("%d\t%s\t%.2f\n", acc.getAccountNumber(), acc.getHolderName().c_str(), acc.getBalance());
+}
+
+int main(int argc, char *argv[]) {
+    string dataFile = "accounts.dat", logFile = "transactions.dat";
+    HolderQuery query;
+    query.limit = 50;
+    size_t pages = SIZE_MAX, shardCount = 0;
+    bool named = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--data" && hasValue) dataFile = argv[++i];
+            else if (arg == "--log" && hasValue) logFile = argv[++i];
+            else if (arg == "--shards" && hasValue) shardCount = max<size_t>(1, stoul(argv[++i]));
+            else if (arg == "--exact") query.mode = HolderQuery::Exact;
+            else if (arg == "--prefix") query.mode = HolderQuery::Prefix;
+            else if (arg == "--page-size" && hasValue) query.limit = max<size_t>(1, stoul(argv[++i]));
+            else if (arg == "--pages" && hasValue) pages = stoul(argv[++i]);
+            else if (arg.rfind("--", 0) == 0 || named) return usage();
+            else {
+                query.text = arg;
+                named = true;
+            }
+        } catch (...) {
+            return usage();
+        }
+    }
+    if (!named) return usage();
+
+    SecureString password;
+    if (const char *env = getenv("SBANK_PASSWORD")) {
+        password = env;
+    } else {
+        string line;
+        getline(cin, line);
+        password = line;
+        fill(line.begin(), line.end(), '\0');
+    }
+    unique_ptr<Bank> bank;
+    unique_ptr<ShardedBank> sharded;
+    if (shardCount) sharded = make_unique<ShardedBank>(dataFile, logFile, password, shardCount);
+    else bank = make_unique<Bank>(dataFile, logFile, password);
+    auto started = chrono::steady_clock::now();
+    if (!(sharded ? sharded->load() : bank->load())) {
+        cerr << "cannot read " << dataFile << (sharded ? " (wrong password, or another --shards?)\n" : " (wrong password?)\n");
+        return 1;
+    }
+    double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    started = chrono::steady_clock::now();
+    size_t matches = 0, shown = 0;
+    bool more = false;
+    do {
+        if (shown == pages) break;
+        if (sharded) {
+            ShardedBank::HolderPage page;
+            if (!sharded->searchHolders(query, page)) return 1;
+            for (const BankAccount &acc : page.accounts) printAccount(acc);
+            matches += page.accounts.size();
+            query.after = page.next;
+            more = page.more;
+        } else {
+            Bank::HolderPage page;
+            bank->searchHolders(query, page);
+            for (size_t pos : page.positions) printAccount((*page.view)[pos]);
+            matches += page.positions.size();
+            query.after = page.next;
+            more = page.more;
+        }
+        ++shown;
+    } while (more);
+    double searchSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    fprintf(stderr, "%zu matches in %zu pages%s; loaded in %.2fs, searched in %.4fs\n", matches, shown,
+            more ? " (more follow)" : "", loadSeconds, searchSeconds);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// bank_reconcile: replays the transaction journal and checks the balances in the accounts
+// file against it (see src/audit/Reconciler.h).
+//
+//   bank_reconcile [--data <file>] [--log <file>] [--catalog <file>] [--threads <n>] [--show <n>]
+//
+// --catalog also replays the archived part of the journal, for logs trimmed by archiving.
+// The master password comes from SBANK_PASSWORD, or else the first line of stdin. The first
+// <n> discrepancies (default 50) go to stdout, a summary to stderr; the exit status is 0 only
+// if the two agree.
+#include "../audit/Reconciler.h"
+#include "../archive/ArchiveCatalog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+using namespace std;
+
+static int usage() {
+    cerr << "usage: bank_reconcile [--data <file>] [--log <file>] [--catalog <file>] [--threads <n>] [--show <n>]\n";
+    return 2;
+}
+
+static const char *kindName(Discrepancy::Kind kind) {
+    switch (kind) {
+    case Discrepancy::BalanceMismatch: return "balance";
+    case Discrepancy::JournalOnly: return "journal-only";
+    case Discrepancy::CloseMismatch: return "close";
+    }
+    return "?";
+}
+
+int main(int argc, char *argv[]) {
+    string dataFile = "accounts.dat", logFile = "transactions.dat", catalogPath;
+    size_t threads = 0, show = 50;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--data" && hasValue) dataFile = argv[++i];
+            else if (arg == "--log" && hasValue) logFile = argv[++i];
+            else if (arg == "--catalog" && hasValue) catalogPath = argv[++i];
+            else if (arg == "--threads" && hasValue) threads = stoul(argv[++i]);
+            else if (arg == "--show" && hasValue) show = stoul(argv[++i]);
+            else return usage();
+        } catch (...) {
+            return usage();
+        }
+    }
+
+    SecureString password;
+    if (const char *env = getenv("SBANK_PASSWORD")) {
+        password = env;
+    } else {
+        string line;
+        getline(cin, line);
+        password = line;
+        fill(line.begin(), line.end(), '\0');
+    }
+    Reconciler reconciler(password, threads);
+    unique_ptr<ArchiveCatalog> catalog;
+    if (!catalogPath.empty()) {
+        catalog = make_unique<ArchiveCatalog>(catalogPath);
+        if (!catalog->load()) {
+            cerr << catalogPath << ": cannot read the catalog\n";
+            return 1;
+        }
+        reconciler.setArchives(catalog.get());
+    }
+    ReconcileReport report;
+    if (!reconciler.reconcileFiles(dataFile, logFile, report)) {
+        cerr << "cannot read " << dataFile << " or " << logFile << " (wrong password?)\n";
+        return 1;
+    }
+    for (size_t i = 0; i < report.discrepancies.size() && i < show; ++i) {
+        const Discrepancy &d = report.discrepancies[i];
+        printf("%d\t%s\taccounts %.2f\tjournal %.2f\t%llu records\n", d.accountNumber, kindName(d.kind),
+               d.snapshotCents / 100.0, d.journalCents / 100.0, (unsigned long long)d.records);
+    }
+    fprintf(stderr, "%llu records, %llu accounts, %zu discrepancies in %.2fs\n", (unsigned long long)report.records,
+            (unsigned long long)report.accounts, report.discrepancies.size(), report.seconds);
+    if (report.unattributed)
+        fprintf(stderr, "%llu records (%.2f) name no account\n", (unsigned long long)report.unattributed,
+                report.unattributedCents / 100.0);
+    if (report.unreadable) fprintf(stderr, "%llu lines could not be read\n", (unsigned long long)report.unreadable);
+    return report.consistent() ? 0 : 1;
+}